@@ -1,11 +1,17 @@
 import sys
 from pathlib import Path
-from flask import Flask, request, jsonify, send_file
+from flask import Flask, Response, request, jsonify, send_file
 from werkzeug.utils import secure_filename
 import os
 import io
 from PIL import Image
-from stable_diffusion.pipeline_service import generate_image, load_pipelines
+if os.getenv('STUB_PIPELINE') == '1':
+    # Canned frames at a steady pace, for trying clients without a GPU
+    from stable_diffusion.stub_pipeline import generate_images, load_pipelines
+else:
+    from stable_diffusion.pipeline_service import generate_images, load_pipelines
+from stable_diffusion.profiles import PROFILES, DEFAULT_PROFILE
+from jobs import Job, JobQueue
 from datetime import datetime
 import logging
 from functools import wraps
@@ -13,6 +19,9 @@ from dotenv import load_dotenv
 import torch
 import threading  # Import threading
 import uuid  # Import uuid for unique filenames
+import hashlib
+import json
+import random
 
 # Add project root to sys.path if necessary
 project_root = Path(__file__).resolve().parent.parent
@@ -31,16 +40,22 @@ app = Flask(__name__)
 
 # Configuration
 INPUT_FOLDER = Path('input_images')
+SURFACES_FOLDER = INPUT_FOLDER / 'surfaces'  # uploaded once, named by content hash
 OUTPUT_FOLDER = Path('output_images')
 CERTS_FOLDER = Path('ssl_cert')
-ALLOWED_EXTENSIONS = {'png', 'jpg', 'jpeg', 'gif'}
+ALLOWED_EXTENSIONS = {'png', 'jpg', 'jpeg', 'gif', 'webp'}
 MAX_CONTENT_LENGTH = 16 * 1024 * 1024  # 16 MB limit
+MAX_CANDIDATES = 9  # images per /generate request
+JOB_TTL_SECONDS = 600  # finished jobs are forgotten after this
+JOB_POLL_SECONDS = 15  # how long an image stream waits on its job between checks
+PREVIEW_QUALITY = 80  # JPEG quality of previews; they are 1/8 of the output size and soon replaced
 
 app.config['INPUT_FOLDER'] = INPUT_FOLDER
 app.config['OUTPUT_FOLDER'] = OUTPUT_FOLDER
 
 # Ensure the upload and output folders exist
 INPUT_FOLDER.mkdir(parents=True, exist_ok=True)
+SURFACES_FOLDER.mkdir(parents=True, exist_ok=True)
 OUTPUT_FOLDER.mkdir(parents=True, exist_ok=True)
 
 # Initialize logging
@@ -85,95 +100,351 @@ with app.app_context():
 # Create a global lock
 generate_image_lock = threading.Lock()
 
-@app.route('/generate', methods=['POST'])
-@require_api_key  # Apply the API key requirement
-def generate():
-    # Check if the post request has the file part
+UPLOAD_MODES = ('photo', 'edges')
+
+
+def save_upload(file, mode, path):
+    """
+    Saves an uploaded photo or edge map ready for generation. Photos are fitted within 640x360 (clients
+    upload only the calibrated region, so their aspect ratio is kept); edge maps arrive traced at
+    generation size and are kept as they are.
+    """
+    file.save(path)
+    logger.info(f"Image saved to {path}.")
+    if mode == 'photo':
+        with Image.open(path) as img:
+            resized_image = img.copy()
+            resized_image.thumbnail((640, 360))
+            resized_image.save(path)
+        logger.info(f"Image resized to {resized_image.size} and saved at {path}.")
+
+
+def find_surface(surface_id):
+    """Returns (path, mode) of a stored surface, or (None, None) if there is none with this id."""
+    if not surface_id or not all(c in '0123456789abcdef' for c in surface_id):
+        return None, None
+    for path in SURFACES_FOLDER.glob(f"{surface_id}.*.*"):
+        mode = path.name.split('.')[1]
+        if mode in UPLOAD_MODES:
+            return path, mode
+    return None, None
+
+
+def validate_upload():
+    """Returns (file, mode, error response) for the image part of a multipart request."""
     if 'image' not in request.files:
         logger.error("No image part in the request.")
-        return jsonify({'error': 'No image part in the request'}), 400
+        return None, None, (jsonify({'error': 'No image part in the request'}), 400)
 
     file = request.files['image']
-
     if file.filename == '':
         logger.error("No selected file in the request.")
-        return jsonify({'error': 'No selected file'}), 400
+        return None, None, (jsonify({'error': 'No selected file'}), 400)
+    if not allowed_file(file.filename):
+        logger.error("Unsupported file type uploaded.")
+        return None, None, (jsonify({'error': 'Unsupported file type'}), 400)
+
+    # Edge maps arrive traced at generation size; photos are traced here
+    mode = request.form.get('mode', 'photo')
+    if mode not in UPLOAD_MODES:
+        logger.error(f"Unknown upload mode '{mode}'.")
+        return None, None, (jsonify({'error': 'Unknown upload mode'}), 400)
+
+    return file, mode, None
+
+
+@app.route('/surfaces', methods=['POST'])
+@require_api_key
+def upload_surface():
+    """
+    Stores a surface (photo or edge map) once so generation requests can refer to it by id. The id is
+    a hash of the content, so uploading the same surface again is cheap and returns the same id.
+    """
+    file, mode, error = validate_upload()
+    if error:
+        return error
+
+    surface_id = surface_hash(mode, file.read())
+    existing, _ = find_surface(surface_id)
+    if existing:
+        logger.info(f"Surface {surface_id} already stored.")
+        return jsonify({'surface_id': surface_id}), 200
+
+    file_ext = file.filename.rsplit('.', 1)[1].lower()
+    path = SURFACES_FOLDER / f"{surface_id}.{mode}.{file_ext}"
+    partial_path = SURFACES_FOLDER / f"{uuid.uuid4().hex}.partial.{file_ext}"
+    try:
+        file.stream.seek(0)
+        save_upload(file, mode, partial_path)
+        os.replace(partial_path, path)  # never seen half written
+    except Exception:
+        logger.exception("Error storing the surface.")
+        if os.path.exists(partial_path):
+            os.remove(partial_path)
+        return jsonify({'error': 'Error storing the surface'}), 500
+
+    logger.info(f"Surface {surface_id} stored at {path}.")
+    return jsonify({'surface_id': surface_id}), 201
+
+
+def surface_hash(mode, data):
+    """Content hash of an upload; stored surfaces are named by it."""
+    return hashlib.sha256(mode.encode() + b'\0' + data).hexdigest()
+
+
+def request_fingerprint(surface, count, generation_args, seed_given):
+    """
+    Identifies requests that would produce the same images: the surface's content hash and every
+    parameter but the path it was saved at. A seed the server picked is left out, so identical
+    requests that leave the seed to the server can share one.
+    """
+    params = {key: value for key, value in generation_args.items()
+              if key != 'image_path' and (key != 'seed' or seed_given)}
+    return hashlib.sha256(json.dumps([surface, count, params], sort_keys=True).encode()).hexdigest()
+
+
+def job_from_request():
+    """
+    Reads a generation request: either a small JSON body naming a stored surface, or a multipart upload
+    with the image in it. Returns (Job, error response).
+    """
+    if request.is_json:
+        fields = request.get_json(silent=True) or {}
+        surface = fields.get('surface_id')
+        upload_path, mode = find_surface(surface)
+        if upload_path is None:
+            logger.warning(f"Unknown surface '{surface}'.")
+            return None, (jsonify({'error': 'Unknown surface'}), 404)
+        remove_path = None  # stored surfaces are kept for the next prompt
+    else:
+        fields = request.form
+        file, mode, error = validate_upload()
+        if error:
+            return None, error
+        surface = surface_hash(mode, file.read())
+        file.stream.seek(0)
 
-    if file and allowed_file(file.filename):
         # Generate a unique filename using UUID
         file_ext = file.filename.rsplit('.', 1)[1].lower()
-        unique_filename = f"{uuid.uuid4().hex}.{file_ext}"
-        upload_path = INPUT_FOLDER / unique_filename
-        file.save(upload_path)
-        logger.info(f"Image saved to {upload_path}.")
-    else:
-        logger.error("Unsupported file type uploaded.")
-        return jsonify({'error': 'Unsupported file type'}), 400
+        upload_path = INPUT_FOLDER / f"{uuid.uuid4().hex}.{file_ext}"
+        remove_path = upload_path
+        try:
+            save_upload(file, mode, upload_path)
+        except Exception:
+            logger.exception("Error resizing the image.")
+            os.remove(upload_path)
+            return None, (jsonify({'error': 'Error resizing the image'}), 500)
 
-    # Resize the image to 640x360
-    try:
-        with Image.open(upload_path) as img:
-            resized_image = img.resize((640, 360))
-            resized_image.save(upload_path)
-        logger.info(f"Image resized to 640x360 and saved at {upload_path}.")
-    except Exception as e:
-        logger.exception("Error resizing the image.")
-        os.remove(upload_path)
-        return jsonify({'error': 'Error resizing the image'}), 500
+    def fail(message):
+        logger.error(f"{message} in the request.")
+        if remove_path and os.path.exists(remove_path):
+            os.remove(remove_path)
+        return None, (jsonify({'error': message}), 400)
 
     # Get additional form data
-    prompt = request.form.get('prompt')
-    style = request.form.get('style', "animated")  # Default style
-    lo_threshold = request.form.get('lo_threshold', 100)
-    hi_threshold = request.form.get('hi_threshold', 200)
+    prompt = fields.get('prompt')
+    style = fields.get('style', "animated")  # Default style
+    lo_threshold = fields.get('lo_threshold', 100)
+    hi_threshold = fields.get('hi_threshold', 200)
 
     if not prompt:
-        logger.error("No prompt provided in the request.")
-        return jsonify({'error': 'No prompt provided'}), 400
+        return fail('No prompt provided')
 
     try:
-        # Acquire the lock before starting image generation
-        with generate_image_lock:
-            logger.info(f"Processing image generation for {upload_path} with prompt '{prompt}'.")
-            # Generate the image using the pipeline
-            generated_image = generate_image(
-                image_path=str(upload_path),
-                prompt=prompt,
-                style=style,
-                lo_threshold=int(lo_threshold),
-                hi_threshold=int(hi_threshold)
-            )
-
-        # Convert PIL Image to bytes
-        img_byte_arr = io.BytesIO()
-        generated_image.save(img_byte_arr, format='PNG')
-        img_byte_arr.seek(0)
-
-        # Optionally, save the generated image to the output folder
-        timestamp = datetime.now().strftime("%Y%m%d_%H%M%S_%f")
-        output_image_filename = f"{timestamp}_{uuid.uuid4().hex}.png"
-        output_image_path = OUTPUT_FOLDER / output_image_filename
-        generated_image.save(output_image_path)
-        logger.info(f"Generated image saved to {output_image_path}.")
-
-        # Remove the uploaded file after processing to save space
-        # os.remove(upload_path)
-        logger.info(f"Uploaded file {upload_path} removed after processing.")
-
-        return send_file(
-            img_byte_arr,
-            mimetype='image/png',
-            as_attachment=True,
-            download_name='generated_image.png'
-        )
+        count = min(max(int(fields.get('count', 1)), 1), MAX_CANDIDATES)
+    except (TypeError, ValueError):
+        return fail('Invalid count')
 
-    except Exception as e:
-        logger.exception("Error during image generation.")
-        # Ensure the uploaded file is removed even if an error occurs
-        if os.path.exists(upload_path):
-            os.remove(upload_path)
-            logger.info(f"Uploaded file {upload_path} removed after error.")
-        return jsonify({'error': str(e)}), 500
+    profile = fields.get('profile', DEFAULT_PROFILE)
+    if profile not in PROFILES:
+        return fail('Unknown profile')
+
+    # Picked here rather than by the pipeline so every image can be labelled with its own (seed + index)
+    seed_given = fields.get('seed') not in (None, '')
+    try:
+        seed = int(fields['seed']) if seed_given else random.randrange(2 ** 31)
+    except (TypeError, ValueError):
+        return fail('Invalid seed')
+
+    generation_args = dict(
+        image_path=str(upload_path),
+        prompt=prompt,
+        style=style,
+        lo_threshold=int(float(lo_threshold)),
+        hi_threshold=int(float(hi_threshold)),
+        edges=(mode == 'edges'),
+        profile=profile,
+        seed=seed
+    )
+    fingerprint = request_fingerprint(surface, count, generation_args, seed_given)
+    return Job(generation_args, count, cleanup_path=remove_path, fingerprint=fingerprint), None
+
+
+@app.route('/generate', methods=['POST'])
+@require_api_key  # Apply the API key requirement
+def generate():
+    """
+    Generates while the client waits: one PNG, or for count > 1 a multipart/mixed stream of them, each
+    sent as soon as it is refined. Runs as a job like /jobs, so an identical request already in flight
+    is shared rather than generated again; a stream the client leaves early gives up its share.
+    """
+    job, error = job_from_request()
+    if error:
+        return error
+    job = job_queue.submit(job)
+
+    if job.count > 1:
+        boundary = uuid.uuid4().hex
+
+        def parts():
+            try:
+                yield from job_parts(job, boundary, previews=False)
+            finally:
+                if not job.finished:
+                    job_queue.cancel(job.id)
+
+        return Response(parts(), content_type=f'multipart/mixed; boundary={boundary}')
+
+    job.wait_until_finished()
+    if not job.images:
+        return jsonify({'error': job.error or 'Generation cancelled'}), 500
+
+    response = send_file(
+        io.BytesIO(job.images[0]),
+        mimetype='image/png',
+        as_attachment=True,
+        download_name='generated_image.png'
+    )
+    response.headers['X-Seed'] = str(job.generation_args['seed'])
+    return response
+
+
+def run_job(job):
+    """Runs a queued job on the job worker, adding each image to it as soon as it is refined."""
+    with generate_image_lock:
+        logger.info(f"Running job {job.id}: {job.count} images for {job.generation_args['image_path']} "
+                    f"with prompt '{job.generation_args['prompt']}'.")
+        images = generate_images(count=job.count, cancel_event=job.cancel_event, progress=job.set_progress,
+                                 preview=lambda index, image: job.set_preview(index, encode_preview(image)),
+                                 **job.generation_args)
+        for image in images:
+            job.add_image(save_generated_image(image))
+
+
+def encode_preview(image):
+    preview_bytes = io.BytesIO()
+    image.save(preview_bytes, format='JPEG', quality=PREVIEW_QUALITY)
+    return preview_bytes.getvalue()
+
+
+job_queue = JobQueue(run_job, ttl_seconds=JOB_TTL_SECONDS)
+
+
+@app.route('/jobs', methods=['POST'])
+@require_api_key
+def create_job():
+    """
+    Queues a generation and returns its id at once. The client then polls GET /jobs/<id>, or fetches
+    GET /jobs/<id>/images to receive the images as they are made, and DELETE /jobs/<id> to cancel it.
+    Takes the same fields as /generate; an identical request already queued or running returns that job.
+    """
+    job, error = job_from_request()
+    if error:
+        return error
+
+    job = job_queue.submit(job)
+    return jsonify(job.to_dict()), 202
+
+
+@app.route('/jobs/<job_id>', methods=['GET'])
+@require_api_key
+def get_job(job_id):
+    job = job_queue.get(job_id)
+    if job is None:
+        return jsonify({'error': 'Unknown job'}), 404
+    return jsonify(job.to_dict()), 200
+
+
+@app.route('/jobs/<job_id>', methods=['DELETE'])
+@require_api_key
+def cancel_job(job_id):
+    """
+    Gives up one request's share of a job. Once no request is left the job is cancelled: dropped if still
+    queued, otherwise stopped at the pipeline's next denoising step.
+    """
+    job = job_queue.cancel(job_id)
+    if job is None:
+        return jsonify({'error': 'Unknown job'}), 404
+    return jsonify(job.to_dict()), 200
+
+
+@app.route('/jobs/<job_id>/images', methods=['GET'])
+@require_api_key
+def stream_job_images(job_id):
+    """
+    Streams a job's images as multipart/mixed, those already made first and then each as it is refined.
+    Every part names its image in X-Candidate, and finished images carry their seed in X-Seed.
+    Parts marked X-Preview are low-resolution JPEG previews of an image still being denoised,
+    to be replaced by a later part for the same candidate.
+    The stream closes when the job ends; a failed or cancelled job closes it with fewer images than it asked for.
+    """
+    job = job_queue.get(job_id)
+    if job is None:
+        return jsonify({'error': 'Unknown job'}), 404
+
+    boundary = uuid.uuid4().hex
+    return Response(job_parts(job, boundary), content_type=f'multipart/mixed; boundary={boundary}')
+
+
+@app.route('/stats', methods=['GET'])
+@require_api_key
+def stats():
+    """Job counters, including how many requests were served by a job already in flight."""
+    return jsonify(job_queue.stats()), 200
+
+
+def job_parts(job, boundary, previews=True):
+    """The multipart/mixed body of a job's images (and previews), yielded as they are made."""
+
+    def part(data, content_type, candidate, seed=None, is_preview=False):
+        headers = (f"--{boundary}\r\n"
+                   f"Content-Type: {content_type}\r\n"
+                   f"Content-Length: {len(data)}\r\n"
+                   f"X-Candidate: {candidate}\r\n")
+        if seed is not None:
+            headers += f"X-Seed: {seed}\r\n"
+        if is_preview:
+            headers += "X-Preview: 1\r\n"
+        return (headers + "\r\n").encode() + data + b"\r\n"
+
+    sent = 0
+    seen = 0
+    finished = False
+    while not finished:
+        images, new_previews, seen, finished = job.wait_for_updates(sent, seen, timeout=JOB_POLL_SECONDS)
+        for data in images:
+            logger.info(f"Streaming image {sent + 1} of {job.count} for job {job.id}.")
+            yield part(data, 'image/png', sent, seed=job.generation_args['seed'] + sent)
+            sent += 1
+        if previews:
+            for index, data in sorted(new_previews.items()):
+                if index >= sent:
+                    yield part(data, 'image/jpeg', index, is_preview=True)
+    yield f"--{boundary}--\r\n".encode()
+
+
+def save_generated_image(image):
+    """Keeps a copy of a generated image in the output folder and returns it as PNG bytes."""
+    img_byte_arr = io.BytesIO()
+    image.save(img_byte_arr, format='PNG')
+
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S_%f")
+    output_image_path = OUTPUT_FOLDER / f"{timestamp}_{uuid.uuid4().hex}.png"
+    with open(output_image_path, 'wb') as output_file:
+        output_file.write(img_byte_arr.getvalue())
+    logger.info(f"Generated image saved to {output_image_path}.")
+
+    return img_byte_arr.getvalue()
 
 
 if __name__ == '__main__':
@@ -0,0 +1,226 @@
+# jobs.py
+
+import logging
+import os
+import queue
+import threading
+import time
+import uuid
+
+logger = logging.getLogger(__name__)
+
+
+class Job:
+    """
+    One generation request: its arguments, its state, the images it has produced so far (PNG bytes) and
+    the latest preview of each image still being made. Readers wait on the condition for any of these.
+    """
+    QUEUED = 'queued'
+    RUNNING = 'running'
+    DONE = 'done'
+    FAILED = 'failed'
+    CANCELLED = 'cancelled'
+
+    def __init__(self, generation_args, count, cleanup_path=None, fingerprint=None):
+        self.id = uuid.uuid4().hex
+        self.generation_args = generation_args
+        self.count = count
+        self.cleanup_path = cleanup_path  # temporary upload, removed once the job is over
+        self.fingerprint = fingerprint    # equal for requests that would produce the same images
+        self.subscribers = 1              # requests sharing this job; it is cancelled when none is left
+        self.cancel_event = threading.Event()
+        self.condition = threading.Condition()
+        self.status = Job.QUEUED
+        self.progress = 0.0
+        self.images = []
+        self.previews = {}  # image index -> (version, JPEG bytes) of its latest preview
+        self.version = 0    # bumped by every preview
+        self.error = None
+        self.finished_at = None
+
+    @property
+    def finished(self):
+        return self.status in (Job.DONE, Job.FAILED, Job.CANCELLED)
+
+    def to_dict(self):
+        with self.condition:
+            return {
+                'job_id': self.id,
+                'status': self.status,
+                'progress': round(self.progress, 3),
+                'count': self.count,
+                'profile': self.generation_args.get('profile'),
+                'seed': self.generation_args.get('seed'),
+                'images': len(self.images),
+                'error': self.error,
+                'subscribers': self.subscribers,
+            }
+
+    def set_status(self, status, error=None):
+        with self.condition:
+            if self.finished:
+                return
+            self.status = status
+            self.error = error
+            if self.finished:
+                self.finished_at = time.monotonic()
+            self.condition.notify_all()
+
+    def set_progress(self, fraction):
+        with self.condition:
+            self.progress = fraction
+            self.condition.notify_all()
+
+    def add_image(self, data):
+        with self.condition:
+            self.images.append(data)
+            self.condition.notify_all()
+
+    def set_preview(self, index, data):
+        with self.condition:
+            self.version += 1
+            self.previews[index] = (self.version, data)
+            self.condition.notify_all()
+
+    def wait_until_finished(self):
+        with self.condition:
+            while not self.finished:
+                self.condition.wait()
+
+    def wait_for_updates(self, sent, seen, timeout):
+        """
+        Returns (images after the first sent, {index: preview} newer than version seen, current version,
+        finished), waiting up to timeout seconds for any of them. Previews of finished images are left out.
+        """
+        with self.condition:
+            if len(self.images) <= sent and self.version <= seen and not self.finished:
+                self.condition.wait(timeout)
+            previews = {index: data for index, (version, data) in self.previews.items()
+                        if version > seen and index >= len(self.images)}
+            return self.images[sent:], previews, self.version, self.finished
+
+
+class JobQueue:
+    """
+    Runs jobs one at a time, in order, on a worker thread of its own. run_job(job) does the work and
+    adds the job's images; if it raises while the job is being cancelled, the job counts as cancelled.
+    Finished jobs are forgotten ttl_seconds after they end.
+
+    A job submitted with the fingerprint of one still queued or running is not queued: the request joins
+    the existing job instead, and shares its images. Cancelling only stops a job once every request
+    that joined it has cancelled.
+    """
+
+    def __init__(self, run_job, ttl_seconds=600):
+        self._run_job = run_job
+        self._ttl_seconds = ttl_seconds
+        self._jobs = {}
+        self._in_flight = {}  # fingerprint -> job queued or running
+        self._submitted = 0
+        self._coalesced = 0
+        self._jobs_lock = threading.Lock()
+        self._queue = queue.Queue()
+        self._worker = threading.Thread(target=self._work, name='JobWorker', daemon=True)
+        self._worker.start()
+
+    def submit(self, job):
+        """Queues job, or joins the matching job in flight; returns the job the request should follow."""
+        self._prune()
+        with self._jobs_lock:
+            self._submitted += 1
+            existing = self._in_flight.get(job.fingerprint) if job.fingerprint else None
+            if existing is not None and not existing.finished and not existing.cancel_event.is_set():
+                with existing.condition:
+                    existing.subscribers += 1
+                self._coalesced += 1
+            else:
+                existing = None
+                self._jobs[job.id] = job
+                if job.fingerprint:
+                    self._in_flight[job.fingerprint] = job
+
+        if existing is not None:
+            self._cleanup(job)  # its upload is not needed; the existing job has its own copy
+            logger.info(f"Request joined job {existing.id} ({existing.subscribers} requests share it).")
+            return existing
+
+        self._queue.put(job)
+        logger.info(f"Job {job.id} queued for {job.count} images.")
+        return job
+
+    def stats(self):
+        with self._jobs_lock:
+            jobs = list(self._jobs.values())
+            submitted, coalesced = self._submitted, self._coalesced
+        return {
+            'submitted': submitted,
+            'coalesced': coalesced,
+            'queued': sum(1 for job in jobs if job.status == Job.QUEUED),
+            'running': sum(1 for job in jobs if job.status == Job.RUNNING),
+        }
+
+    def get(self, job_id):
+        with self._jobs_lock:
+            return self._jobs.get(job_id)
+
+    def cancel(self, job_id):
+        with self._jobs_lock:
+            job = self._jobs.get(job_id)
+            if job is None:
+                return None
+            with job.condition:
+                job.subscribers = max(job.subscribers - 1, 0)
+                remaining = job.subscribers
+            if remaining > 0:
+                logger.info(f"Request left job {job_id}; {remaining} still share it.")
+                return job
+            self._forget_in_flight(job)
+
+        job.cancel_event.set()
+        if job.status == Job.QUEUED:
+            job.set_status(Job.CANCELLED)  # the worker skips it
+        logger.info(f"Job {job_id} cancelled.")
+        return job
+
+    def _forget_in_flight(self, job):
+        if job.fingerprint and self._in_flight.get(job.fingerprint) is job:
+            del self._in_flight[job.fingerprint]
+
+    def _prune(self):
+        now = time.monotonic()
+        with self._jobs_lock:
+            expired = [job_id for job_id, job in self._jobs.items()
+                       if job.finished and now - job.finished_at > self._ttl_seconds]
+            for job_id in expired:
+                del self._jobs[job_id]
+
+    def _work(self):
+        while True:
+            job = self._queue.get()
+            if job.finished or job.cancel_event.is_set():
+                job.set_status(Job.CANCELLED)
+                with self._jobs_lock:
+                    self._forget_in_flight(job)
+                self._cleanup(job)
+                continue
+
+            job.set_status(Job.RUNNING)
+            try:
+                self._run_job(job)
+                job.set_status(Job.CANCELLED if job.cancel_event.is_set() else Job.DONE)
+            except Exception as e:
+                if job.cancel_event.is_set():
+                    job.set_status(Job.CANCELLED)
+                else:
+                    logger.exception(f"Job {job.id} failed.")
+                    job.set_status(Job.FAILED, str(e))
+            finally:
+                with self._jobs_lock:
+                    self._forget_in_flight(job)
+                self._cleanup(job)
+            logger.info(f"Job {job.id} {job.status} with {len(job.images)} of {job.count} images.")
+
+    @staticmethod
+    def _cleanup(job):
+        if job.cleanup_path and os.path.exists(job.cleanup_path):
+            os.remove(job.cleanup_path)
@@ -33,7 +33,17 @@ def process_controlnet_image(image_path, lo_threshold = 100, hi_threshold = 200)
 
     return Image.fromarray(controlnet_img).convert("RGB"), new_width, new_height
 
-# Make the Image being returned scaled to 1280 x 720
-def resize_final_image(image, new_width, new_height):
-    image = image.resize((new_width, new_height))
-    return image
\ No newline at end of file
+def process_edge_map(image_path):
+    # Edges traced by the client at generation size (1-bit PNG); only the softening is left to do
+    edges = cv2.imread(image_path, cv2.IMREAD_GRAYSCALE)
+    height, width = edges.shape
+    ratio = np.sqrt(1024 * 1024 / (width * height))
+    new_width, new_height = int(width * ratio), int(height * ratio)
+    if (new_width, new_height) != (width, height):
+        # Older or odd-sized maps; keep them binary so the blur below sees what the client previewed
+        edges = cv2.resize(edges, (new_width, new_height), interpolation=cv2.INTER_NEAREST)
+
+    edges = cv2.GaussianBlur(edges, (5, 5), 0)
+    controlnet_img = HWC3(edges)
+
+    return Image.fromarray(controlnet_img).convert("RGB"), new_width, new_height
@@ -1,14 +1,35 @@
 # stable_diffusion/pipeline_service.py
 
 import torch
-from .image_processing import process_controlnet_image, resize_final_image
+from .image_processing import process_controlnet_image, process_edge_map
 from .pipeline_initialization import initialize_pipelines
+from .profiles import PROFILES, DEFAULT_PROFILE
 from .gif_creator import save_gif
 from PIL import Image
 from datetime import datetime
 import os
+import random
 import threading
 
+# Base images denoised together; more candidates than this are generated in several batches
+MAX_BATCH_SIZE = int(os.getenv('GENERATE_MAX_BATCH', 4))
+REFINER_STRENGTH = 0.3  # the img2img default, spelled out so progress can count the refiner's steps
+PREVIEW_STEPS = int(os.getenv('GENERATE_PREVIEW_STEPS', 5))  # base steps between previews
+
+# Linear map from SDXL's four latent channels to RGB: a rough picture of where each image is heading,
+# for the cost of a matrix product instead of a VAE decode
+LATENT_RGB_FACTORS = torch.tensor([
+    [0.3651, 0.4232, 0.4341],
+    [-0.2533, -0.0042, 0.1068],
+    [0.1076, 0.1111, -0.0362],
+    [-0.3165, -0.2492, -0.2188],
+])
+LATENT_RGB_BIAS = torch.tensor([0.1084, -0.0175, -0.0011])
+
+
+class GenerationCancelled(Exception):
+    """Raised by generate_images when its cancel_event is set."""
+
 # Use threading.Lock to ensure thread-safe initialization
 _init_lock = threading.Lock()
 _pipe = None
@@ -51,21 +72,46 @@ def get_pipelines():
     global _pipe, _refiner
     return _pipe, _refiner
 
-def generate_image(
+
+def latents_to_previews(latents):
+    """Approximates a batch of latents as RGB images at latent resolution (1/8 of the output)."""
+    rgb = torch.einsum('bchw,cr->bhwr', latents.float(), LATENT_RGB_FACTORS.to(latents.device))
+    rgb = rgb + LATENT_RGB_BIAS.to(latents.device)
+    pixels = ((rgb + 1) / 2).clamp(0, 1).mul(255).byte().cpu().numpy()
+    return [Image.fromarray(image) for image in pixels]
+
+def generate_images(
     image_path: str,
     prompt: str,
     style: str = "",  # "animated" or "realistic"
     controlnet_conditioning_scale: float = 1.0,
     guidance_scale: float = 10.0,
     control_guidance_end: float = 0.8,
-    num_inference_steps: int = 60,
-    num_refiner_steps: int = 40,
+    profile: str = DEFAULT_PROFILE,  # a PROFILES key: step counts and whether to refine
+    seed: int = None,  # image i uses seed + i, so any one can be rendered again alone; random if None
     lo_threshold: int = 100,
-    hi_threshold: int = 200
-) -> Image.Image:
+    hi_threshold: int = 200,
+    edges: bool = False,  # image_path is an edge map the client traced; thresholds are ignored
+    count: int = 1,
+    cancel_event: threading.Event = None,
+    progress=None,  # called with the fraction done, 0..1, after every denoising step
+    preview=None  # called with (index, low-resolution PIL image) every PREVIEW_STEPS base steps
+):
     """
-    Generates and refines an image using the Stable Diffusion pipeline with style-specific prompts.
+    Generates and refines count images using the Stable Diffusion pipeline with style-specific prompts,
+    yielding each one as soon as it is refined. The control image is prepared and the prompt encoded
+    once; base images are denoised in batches of up to MAX_BATCH_SIZE.
+
+    Setting cancel_event stops the pipeline at its next denoising step and raises GenerationCancelled.
+    Previews come from the base pass only, approximated from the latents without the VAE.
     """
+    if profile not in PROFILES:
+        raise ValueError(f"Unknown profile '{profile}'")
+    num_inference_steps = PROFILES[profile]["num_inference_steps"]
+    num_refiner_steps = PROFILES[profile]["num_refiner_steps"]
+    if seed is None:
+        seed = random.randrange(2 ** 31)
+
     device = torch.device("cuda" if torch.cuda.is_available() else "cpu")
     load_pipelines(device)
     pipe, refiner = get_pipelines()
@@ -80,40 +126,92 @@ def generate_image(
     # Embed the prompt into the style-specific template
     full_prompt = style_prompt_template.format(prompt=prompt)
 
-    print(f"Full Prompt: {full_prompt}")
-
-    with torch.no_grad():
-        # Read and process the ControlNet image
-        controlnet_img, new_width, new_height = process_controlnet_image(image_path, lo_threshold, hi_threshold)
-
-        # Generate the base image
-        base_images = pipe(
-            prompt=[full_prompt],
-            image=controlnet_img,
-            controlnet_conditioning_scale=controlnet_conditioning_scale,
-            width=new_width,
-            height=new_height,
-            guidance_scale=guidance_scale,
-            control_guidance_end=control_guidance_end,
-            num_inference_steps=num_inference_steps,
-            negative_prompt=[style_negative_prompt] if style_negative_prompt else None,
-        ).images
-
-        # Refine the generated image
-        refined_images = refiner(
-            prompt=[full_prompt],
-            image=base_images,
-            num_inference_steps=num_refiner_steps,
-            negative_prompt=[style_negative_prompt] if style_negative_prompt else None,
-        ).images
-
+    print(f"Full Prompt: {full_prompt} ({profile}, seed {seed})")
+
+    batches = -(-count // MAX_BATCH_SIZE)
+    total_steps = batches * num_inference_steps + count * int(num_refiner_steps * REFINER_STRENGTH)
+    steps_done = 0
+    preview_offset = None  # index of the first image in the batch being denoised, None while refining
+
+    def on_step_end(pipeline, step, timestep, callback_kwargs):
+        nonlocal steps_done
+        steps_done += 1
+        if progress is not None:
+            progress(min(steps_done / max(total_steps, 1), 1.0))
+        if (preview is not None and preview_offset is not None and PREVIEW_STEPS > 0
+                and (step + 1) % PREVIEW_STEPS == 0 and step + 1 < num_inference_steps):
+            for index, image in enumerate(latents_to_previews(callback_kwargs['latents'])):
+                preview(preview_offset + index, image)
+        if cancel_event is not None and cancel_event.is_set():
+            pipeline._interrupt = True  # checked by the pipeline before its next step
+        return callback_kwargs
+
+    def check_cancelled():
+        if cancel_event is not None and cancel_event.is_set():
+            raise GenerationCancelled()
+
+    try:
+        with torch.no_grad():
+            # Read and process the ControlNet image
+            if edges:
+                controlnet_img, new_width, new_height = process_edge_map(image_path)
+            else:
+                controlnet_img, new_width, new_height = process_controlnet_image(image_path, lo_threshold, hi_threshold)
+
+            remaining = count
+            while remaining > 0:
+                batch_size = min(remaining, MAX_BATCH_SIZE)
+                preview_offset = count - remaining
+                remaining -= batch_size
+                seeds = [seed + preview_offset + index for index in range(batch_size)]
+
+                # Generate the base images
+                base_images = pipe(
+                    prompt=[full_prompt],
+                    image=controlnet_img,
+                    num_images_per_prompt=batch_size,
+                    controlnet_conditioning_scale=controlnet_conditioning_scale,
+                    width=new_width,
+                    height=new_height,
+                    guidance_scale=guidance_scale,
+                    control_guidance_end=control_guidance_end,
+                    num_inference_steps=num_inference_steps,
+                    negative_prompt=[style_negative_prompt] if style_negative_prompt else None,
+                    generator=[torch.Generator(device).manual_seed(s) for s in seeds],
+                    callback_on_step_end=on_step_end,
+                ).images
+                check_cancelled()
+                preview_offset = None
+
+                if num_refiner_steps == 0:
+                    yield from base_images
+                    continue
+
+                # Refine them one at a time so each can be sent while the next is refined
+                for base_seed, base_image in zip(seeds, base_images):
+                    refined_images = refiner(
+                        prompt=[full_prompt],
+                        image=[base_image],
+                        strength=REFINER_STRENGTH,
+                        num_inference_steps=num_refiner_steps,
+                        negative_prompt=[style_negative_prompt] if style_negative_prompt else None,
+                        generator=torch.Generator(device).manual_seed(base_seed),
+                        callback_on_step_end=on_step_end,
+                    ).images
+                    check_cancelled()
+
+                    # Returned at generation size; the client scales it onto the projection in its warp
+                    yield refined_images[0]
+    finally:
         # Clear PyTorch cache
         torch.cuda.empty_cache()
 
-        final_image = resize_final_image(refined_images[0], 1280, 720)
 
-        # Return the refined image
-        return final_image
+def generate_image(image_path: str, prompt: str, **kwargs) -> Image.Image:
+    """
+    Generates and refines a single image; see generate_images.
+    """
+    return list(generate_images(image_path, prompt, count=1, **kwargs))[0]
 
 
 def create_fading_gif(
@@ -0,0 +1,10 @@
+# stable_diffusion/profiles.py
+
+# Quality/latency trade-offs a request can pick by name. All render at the same size, so a draft
+# re-rendered with its seed under another profile keeps its composition and gains detail.
+PROFILES = {
+    "draft": {"num_inference_steps": 20, "num_refiner_steps": 0},  # no refiner pass
+    "standard": {"num_inference_steps": 60, "num_refiner_steps": 40},
+    "final": {"num_inference_steps": 80, "num_refiner_steps": 50},
+}
+DEFAULT_PROFILE = "standard"
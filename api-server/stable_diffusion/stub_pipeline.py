@@ -0,0 +1,97 @@
+# stable_diffusion/stub_pipeline.py
+
+"""
+Stands in for pipeline_service when the server runs with STUB_PIPELINE=1, so clients can be tried
+against the real API without a GPU or model weights. It streams canned previews and images at a
+steady pace: a colour wash over the surface's edges, emerging from noise step by step.
+"""
+
+import os
+import random
+import time
+import threading
+
+import cv2
+import numpy as np
+from PIL import Image
+
+from .image_processing import process_controlnet_image, process_edge_map
+from .profiles import PROFILES, DEFAULT_PROFILE
+
+STUB_STEP_SECONDS = float(os.getenv('STUB_STEP_SECONDS', 0.05))  # pretend time per denoising step
+PREVIEW_STEPS = int(os.getenv('GENERATE_PREVIEW_STEPS', 5))
+
+
+class GenerationCancelled(Exception):
+    """Raised by generate_images when its cancel_event is set, as the real pipeline does."""
+
+
+def load_pipelines(device):
+    pass
+
+
+def canned_image(edges, image_seed, fraction, rng):
+    """The final image for a seed, blended with noise while fraction (0..1) is short of 1."""
+    height, width = edges.shape[:2]
+    hue = (np.arange(width, dtype=np.float32) * 180 / width + image_seed * 40) % 180
+    hsv = np.empty((height, width, 3), np.uint8)
+    hsv[..., 0] = hue[None, :].astype(np.uint8)
+    hsv[..., 1] = 160
+    hsv[..., 2] = 200
+    image = cv2.cvtColor(hsv, cv2.COLOR_HSV2RGB)
+    image[edges[..., 0] > 127] = 255
+
+    if fraction < 1.0:
+        noise = rng.integers(0, 256, image.shape, np.uint8)
+        image = cv2.addWeighted(image, fraction, noise, 1.0 - fraction, 0)
+    return image
+
+
+def generate_images(
+    image_path: str,
+    prompt: str,
+    style: str = "",
+    profile: str = DEFAULT_PROFILE,
+    seed: int = None,
+    lo_threshold: int = 100,
+    hi_threshold: int = 200,
+    edges: bool = False,
+    count: int = 1,
+    cancel_event: threading.Event = None,
+    progress=None,
+    preview=None,
+    **kwargs
+):
+    """Same arguments and callbacks as pipeline_service.generate_images; the rest are ignored."""
+    if profile not in PROFILES:
+        raise ValueError(f"Unknown profile '{profile}'")
+    num_inference_steps = PROFILES[profile]["num_inference_steps"] + PROFILES[profile]["num_refiner_steps"]
+    if seed is None:
+        seed = random.randrange(2 ** 31)
+    rng = np.random.default_rng(seed)
+    print(f"Stub generation of {count} images for prompt '{prompt}' ({profile}, seed {seed})")
+    if edges:
+        control, width, height = process_edge_map(image_path)
+    else:
+        control, width, height = process_controlnet_image(image_path, lo_threshold, hi_threshold)
+    control = np.asarray(control)
+
+    total_steps = count * num_inference_steps
+    for index in range(count):
+        for step in range(num_inference_steps):
+            time.sleep(STUB_STEP_SECONDS)
+            if cancel_event is not None and cancel_event.is_set():
+                raise GenerationCancelled()
+            if progress is not None:
+                progress((index * num_inference_steps + step + 1) / total_steps)
+            if (preview is not None and PREVIEW_STEPS > 0
+                    and (step + 1) % PREVIEW_STEPS == 0 and step + 1 < num_inference_steps):
+                frame = canned_image(control, seed + index, (step + 1) / num_inference_steps, rng)
+                preview(index, Image.fromarray(cv2.resize(frame, (width // 8, height // 8),
+                                                          interpolation=cv2.INTER_AREA)))
+
+        yield Image.fromarray(canned_image(control, seed + index, 1.0, rng))
+
+
+def generate_image(image_path: str, prompt: str, **kwargs) -> Image.Image:
+    return list(generate_images(image_path, prompt, count=1, **kwargs))[0]
@@ -0,0 +1,145 @@
+// renderbench.cpp
+
+// Times ProjectionRenderer at 720p and 1080p: plain warp, with a colour LUT, with LUT and
+// compensation, and with a feathered layer over another. Usage: gpms_render_bench [lut.cube];
+// without an argument the LUT named by GPMS_PROJECTOR_LUT is used, or else a synthetic one.
+
+#include "utils/colorlut.h"
+#include "utils/projectionrenderer.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QProcessEnvironment>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+
+namespace {
+
+constexpr int ITERATIONS = 30;
+constexpr int SYNTHETIC_LUT_SIZE = 33;
+
+// Gradient source, slightly smaller than the output so every pixel is interpolated
+cv::Mat gradient(const cv::Size& size)
+{
+    cv::Mat src(size.height * 3 / 4, size.width * 3 / 4, CV_8UC3);
+    for (int y = 0; y < src.rows; ++y) {
+        cv::Vec3b* row = src.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < src.cols; ++x) {
+            row[x] = cv::Vec3b(x % 256, y % 256, (x + y) % 256);
+        }
+    }
+    return src;
+}
+
+// A mild keystone, like a real calibration
+cv::Matx33d keystone(const cv::Mat& src, const cv::Size& size)
+{
+    const cv::Point2f from[] = {{0.0f, 0.0f}, {static_cast<float>(src.cols), 0.0f},
+                                {static_cast<float>(src.cols), static_cast<float>(src.rows)},
+                                {0.0f, static_cast<float>(src.rows)}};
+    const cv::Point2f to[] = {{size.width * 0.05f, size.height * 0.02f}, {size.width * 0.97f, 0.0f},
+                              {static_cast<float>(size.width), static_cast<float>(size.height)},
+                              {0.0f, size.height * 0.95f}};
+    return cv::getPerspectiveTransform(from, to);
+}
+
+// An ellipse over the middle of the output with a 40 px feather, as a drawn mask would be
+ProjectionMask feathered(const cv::Size& size)
+{
+    cv::Mat alpha = cv::Mat::zeros(size, CV_8UC1);
+    cv::ellipse(alpha, cv::Point(size.width / 2, size.height / 2), cv::Size(size.width / 3, size.height / 3),
+                0.0, 0.0, 360.0, cv::Scalar(255), cv::FILLED);
+    cv::GaussianBlur(alpha, alpha, cv::Size(0, 0), 20.0);
+    return ProjectionMask(alpha);
+}
+
+// A 33^3 table with a slight gamma and some crosstalk between channels, as a measured projector
+// would need; far enough from identity that nothing can skip it
+bool loadSyntheticLut(ColorLut& lut)
+{
+    QTemporaryFile file(QDir::tempPath() + "/gpms_render_bench_XXXXXX.cube");
+    if (!file.open()) {
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "LUT_3D_SIZE " << SYNTHETIC_LUT_SIZE << "\n";
+    const double last = SYNTHETIC_LUT_SIZE - 1;
+    for (int b = 0; b < SYNTHETIC_LUT_SIZE; ++b) {
+        for (int g = 0; g < SYNTHETIC_LUT_SIZE; ++g) {
+            for (int r = 0; r < SYNTHETIC_LUT_SIZE; ++r) { // red varies fastest
+                const double in[3] = {std::pow(r / last, 1.1), std::pow(g / last, 1.1), std::pow(b / last, 1.1)};
+                for (int c = 0; c < 3; ++c) {
+                    const double mixed = 0.92 * in[c] + 0.04 * in[(c + 1) % 3] + 0.03 * in[(c + 2) % 3];
+                    out << std::min(std::max(mixed, 0.0), 1.0) << (c < 2 ? " " : "\n");
+                }
+            }
+        }
+    }
+    out.flush();
+    file.close();
+    return lut.load(file.fileName());
+}
+
+void timeRender(const ProjectionRenderer& renderer, const std::vector<ProjectionLayer>& layers, const char* label)
+{
+    cv::Mat dst;
+    renderer.render(layers, dst); // warm up
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        renderer.render(layers, dst);
+    }
+    const cv::Size& size = renderer.outputSize();
+    qDebug() << "Render benchmark" << size.width << "x" << size.height << label
+             << static_cast<double>(timer.nsecsElapsed()) / ITERATIONS / 1e6 << "ms/frame";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    ColorLut lut;
+    const QStringList arguments = app.arguments();
+    const QString lutPath = arguments.size() > 1 ? arguments[1]
+                                                 : QProcessEnvironment::systemEnvironment().value("GPMS_PROJECTOR_LUT");
+    if (!lutPath.isEmpty() && !lut.load(lutPath)) {
+        qDebug() << "Could not load" << lutPath << "- using a synthetic LUT";
+    }
+    if (!lut.isValid() && !loadSyntheticLut(lut)) {
+        qDebug() << "Could not write a synthetic LUT - timing without one";
+    }
+
+    const cv::Size sizes[] = {cv::Size(1280, 720), cv::Size(1920, 1080)};
+    for (const cv::Size& size : sizes) {
+        ProjectionLayer base;
+        base.source = gradient(size);
+        base.homography = keystone(base.source, size);
+
+        ProjectionRenderer renderer(size);
+        timeRender(renderer, {base}, "warp");
+        if (lut.isValid()) {
+            renderer.setColorLut(lut);
+            timeRender(renderer, {base}, "warp + LUT");
+        }
+        const cv::Size mapSize(size.width / 8, size.height / 8);
+        renderer.setCompensation(cv::Mat(mapSize, CV_32FC3, cv::Scalar::all(0.9)),
+                                 cv::Mat(mapSize, CV_32FC3, cv::Scalar::all(10.0)), 2.2);
+        timeRender(renderer, {base}, lut.isValid() ? "warp + LUT + compensation" : "warp + compensation");
+
+        // A second region over the first, blended across its feathered edge
+        const ProjectionMask mask = feathered(size);
+        ProjectionLayer top = base;
+        top.order = ChannelOrder::RGB;
+        top.mask = &mask;
+        timeRender(renderer, {base, top}, "two layers, feathered");
+    }
+    return 0;
+}
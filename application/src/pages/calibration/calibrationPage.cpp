@@ -11,6 +11,8 @@
 #include <QDir>
 #include <QDateTime>
 
+#include <QtConcurrent/QtConcurrentRun>
+
 // OpenCV includes
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
@@ -24,6 +26,13 @@ static constexpr int HEIGHT = 720;
 static constexpr int DISPLAY_WIDTH = 800;
 static constexpr int DISPLAY_HEIGHT = 450;
 
+// Number of sharpest ring frames averaged into the still
+static constexpr int STILL_AVERAGE_FRAMES = 4;
+
+// Lens calibration: checkerboard views to collect, and minimum spacing between them
+static constexpr int LENS_VIEWS = 15;
+static constexpr int LENS_VIEW_INTERVAL_MS = 1000;
+
 // Constructor
 CalibrationPage::CalibrationPage(ImageProjectionWindow *projectionWindow, QWidget *parent)
     : QWidget(parent),
@@ -36,12 +45,23 @@ CalibrationPage::CalibrationPage(ImageProjectionWindow *projectionWindow, QWidge
     selectedCorner(-1),
     mouseX(-1),
     mouseY(-1),
+    lensMode(false),
+    lensButton(nullptr),
+    findSurfaceMode(false),
+    maskMode(false),
+    maskButton(nullptr),
+    projectorButton(nullptr),
     stillFrameCaptured(false),
     pointsChanged(false) // Initialize the flag
 {
     ui->setupUi(this);
     initializeUI();
 
+    // Use the saved lens model, if the camera has been calibrated before
+    if (cameraModel.load()) {
+        m_projectionWindow->setCameraModel(cameraModel);
+    }
+
     setFocusPolicy(Qt::StrongFocus);
 
     // Connect the timer to capture frames
@@ -52,11 +72,17 @@ CalibrationPage::CalibrationPage(ImageProjectionWindow *projectionWindow, QWidge
 
     // **Connect the rejectCalibrationButton to resetPoints()**
     connect(ui->rejectCalibrationButton, &QPushButton::clicked, this, &CalibrationPage::resetPoints);
+
+    connect(lensButton, &QPushButton::clicked, this, &CalibrationPage::onLensButtonClicked);
+    connect(maskButton, &QPushButton::clicked, this, &CalibrationPage::onMaskButtonClicked);
+    connect(projectorButton, &QPushButton::clicked, this, &CalibrationPage::onProjectorButtonClicked);
+    connect(&surfaceWatcher, &QFutureWatcher<SurfaceSegmentation::Surface>::finished, this, &CalibrationPage::onSurfaceFound);
 }
 
 // Destructor
 CalibrationPage::~CalibrationPage()
 {
+    surfaceWatcher.waitForFinished();
     stopCamera();
     delete ui;
 }
@@ -96,6 +122,13 @@ void CalibrationPage::captureFrame()
             qDebug() << "Error: Could not capture frame.";
             return;
         }
+        if (lensMode) {
+            processLensFrame(); // Look for the checkerboard instead
+            update();
+            return;
+        }
+
+        frameRing.push(frame);
 
         processFrame(); // Process the captured frame
 
@@ -107,8 +140,10 @@ void CalibrationPage::captureFrame()
 void CalibrationPage::processFrame()
 {
     if (!stillFrameCaptured) {
-        // Live frame processing
-        cv::Mat displayFrame = frame.clone();
+        // Live frame processing, undistorted so corners are picked in the corrected image
+        cv::Mat liveFrame;
+        cameraModel.undistort(frame, liveFrame);
+        cv::Mat displayFrame = liveFrame.clone();
 
         // Draw selected points
         for (int i = 0; i < numSelectedPoints; ++i) {
@@ -122,17 +157,10 @@ void CalibrationPage::processFrame()
 
         if (dragging && selectedCorner != -1) {
             // Draw magnifying glass
-            drawMagnifyingGlass(frame, displayFrame, mouseX, mouseY);
+            drawMagnifyingGlass(liveFrame, displayFrame, mouseX, mouseY);
         }
 
-        // Scale down the displayFrame to DISPLAY_WIDTH x DISPLAY_HEIGHT
-        cv::Mat scaledFrame;
-        cv::resize(displayFrame, scaledFrame, cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, cv::INTER_LINEAR);
-
-        // Convert scaledFrame to QImage
-        cv::Mat rgbFrame;
-        cv::cvtColor(scaledFrame, rgbFrame, cv::COLOR_BGR2RGB);
-        qimg = QImage(rgbFrame.data, rgbFrame.cols, rgbFrame.rows, rgbFrame.step, QImage::Format_RGB888).copy();
+        setDisplayFrame(displayFrame);
 
         // From Previous Iteration, now I realize it's never called
         // // If four points are selected and a still frame hasn't been captured yet, capture it
@@ -154,6 +182,66 @@ void CalibrationPage::processFrame()
     }
 }
 
+// Collect checkerboard views for the lens model, at most one per LENS_VIEW_INTERVAL_MS
+void CalibrationPage::processLensFrame()
+{
+    cv::Mat displayFrame = frame.clone();
+
+    std::vector<cv::Point2f> corners;
+    const bool found = cameraModel.findCheckerboard(frame, corners);
+    if (found) {
+        cv::drawChessboardCorners(displayFrame, CameraModel::boardSize(), corners, found);
+
+        if (!lensViewTimer.isValid() || lensViewTimer.elapsed() > LENS_VIEW_INTERVAL_MS) {
+            cameraModel.addView(corners, frame.size());
+            lensViewTimer.restart();
+            lensButton->setText(QString("LENS %1/%2").arg(cameraModel.viewCount()).arg(LENS_VIEWS));
+            qDebug() << "Checkerboard view" << cameraModel.viewCount() << "captured";
+        }
+    }
+
+    setDisplayFrame(displayFrame);
+
+    if (cameraModel.viewCount() >= LENS_VIEWS) {
+        if (cameraModel.calibrate() >= 0.0) {
+            cameraModel.save();
+            m_projectionWindow->setCameraModel(cameraModel);
+            emit cameraModelChanged();
+        }
+        setLensMode(false);
+    }
+}
+
+void CalibrationPage::setLensMode(bool enabled)
+{
+    lensMode = enabled;
+    cameraModel.clearViews();
+    lensViewTimer.invalidate();
+    lensButton->setText(enabled ? "CANCEL LENS SETUP" : "CALIBRATE LENS");
+    qDebug() << "Lens calibration mode:" << enabled;
+
+    // Start from a clean live feed either way
+    resetPoints();
+}
+
+void CalibrationPage::onLensButtonClicked()
+{
+    setLensMode(!lensMode);
+}
+
+// Scale a frame down for the monitor and keep it as the QImage painted by paintEvent
+void CalibrationPage::setDisplayFrame(const cv::Mat& displayFrame)
+{
+    // Scale down the displayFrame to DISPLAY_WIDTH x DISPLAY_HEIGHT
+    cv::Mat scaledFrame;
+    cv::resize(displayFrame, scaledFrame, cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, cv::INTER_LINEAR);
+
+    // Convert scaledFrame to QImage
+    cv::Mat rgbFrame;
+    cv::cvtColor(scaledFrame, rgbFrame, cv::COLOR_BGR2RGB);
+    qimg = QImage(rgbFrame.data, rgbFrame.cols, rgbFrame.rows, rgbFrame.step, QImage::Format_RGB888).copy();
+}
+
 // Update the projection window based on the selected points
 void CalibrationPage::updateProjectionWindow()
 {
@@ -172,12 +260,12 @@ void CalibrationPage::updateProjectionWindow()
 // Update the display using the still frame
 void CalibrationPage::updateDisplayWithStillFrame()
 {
-    if (stillFrame.empty()) {
+    if (stillDisplayFrame.empty()) {
         qDebug("Still frame is empty");
         return;
     }
 
-    cv::Mat displayFrame = stillFrame.clone();
+    cv::Mat displayFrame = stillDisplayFrame.clone();
 
     // Draw selected points
     for (int i = 0; i < numSelectedPoints; ++i) {
@@ -189,19 +277,14 @@ void CalibrationPage::updateDisplayWithStillFrame()
         drawROI(displayFrame, selectedPoints);
     }
 
+    drawMask(displayFrame);
+
     // Only draw magnifying glass if dragging is active
     if (dragging && selectedCorner != -1) {
-        drawMagnifyingGlass(stillFrame, displayFrame, mouseX, mouseY);
+        drawMagnifyingGlass(stillDisplayFrame, displayFrame, mouseX, mouseY);
     }
 
-    // Scale down the displayFrame to DISPLAY_WIDTH x DISPLAY_HEIGHT
-    cv::Mat scaledFrame;
-    cv::resize(displayFrame, scaledFrame, cv::Size(DISPLAY_WIDTH, DISPLAY_HEIGHT), 0, 0, cv::INTER_LINEAR);
-
-    // Convert scaledFrame to QImage
-    cv::Mat rgbFrame;
-    cv::cvtColor(scaledFrame, rgbFrame, cv::COLOR_BGR2RGB);
-    qimg = QImage(rgbFrame.data, rgbFrame.cols, rgbFrame.rows, rgbFrame.step, QImage::Format_RGB888).copy();
+    setDisplayFrame(displayFrame);
 
     // Update the widget
     update();
@@ -227,6 +310,10 @@ void CalibrationPage::paintEvent(QPaintEvent* event)
 // Handle mouse press events for point selection and dragging
 void CalibrationPage::mousePressEvent(QMouseEvent* event)
 {
+    if (lensMode) {
+        return; // no corner picking while collecting checkerboard views
+    }
+
     // Get the position of m_imageLabel within the widget
     QPoint labelTopLeft = m_imageLabel->mapTo(this, QPoint(0, 0));
     int labelX = labelTopLeft.x();
@@ -266,6 +353,25 @@ void CalibrationPage::mousePressEvent(QMouseEvent* event)
         mouseX = imgX * scaleX;
         mouseY = imgY * scaleY;
 
+        // One tap on the live feed segments the surface under it
+        if (findSurfaceMode) {
+            if (event->button() == Qt::LeftButton && !surfaceWatcher.isRunning()) {
+                findSurfaceAt(cv::Point2f(mouseX, mouseY));
+            }
+            return;
+        }
+
+        // Mask drawing: left click adds a vertex, right click takes the last one back
+        if (maskMode) {
+            if (event->button() == Qt::LeftButton) {
+                maskPolygon.emplace_back(mouseX, mouseY);
+            } else if (event->button() == Qt::RightButton && !maskPolygon.empty()) {
+                maskPolygon.pop_back();
+            }
+            updateDisplayWithStillFrame();
+            return;
+        }
+
         if (event->button() == Qt::LeftButton && numSelectedPoints < 4) {
             if (isValidPoint(cv::Point2f(mouseX, mouseY), 20.0)) {
                 selectedPoints[numSelectedPoints] = cv::Point2f(mouseX, mouseY);
@@ -275,12 +381,11 @@ void CalibrationPage::mousePressEvent(QMouseEvent* event)
 
                 // If 4 points are selected, capture the still frame
                 if (numSelectedPoints == 4) {
-                    stillFrame = frame.clone();
-                    stillFrameCaptured = true;
-                    stopCamera();
+                    captureStill();
                     updateProjectionWindow();
                     updateDisplayWithStillFrame();
                     ui->completeButton->setEnabled(true);
+                    updateMaskButton();
                 }
             } else {
                 qDebug() << "Point is too close to an existing point.";
@@ -356,6 +461,13 @@ void CalibrationPage::mouseReleaseEvent(QMouseEvent* event)
 // Reset all selected points and related states
 void CalibrationPage::resetPoints()
 {
+    emit calibrationReset();
+
+    setMaskMode(false);
+    findSurfaceMode = false;
+    maskPolygon.clear();
+    m_projectionWindow->clearMask();
+
     numSelectedPoints = 0;
     resetMode = true;
     pointsSelected = false;
@@ -365,11 +477,14 @@ void CalibrationPage::resetPoints()
     mouseY = -1;
     matrix.release();
     stillFrame.release();
+    stillDisplayFrame.release();
     stillFrameCaptured = false; // Reset the still frame flag
+    frameRing.clear();
     pointsChanged = false; // Reset the flag
     qimg = QImage(); // Clear the image
     qDebug() << "Points reset. Please select 4 new points.";
     ui->completeButton->setEnabled(false);
+    updateMaskButton();
 
     // Clear the image in the projection window using clearImage
     m_projectionWindow->setProjectionState(ImageProjectionWindow::projectionState::SCANNING);
@@ -380,6 +495,14 @@ void CalibrationPage::resetPoints()
     startCamera();
 }
 
+// Selected corners in the order the projection window expects
+std::array<cv::Point2f, 4> CalibrationPage::getSortedCorners()
+{
+    std::array<cv::Point2f, 4> sortedPoints = selectedPoints;
+    sortPointsClockwise(sortedPoints);
+    return sortedPoints;
+}
+
 // Finalize the selection (if needed)
 void CalibrationPage::finalizeSelection()
 {
@@ -389,6 +512,148 @@ void CalibrationPage::finalizeSelection()
     }
 }
 
+void CalibrationPage::onMaskButtonClicked()
+{
+    if (stillFrameCaptured) {
+        setMaskMode(!maskMode);
+    } else {
+        findSurfaceMode = !findSurfaceMode;
+        updateMaskButton();
+        if (findSurfaceMode) {
+            qDebug() << "Find surface mode: tap inside the surface.";
+        }
+    }
+}
+
+// Before the still is taken the button finds the surface, afterwards it draws the mask
+void CalibrationPage::updateMaskButton()
+{
+    if (stillFrameCaptured) {
+        maskButton->setText(maskMode ? "FINISH MASK" : "DRAW MASK");
+    } else if (surfaceWatcher.isRunning()) {
+        maskButton->setText("FINDING SURFACE...");
+    } else {
+        maskButton->setText(findSurfaceMode ? "CANCEL FIND" : "FIND SURFACE");
+    }
+}
+
+// Move on to the next projector; the ones already calibrated keep their corners
+void CalibrationPage::onProjectorButtonClicked()
+{
+    const int outputCount = m_projectionWindow->getOutputCount();
+    m_projectionWindow->setActiveOutput((m_projectionWindow->getActiveOutput() + 1) % outputCount);
+    updateProjectorButton();
+    resetPoints();
+}
+
+void CalibrationPage::updateProjectorButton()
+{
+    const int outputCount = m_projectionWindow->getOutputCount();
+    projectorButton->setVisible(outputCount > 1);
+    projectorButton->setText(QString("NEXT PROJECTOR (%1/%2)")
+                                 .arg(m_projectionWindow->getActiveOutput() + 1)
+                                 .arg(outputCount));
+}
+
+// Freeze the live feed into the still frame used for the rest of the calibration
+void CalibrationPage::captureStill()
+{
+    stillFrame = frameRing.bestStill(STILL_AVERAGE_FRAMES);
+    if (stillFrame.empty()) {
+        stillFrame = frame.clone();
+    }
+    cameraModel.undistort(stillFrame, stillDisplayFrame);
+    stillFrameCaptured = true;
+    stopCamera();
+}
+
+// Segment the surface around seed in the background; onSurfaceFound applies the result
+void CalibrationPage::findSurfaceAt(const cv::Point2f& seed)
+{
+    surfaceStill = frameRing.bestStill(STILL_AVERAGE_FRAMES);
+    if (surfaceStill.empty()) {
+        surfaceStill = frame.clone();
+    }
+    cameraModel.undistort(surfaceStill, surfaceDisplayStill);
+
+    const cv::Mat displayStill = surfaceDisplayStill;
+    surfaceWatcher.setFuture(QtConcurrent::run([displayStill, seed]() {
+        return SurfaceSegmentation::findSurface(displayStill, seed);
+    }));
+    updateMaskButton();
+}
+
+// Use the surface's outline as the mask and its quad as the corners
+void CalibrationPage::onSurfaceFound()
+{
+    const SurfaceSegmentation::Surface surface = surfaceWatcher.result();
+    updateMaskButton();
+    if (!findSurfaceMode || stillFrameCaptured) {
+        return; // cancelled or reset while it ran
+    }
+    if (!surface.found) {
+        return; // the live feed keeps running; tap again or pick corners by hand
+    }
+
+    findSurfaceMode = false;
+    stillFrame = surfaceStill;
+    stillDisplayFrame = surfaceDisplayStill;
+    stillFrameCaptured = true;
+    stopCamera();
+
+    selectedPoints = surface.quad;
+    numSelectedPoints = 4;
+    pointsChanged = true;
+    updateProjectionWindow(); // corners first, the mask is mapped through them
+
+    maskPolygon = surface.outline;
+    m_projectionWindow->setMaskPolygon(maskPolygon);
+
+    updateMaskButton();
+    updateDisplayWithStillFrame();
+    ui->completeButton->setEnabled(true);
+}
+
+// Entering starts a fresh polygon; leaving hands it to the projection window
+void CalibrationPage::setMaskMode(bool enabled)
+{
+    if (enabled == maskMode) {
+        return;
+    }
+
+    maskMode = enabled;
+    ui->completeButton->setEnabled(!enabled && stillFrameCaptured);
+    updateMaskButton();
+
+    if (enabled) {
+        maskPolygon.clear();
+        qDebug() << "Mask mode: click around the surface, right click to undo.";
+    } else if (maskPolygon.size() >= 3) {
+        m_projectionWindow->setMaskPolygon(maskPolygon);
+    } else {
+        maskPolygon.clear();
+        m_projectionWindow->clearMask();
+    }
+
+    updateDisplayWithStillFrame();
+}
+
+// The mask outline, left open while it is still being drawn
+void CalibrationPage::drawMask(cv::Mat& frame)
+{
+    if (maskPolygon.empty()) {
+        return;
+    }
+
+    std::vector<cv::Point> outline(maskPolygon.begin(), maskPolygon.end());
+    cv::polylines(frame, outline, !maskMode, cv::Scalar(255, 0, 255), 3, cv::LINE_AA);
+    if (maskMode) {
+        for (const cv::Point& vertex : outline) {
+            cv::circle(frame, vertex, 6, cv::Scalar(255, 0, 255), -1);
+        }
+    }
+}
+
 // Slot for the Complete button to navigate to the sensitivity page
 void CalibrationPage::onCompleteButtonClicked()
 {
@@ -567,10 +832,10 @@ QImage CalibrationPage::getQImage() {
 }
 
 QImage CalibrationPage::getCleanQImage() {
-    if (!stillFrame.empty()) {
+    if (!stillDisplayFrame.empty()) {
         // Convert to RGB at full resolution (without any drawings)
         cv::Mat rgbFrame;
-        cv::cvtColor(stillFrame, rgbFrame, cv::COLOR_BGR2RGB);
+        cv::cvtColor(stillDisplayFrame, rgbFrame, cv::COLOR_BGR2RGB);
 
         // Create clean QImage at full resolution
         QImage cleanImage = QImage(rgbFrame.data, rgbFrame.cols, rgbFrame.rows,
@@ -656,6 +921,13 @@ QHBoxLayout* CalibrationPage::createButtonLayout()
     QHBoxLayout *buttonLayout = new QHBoxLayout();
     buttonLayout->setContentsMargins(0, 0, 0, 0);
     buttonLayout->addWidget(styleButton(ui->rejectCalibrationButton, "LET'S TRY AGAIN", "#CD6F6F"));
+    lensButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(lensButton, "CALIBRATE LENS", "#6F81CD"));
+    maskButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(maskButton, "FIND SURFACE", "#6F81CD"));
+    projectorButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(projectorButton, "NEXT PROJECTOR", "#6F81CD"));
+    updateProjectorButton();
     buttonLayout->addWidget(styleButton(ui->completeButton, "THIS LOOKS GOOD!", "#BB64C7"));
     ui->completeButton->setEnabled(false); // initially false
     return buttonLayout;
@@ -2,6 +2,9 @@
 #define CALIBRATIONPAGE_H
 
 #include "windows/imageprojectionwindow.h"
+#include "utils/framering.h"
+#include "utils/cameramodel.h"
+#include "utils/surfacesegmentation.h"
 #include <QWidget>
 #include <QTimer>
 #include <QImage>
@@ -9,6 +12,8 @@
 #include <array>
 #include <QHBoxLayout>
 #include <QPushButton>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 
 namespace Ui {
 class CalibrationPage;
@@ -30,10 +35,16 @@ public:
     QPixmap getImage();
     QImage getQImage();
     QImage getCleanQImage();
+    std::array<cv::Point2f, 4> getSortedCorners();
+    const CameraModel& getCameraModel() const { return cameraModel; }
 
 private slots:
     void captureFrame();
     void onCompleteButtonClicked(); // Slot for the Complete button
+    void onLensButtonClicked(); // Toggles checkerboard lens calibration
+    void onMaskButtonClicked(); // Find surface (live) or draw mask (still)
+    void onProjectorButtonClicked(); // Calibrate the next projector output
+    void onSurfaceFound(); // segmentation started by a tap has finished
 
 protected:
     void paintEvent(QPaintEvent* event) override;
@@ -43,6 +54,8 @@ protected:
 
 signals:
     void navigateToSensitivityPage();
+    void calibrationReset(); // emitted before the camera is reopened
+    void cameraModelChanged();
 
 private:
     Ui::CalibrationPage *ui;
@@ -51,6 +64,7 @@ private:
     QTimer* timer;
     cv::VideoCapture cap;
     cv::Mat frame;
+    FrameRing frameRing; // recent live frames, the still is picked from these
     QImage qimg;
     QLabel* m_imageLabel; // for image on monitor
 
@@ -63,14 +77,41 @@ private:
     int selectedCorner;
     int mouseX, mouseY;
 
+    // Lens calibration
+    CameraModel cameraModel;
+    bool lensMode;
+    QElapsedTimer lensViewTimer;
+    QPushButton* lensButton;
+
+    // Projection mask, drawn on the still frame or found from a single tap on the live feed
+    bool findSurfaceMode;
+    bool maskMode;
+    std::vector<cv::Point2f> maskPolygon;
+    QPushButton* maskButton;
+    QFutureWatcher<SurfaceSegmentation::Surface> surfaceWatcher; // GrabCut runs off the GUI thread
+    cv::Mat surfaceStill, surfaceDisplayStill; // the still being segmented, kept if a surface is found
+
+    // Only shown with more than one projector output
+    QPushButton* projectorButton;
+
     // Stateful variables
     cv::Mat matrix;
-    cv::Mat stillFrame;
+    cv::Mat stillFrame; // as captured; the projection window undistorts its ROI
+    cv::Mat stillDisplayFrame; // undistorted still, for display and upload
     bool stillFrameCaptured;
     bool pointsChanged;
 
     // Methods
     void processFrame();
+    void processLensFrame();
+    void setLensMode(bool enabled);
+    void setMaskMode(bool enabled);
+    void updateMaskButton();
+    void updateProjectorButton();
+    void captureStill();
+    void findSurfaceAt(const cv::Point2f& seed);
+    void drawMask(cv::Mat& frame);
+    void setDisplayFrame(const cv::Mat& displayFrame);
     void updateProjectionWindow(); // Method to update the projection window
     void drawMagnifyingGlass(const cv::Mat& sourceFrame, cv::Mat& drawFrame, int x, int y, int zoomFactor = 2, int radius = 80);
     void drawROI(cv::Mat& frame, const std::array<cv::Point2f, 4>& selectedPoints);
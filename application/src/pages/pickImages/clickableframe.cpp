@@ -77,6 +77,21 @@ void ClickableFrame::setImage(const cv::Mat& mat)
     m_loadingLabel->setVisible(false);
 }
 
+void ClickableFrame::setPreview(const cv::Mat& mat)
+{
+    if (hasValidImage() || mat.empty() || mat.type() != CV_8UC3) {
+        return; // a late preview must not cover the finished image
+    }
+
+    QImage qimg(mat.data, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
+    // Low resolution; the label scales it up to the frame
+    m_imageLabel->setPixmap(QPixmap::fromImage(qimg.copy()));
+
+    m_loadingTimer->stop();
+    m_loadingLabel->setVisible(false);
+    m_imageLabel->setVisible(true);
+}
+
 void ClickableFrame::clearImage()
 {
     m_image = cv::Mat();
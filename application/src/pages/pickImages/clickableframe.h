@@ -15,6 +15,7 @@ class ClickableFrame : public QFrame
 public:
     explicit ClickableFrame(QWidget *parent = nullptr);
     void setImage(const cv::Mat& mat);
+    void setPreview(const cv::Mat& mat); // shown until the image arrives; not selectable
     void clearImage();
     void setSelected(bool selected);
     bool isSelected() const;
@@ -10,12 +10,17 @@
 #include <QMouseEvent>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QHttpMultiPart>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrent/QtConcurrentRun>
 #include <QPixmap>
 #include <QTimer>
 #include <QDir>
 #include <QUrlQuery>
 #include <QProcessEnvironment>
 #include <QPainter>
+#include <QRandomGenerator>
 
 
 // Pick Images Page
@@ -30,20 +35,35 @@ PickImagesPage::PickImagesPage(ImageProjectionWindow *projectionWindow, QWidget
     , m_lowThreshold(0.0)
     , m_highThreshold(1.0)
     , m_actual_image(0,0)
+    , m_uploadRevision(-1)
+    , m_pendingRequests(0)
+    , m_surfaceReply(nullptr)
+    , m_candidateCount(qBound(MIN_CANDIDATES,
+                              QProcessEnvironment::systemEnvironment().value("GPMS_CANDIDATES", "2").toInt(),
+                              MAX_CANDIDATES))
+    , m_nextFrameIndex(0)
+    , m_candidateProfile(QProcessEnvironment::systemEnvironment().value("GPMS_CANDIDATE_PROFILE", "draft"))
 {
     ui->setupUi(this);
     initializeUI();
+    m_frameSeeds.fill(-1, m_imageFrames.size());
 
     QCoreApplication::addLibraryPath("C:/Program Files/openssl-1.1/x64/bin");
     // connect buttons
     connect(ui->selectImagesButton, &QPushButton::clicked, this, &PickImagesPage::onAcceptButtonClicked);
     connect(ui->rejectImagesButton, &QPushButton::clicked, this, &PickImagesPage::onRejectButtonClicked);
     connect(ui->retakePhotoButton, &QPushButton::clicked, this, &PickImagesPage::onRetakePhotoButtonClicked);
+    connect(&m_uploadWatcher, &QFutureWatcher<UploadPayload>::finished, this, &PickImagesPage::onUploadEncoded);
 }
 
 PickImagesPage::~PickImagesPage()
 {
     cleanupNetworkRequests();
+    if (m_surfaceReply) {
+        disconnect(m_surfaceReply, nullptr, this, nullptr);
+        m_surfaceReply->abort();
+        m_surfaceReply->deleteLater();
+    }
     delete ui;
 }
 
@@ -68,30 +88,177 @@ void PickImagesPage::fetchRandomImages(int numImages) {
         return;
     }
 
-    for (int i = 0; i < numImages; ++i) {
-        try {
-            qDebug("Creating network request");
-            QNetworkRequest request = createNetworkRequest();
-            qDebug("Created network request");
-            cv::Mat imageData = prepareImageData();
+    // Usually encoded and stored on the server while the prompt was typed; otherwise the requests wait for it
+    prepareUpload();
+    m_pendingRequests += numImages;
+    sendPendingRequests();
+}
 
-            if (imageData.empty()) {
-                qDebug() << "Failed to prepare image data";
-                continue;
-            }
+void PickImagesPage::prepareUpload()
+{
+    // Either the edge map the user has been previewing, or the photo for the server to trace itself
+    const bool edges = m_uploadEncoder.mode() == UploadEncoder::Mode::EDGES;
+    cv::Mat source = edges ? m_projectionWindow->getEdgeMap() : m_projectionWindow->getStillRegion();
+    const int revision = edges ? m_projectionWindow->getEdgeRevision() : m_projectionWindow->getStillRevision();
+    if (revision == m_uploadRevision && (m_uploadWatcher.isRunning() || !m_upload.isEmpty())) {
+        return; // already encoded, or on its way
+    }
+
+    // Only the calibration quad's bounding box is ever projected, so that's all we upload
+    if (source.empty()) {
+        qDebug() << "No still region available from the projection window";
+        return;
+    }
+
+    // The window remaps into the same buffer when the still or corners change, so encode a copy
+    if (!edges) {
+        source = source.clone();
+    }
+    const UploadEncoder encoder = m_uploadEncoder;
+    m_upload = UploadPayload();
+    m_uploadRevision = revision;
+    m_uploadWatcher.setFuture(QtConcurrent::run([source, encoder]() {
+        return encoder.encode(source);
+    }));
+}
+
+void PickImagesPage::onUploadEncoded()
+{
+    if (!m_uploadWatcher.isFinished()) {
+        return; // superseded by a newer still
+    }
+
+    m_upload = m_uploadWatcher.result();
+    m_surfaceId.clear();
+    if (m_upload.isEmpty()) {
+        m_uploadRevision = -1; // try again next time
+    } else {
+        uploadSurface();
+    }
+    sendPendingRequests();
+}
+
+// Store the encoded surface on the server once; every prompt for it then only sends its id
+void PickImagesPage::uploadSurface()
+{
+    if (m_surfaceReply) {
+        disconnect(m_surfaceReply, nullptr, this, nullptr);
+        m_surfaceReply->abort();
+        m_surfaceReply->deleteLater();
+        m_surfaceReply = nullptr;
+    }
+    if (m_upload.isEmpty()) {
+        return;
+    }
 
-            QByteArray postData = encodeToPNG(imageData);
-            if (postData.isEmpty()) {
-                qDebug() << "Failed to encode image to PNG";
-                continue;
+    try {
+        QNetworkRequest request = createNetworkRequest(getSurfacesEndpoint());
+        QHttpMultiPart *multiPart = createMultiPart(m_upload, { { "mode", m_upload.mode } });
+        QNetworkReply *reply = m_networkManager->post(request, multiPart);
+        if (!reply) {
+            qDebug() << "Failed to create network reply";
+            delete multiPart;
+            return;
+        }
+        multiPart->setParent(reply); // freed with the reply
+
+        m_surfaceReply = reply;
+        connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+            onSurfaceStored(reply);
+        });
+    } catch (const std::exception& e) {
+        qDebug() << "Exception in uploadSurface:" << e.what();
+    }
+}
+
+void PickImagesPage::onSurfaceStored(QNetworkReply* reply)
+{
+    m_surfaceReply = nullptr;
+
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() == QNetworkReply::NoError && httpStatus >= 200 && httpStatus < 300) {
+        m_surfaceId = QJsonDocument::fromJson(reply->readAll()).object().value("surface_id").toString();
+        qDebug() << "Surface stored on the server as" << m_surfaceId;
+    } else {
+        // e.g. a server without /surfaces; each request carries the image instead
+        qDebug() << "Could not store the surface:" << httpStatus << reply->errorString();
+    }
+    reply->deleteLater();
+
+    sendPendingRequests();
+}
+
+void PickImagesPage::sendPendingRequests()
+{
+    if (m_pendingRequests == 0 || m_uploadWatcher.isRunning() || m_surfaceReply) {
+        return; // called again once the encode or the surface upload finishes
+    }
+
+    const int count = m_pendingRequests;
+    m_pendingRequests = 0;
+    if (m_upload.isEmpty()) {
+        qDebug() << "Failed to prepare image data, dropping" << count << "requests";
+        return;
+    }
+
+    // Candidate i has seed firstSeed + i, picked here so every image is cached under its own seed.
+    // Asking again for a surface and prompt replays its last seeds from the cache; once those
+    // candidates are rejected (REVISE MY VISION) the next round starts from fresh seeds
+    m_roundKey = cacheKey(m_candidateProfile, "candidates");
+    if (!m_roundSeeds.contains(m_roundKey)) {
+        m_roundSeeds.insert(m_roundKey, QRandomGenerator::global()->bounded(MAX_SEED - MAX_CANDIDATES));
+    }
+    const qint64 firstSeed = m_roundSeeds.value(m_roundKey);
+
+    // The rest are asked for in one job per run of consecutive seeds (usually a single one): the server
+    // conditions once, numbers the images from the seed it is given and streams them back as they are done
+    int sent = 0;
+    GenerationOptions options;
+    options.profile = m_candidateProfile;
+    auto sendRun = [&]() {
+        if (options.cacheKeys.isEmpty()) {
+            return;
+        }
+        options.count = options.cacheKeys.size();
+        qDebug() << "sending network request for" << options.count << "images from seed" << options.seed;
+        sendGenerationRequest(options);
+        sent += options.count;
+        options.cacheKeys.clear();
+    };
+
+    for (int slot = 0; slot < count; ++slot) {
+        const qint64 seed = firstSeed + slot;
+        const QByteArray key = cacheKey(m_candidateProfile, QString("seed:%1").arg(seed));
+        cv::Mat image;
+        qint64 cachedSeed = -1;
+        if (m_resultCache.lookup(key, image, cachedSeed)) {
+            addCandidate(image, seed);
+            sendRun();
+        } else {
+            if (options.cacheKeys.isEmpty()) {
+                options.seed = seed;
             }
-            qDebug() << "sending network request: " << i;
-            sendNetworkRequest(request, postData);
+            options.cacheKeys.append(key);
+        }
+    }
+    sendRun();
 
-        } catch (const std::exception& e) {
-            qDebug() << "Unexpected error:" << e.what();
-            continue;
+    if (sent == 0) {
+        qDebug() << "All" << count << "images found in the result cache";
+    }
+}
+
+void PickImagesPage::sendGenerationRequest(const GenerationOptions& options)
+{
+    try {
+        if (!m_surfaceId.isEmpty()) {
+            sendSurfaceRequest(m_surfaceId, options);
+        } else {
+            sendNetworkRequest(createNetworkRequest(getJobsEndpoint()), m_upload, options);
         }
+
+    } catch (const std::exception& e) {
+        qDebug() << "Unexpected error:" << e.what();
     }
 }
 
@@ -104,12 +271,12 @@ bool PickImagesPage::validateInputs(int numImages) {
 }
 
 
-QUrl getEnvironmentUrl() {
+QUrl getEnvironmentUrl(const QString& endpointOverride = QString()) {
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
 
     QString host = env.value("API_HOST", "");
     QString port = env.value("API_PORT", "");
-    QString endpoint = env.value("API_ENDPOINT", "");
+    QString endpoint = endpointOverride.isEmpty() ? env.value("API_ENDPOINT", "") : endpointOverride;
 
     // Construct the URL
     QString urlStr = QString("https://%1:%2/%3")
@@ -122,10 +289,19 @@ QUrl getEnvironmentUrl() {
     return QUrl(urlStr);
 }
 
-QNetworkRequest PickImagesPage::createNetworkRequest() {
+QString PickImagesPage::getSurfacesEndpoint() {
+    return QProcessEnvironment::systemEnvironment().value("API_SURFACES_ENDPOINT", "surfaces");
+}
+
+// Generations run as server-side jobs: POST queues one, jobs/<id>/images streams its images, DELETE cancels it
+QString PickImagesPage::getJobsEndpoint() {
+    return QProcessEnvironment::systemEnvironment().value("API_JOBS_ENDPOINT", "jobs");
+}
+
+QNetworkRequest PickImagesPage::createNetworkRequest(const QString& endpoint) {
 
 
-    QUrl url = getEnvironmentUrl();
+    QUrl url = getEnvironmentUrl(endpoint);
 
     if (!url.isValid()) {
         throw std::runtime_error("Invalid API URL");
@@ -145,8 +321,8 @@ QNetworkRequest PickImagesPage::createNetworkRequest() {
     }
     request.setRawHeader("x-api-key", apiKey);
 
-    // Instead of setting query parameters, we'll send them in the multipart data
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "multipart/form-data; boundary=boundary");
+    // Instead of setting query parameters, we'll send them in the multipart data;
+    // its content type (with the boundary) is set when it is posted
 
     return request;
 }
@@ -166,63 +342,32 @@ QUrlQuery PickImagesPage::createQueryParameters() {
     return query;
 }
 
-cv::Mat PickImagesPage::prepareImageData() {
-    qDebug() << "Original pixmap size:" << m_actual_image.size();
-    // Convert to QImage
-    QImage qImage = m_actual_image;
-
-    // Scale to exactly 1280x720 while maintaining aspect ratio
-    qImage = qImage.scaled(1280, 720, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-
-    // If the image isn't exactly 1280x720 after scaling (due to aspect ratio),
-    // create a black background image and center the scaled image
-    if (qImage.size() != QSize(1280, 720)) {
-        QImage finalImage(1280, 720, QImage::Format_RGB888);
-        finalImage.fill(Qt::black);
-
-        // Calculate position to center the image
-        int x = (1280 - qImage.width()) / 2;
-        int y = (720 - qImage.height()) / 2;
-
-        // Create painter to draw the scaled image onto the black background
-        QPainter painter(&finalImage);
-        painter.drawImage(x, y, qImage);
-        painter.end();
-
-        qImage = finalImage;
-    }
-
-    cv::Mat mat = ImageUtils::qimage_to_mat(qImage);
-    qDebug() << "Resulting Mat size:" << mat.size().width << "x" << mat.size().height;
-
-    return mat;
-}
-
-QByteArray PickImagesPage::encodeToPNG(const cv::Mat& image) {
-    std::vector<uchar> buffer;
-    std::vector<int> png_params;
-    png_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-    png_params.push_back(9); // Maximum compression
-
-    if (!cv::imencode(".png", image, buffer, png_params)) {
-        return QByteArray();
-    }
-
-    return QByteArray(reinterpret_cast<char*>(buffer.data()), buffer.size());
-}
-
 void PickImagesPage::cleanupNetworkRequests()
 {
+    // Aborting a reply only closes the socket; the server would keep generating for nobody
+    for (const QString& jobId : m_activeJobs) {
+        cancelJob(jobId);
+    }
+    m_activeJobs.clear();
+    m_finalRenderFrame = -1;
+    m_finalRenderJob.clear();
+
     // Abort and cleanup all active network requests
     for (QNetworkReply* reply : m_activeReplies) {
         if (reply) {
             disconnect(reply, nullptr, this, nullptr);  // Disconnect all signals
-            reply->abort();  // Abort the request
-            reply->deleteLater();
+            if (reply->property(JOB_ID_PROPERTY).toString().isEmpty()) {
+                abandonJobCreation(reply); // may have queued a job by now
+            } else {
+                reply->abort();  // Abort the request
+                reply->deleteLater();
+            }
             qDebug() << "Ending network request for: " << m_prompt;
         }
     }
     m_activeReplies.clear();
+    m_candidateReaders.clear();
+    m_pendingRequests = 0;
 
     // Clean up associated timers
     for (QTimer* timer : m_replyTimers.values()) {
@@ -240,55 +385,132 @@ void PickImagesPage::resetState(){
 }
 
 
-void PickImagesPage::sendNetworkRequest(const QNetworkRequest& request, const QByteArray& imageData) {
-    // Create multipart data
-    QByteArray multipartData;
-    QString boundary = "boundary";
-
-    // Add form fields
+QMap<QString, QString> PickImagesPage::createFormFields(const GenerationOptions& options) {
     QMap<QString, QString> formFields;
+    formFields["count"] = QString::number(options.count);
+    formFields["profile"] = options.profile;
+    if (options.seed >= 0) {
+        formFields["seed"] = QString::number(options.seed);
+    }
     formFields["prompt"] = getPrompt();
     formFields["style"] = getIsRealistic() ? "realistic" : "animated";
     formFields["lo_threshold"] = QString::number(getLowThreshold());
     formFields["hi_threshold"] = QString::number(getHighThreshold());
+    return formFields;
+}
+
+// Form fields plus the image; the image body shares the encoded buffer, so any number of requests hold one copy of it
+QHttpMultiPart* PickImagesPage::createMultiPart(const UploadPayload& upload, const QMap<QString, QString>& formFields) {
+    QHttpMultiPart *multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
 
-    // Add form fields to multipart data
     for (auto it = formFields.begin(); it != formFields.end(); ++it) {
-        multipartData.append("--" + boundary.toUtf8() + "\r\n");
-        multipartData.append("Content-Disposition: form-data; name=\"" + it.key().toUtf8() + "\"\r\n\r\n");
-        multipartData.append(it.value().toUtf8() + "\r\n");
+        QHttpPart field;
+        field.setHeader(QNetworkRequest::ContentDispositionHeader, QString("form-data; name=\"%1\"").arg(it.key()));
+        field.setBody(it.value().toUtf8());
+        multiPart->append(field);
     }
 
-    // Add image data
-    multipartData.append("--" + boundary.toUtf8() + "\r\n");
-    multipartData.append("Content-Disposition: form-data; name=\"image\"; filename=\"image.png\"\r\n");
-    multipartData.append("Content-Type: image/png\r\n\r\n");
-    multipartData.append(imageData);
-    multipartData.append("\r\n");
+    QHttpPart imagePart;
+    imagePart.setHeader(QNetworkRequest::ContentTypeHeader, upload.mimeType);
+    imagePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                        QString("form-data; name=\"image\"; filename=\"%1\"").arg(upload.fileName));
+    imagePart.setBody(upload.data);
+    multiPart->append(imagePart);
+
+    return multiPart;
+}
 
-    // Add closing boundary
-    multipartData.append("--" + boundary.toUtf8() + "--\r\n");
+void PickImagesPage::sendNetworkRequest(const QNetworkRequest& request, const UploadPayload& upload, const GenerationOptions& options) {
+    QMap<QString, QString> formFields = createFormFields(options);
+    formFields["mode"] = upload.mode;
+    QHttpMultiPart *multiPart = createMultiPart(upload, formFields);
 
     // Send the request
     qDebug() << "posting request now";
     try {
-        QNetworkReply *reply = m_networkManager->post(request, multipartData);
+        QNetworkReply *reply = m_networkManager->post(request, multiPart);
         if (!reply) {
             qDebug() << "Failed to create network reply";
+            delete multiPart;
             return;
         }
+        multiPart->setParent(reply); // freed with the reply
 
-        m_activeReplies.append(reply);  // Track the new reply
-
-        setupRequestTimeout(reply);
-        setupResponseHandlers(reply);
+        trackReply(reply, options);
 
     } catch (const std::exception& e) {
         qDebug() << "Exception in sendNetworkRequest:" << e.what();
     }
 }
 
-void PickImagesPage::setupRequestTimeout(QNetworkReply* reply) {
+// The surface is already on the server, so this is a few hundred bytes of JSON
+void PickImagesPage::sendSurfaceRequest(const QString& surfaceId, const GenerationOptions& options) {
+    QNetworkRequest request = createNetworkRequest(getJobsEndpoint());
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    const QMap<QString, QString> formFields = createFormFields(options);
+    QJsonObject body;
+    for (auto it = formFields.begin(); it != formFields.end(); ++it) {
+        body.insert(it.key(), it.value());
+    }
+    body.insert("surface_id", surfaceId);
+
+    QNetworkReply *reply = m_networkManager->post(request, QJsonDocument(body).toJson(QJsonDocument::Compact));
+    if (!reply) {
+        qDebug() << "Failed to create network reply";
+        return;
+    }
+    reply->setProperty(SURFACE_ID_PROPERTY, surfaceId); // resent with the image if the server has lost it
+
+    trackReply(reply, options);
+}
+
+void PickImagesPage::trackReply(QNetworkReply* reply, const GenerationOptions& options) {
+    m_activeReplies.append(reply);  // Track the new reply
+    reply->setProperty(COUNT_PROPERTY, options.count);
+    reply->setProperty(PROFILE_PROPERTY, options.profile);
+    reply->setProperty(SEED_PROPERTY, options.seed);
+    reply->setProperty(FRAME_PROPERTY, options.frameIndex);
+    QVariantList cacheKeys;
+    for (const QByteArray& key : options.cacheKeys) {
+        cacheKeys.append(key);
+    }
+    reply->setProperty(CACHE_KEYS_PROPERTY, cacheKeys);
+
+    // Every candidate in a batch is denoised before the first is refined and sent
+    setupRequestTimeout(reply, REQUEST_TIMEOUT_MS + BATCH_TIMEOUT_MS * (options.count - 1));
+    setupResponseHandlers(reply);
+}
+
+// What a reply was sent for, to follow it up (fetch a job's images, resend after a lost surface)
+PickImagesPage::GenerationOptions PickImagesPage::optionsOf(QNetworkReply* reply) const {
+    GenerationOptions options;
+    options.count = reply->property(COUNT_PROPERTY).toInt();
+    options.profile = reply->property(PROFILE_PROPERTY).toString();
+    options.seed = reply->property(SEED_PROPERTY).toLongLong();
+    options.frameIndex = reply->property(FRAME_PROPERTY).toInt();
+    for (const QVariant& key : reply->property(CACHE_KEYS_PROPERTY).toList()) {
+        options.cacheKeys.append(key.toByteArray());
+    }
+    return options;
+}
+
+// Everything that shapes a generated image: the uploaded surface, the request, and which image it is
+// (its seed, or "candidates" for the seeds a round of candidates starts from)
+QByteArray PickImagesPage::cacheKey(const QString& profile, const QString& variant) const {
+    return ResultCache::key(m_upload.data, { m_upload.mode, getPrompt(), getIsRealistic() ? "realistic" : "animated",
+                                             QString::number(getLowThreshold()), QString::number(getHighThreshold()),
+                                             profile, variant });
+}
+
+void PickImagesPage::cacheResult(QNetworkReply* reply, int candidate, const cv::Mat& image, qint64 seed) {
+    const QVariantList cacheKeys = reply->property(CACHE_KEYS_PROPERTY).toList();
+    if (candidate >= 0 && candidate < cacheKeys.size()) {
+        m_resultCache.insert(cacheKeys[candidate].toByteArray(), image, seed);
+    }
+}
+
+void PickImagesPage::setupRequestTimeout(QNetworkReply* reply, int timeoutMs) {
     QTimer *timer = new QTimer(this);
     timer->setSingleShot(true);
 
@@ -318,7 +540,7 @@ void PickImagesPage::setupRequestTimeout(QNetworkReply* reply) {
         }
     });
 
-    timer->start(100000); // 100 second timeout
+    timer->start(timeoutMs);
 }
 
 void PickImagesPage::setupResponseHandlers(QNetworkReply* reply) {
@@ -328,6 +550,11 @@ void PickImagesPage::setupResponseHandlers(QNetworkReply* reply) {
         handleNetworkReply(reply);
     });
 
+    // Batches come back as multipart/mixed, one image per part, each shown as soon as it is complete
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        readCandidates(reply);
+    });
+
     // Handle errors during transmission
     connect(reply, &QNetworkReply::errorOccurred, this,
             [](QNetworkReply::NetworkError error) {
@@ -354,9 +581,37 @@ void PickImagesPage::handleNetworkReply(QNetworkReply* reply) {
         timer->deleteLater();
     }
 
+    // The server restarted or cleaned up since the surface was stored: send this one with the image, store it again
+    const QString surfaceId = reply->property(SURFACE_ID_PROPERTY).toString();
+    if (!surfaceId.isEmpty() && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 404) {
+        qDebug() << "Server no longer has surface" << surfaceId;
+        if (surfaceId == m_surfaceId) {
+            m_surfaceId.clear();
+            uploadSurface();
+        }
+        if (!m_upload.isEmpty()) {
+            try {
+                sendNetworkRequest(createNetworkRequest(getJobsEndpoint()), m_upload, optionsOf(reply));
+            } catch (const std::exception& e) {
+                qDebug() << "Unexpected error:" << e.what();
+            }
+        }
+        m_candidateReaders.remove(reply);
+        reply->deleteLater();
+        return;
+    }
+
+    // The image stream of a job ended; if it broke off (timeout, network), the job is of no use any more
+    const QString jobId = reply->property(JOB_ID_PROPERTY).toString();
+    if (!jobId.isEmpty() && m_activeJobs.remove(jobId) && reply->error() != QNetworkReply::NoError) {
+        cancelJob(jobId);
+    }
+
     if (reply->error() == QNetworkReply::NoError) {
         int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if (httpStatus >= 200 && httpStatus < 300) {
+        if (httpStatus == 202) {
+            onJobCreated(reply);
+        } else if (httpStatus >= 200 && httpStatus < 300) {
             handleImageResponse(reply);
         } else {
             qDebug() << "HTTP error:" << httpStatus;
@@ -365,50 +620,294 @@ void PickImagesPage::handleNetworkReply(QNetworkReply* reply) {
         qDebug() << "Network error:" << reply->errorString();
     }
 
+    m_candidateReaders.remove(reply);
     reply->deleteLater();
 }
 
 
+// The job is queued on the server: fetch its images, which arrive as a multipart stream like a batch does
+void PickImagesPage::onJobCreated(QNetworkReply* reply)
+{
+    const QString jobId = QJsonDocument::fromJson(reply->readAll()).object().value("job_id").toString();
+    if (jobId.isEmpty()) {
+        qDebug() << "Job created without an id";
+        return;
+    }
+    const GenerationOptions options = optionsOf(reply);
+    qDebug() << "Job" << jobId << "queued for" << options.count << options.profile << "images";
+
+    try {
+        QNetworkReply *imagesReply = m_networkManager->get(createNetworkRequest(getJobsEndpoint() + "/" + jobId + "/images"));
+        if (!imagesReply) {
+            qDebug() << "Failed to create network reply";
+            cancelJob(jobId);
+            return;
+        }
+        imagesReply->setProperty(JOB_ID_PROPERTY, jobId);
+        imagesReply->setProperty(FRAME_OFFSET_PROPERTY, m_nextFrameIndex);
+        m_activeJobs.insert(jobId);
+        if (options.frameIndex >= 0 && options.frameIndex == m_finalRenderFrame) {
+            m_finalRenderJob = jobId;
+        }
+
+        trackReply(imagesReply, options);
+    } catch (const std::exception& e) {
+        qDebug() << "Unexpected error:" << e.what();
+        cancelJob(jobId);
+    }
+}
+
+// A job request nobody wants any more. Aborting it would leave the job running on the server if
+// the request already got there, with no id to cancel it by: let it finish, and cancel what it made
+void PickImagesPage::abandonJobCreation(QNetworkReply* reply)
+{
+    auto cancelCreated = [this, reply]() {
+        if (reply->error() == QNetworkReply::NoError
+            && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 202) {
+            const QString jobId = QJsonDocument::fromJson(reply->readAll()).object().value("job_id").toString();
+            if (!jobId.isEmpty()) {
+                cancelJob(jobId);
+            }
+        }
+        reply->deleteLater();
+    };
+
+    if (reply->isFinished()) {
+        cancelCreated();
+        return;
+    }
+    connect(reply, &QNetworkReply::finished, this, cancelCreated);
+    QTimer::singleShot(REQUEST_TIMEOUT_MS, reply, [reply]() {
+        reply->abort(); // finishes it, and the job is cancelled if it was made
+    });
+}
+
+// Fire and forget: nothing waits for the answer, the job just stops at its next denoising step
+void PickImagesPage::cancelJob(const QString& jobId)
+{
+    try {
+        QNetworkReply *reply = m_networkManager->deleteResource(createNetworkRequest(getJobsEndpoint() + "/" + jobId));
+        if (reply) {
+            connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
+        }
+        qDebug() << "Cancelling job" << jobId;
+    } catch (const std::exception& e) {
+        qDebug() << "Could not cancel job" << jobId << e.what();
+    }
+}
+
 // called by handle network reply
 void PickImagesPage::handleImageResponse(QNetworkReply* reply)
 {
-    static int currentFrameIndex = 0;
-
     if (reply->error() == QNetworkReply::NoError) {
-        QByteArray imageData = reply->readAll();
-        QString contentType = reply->header(QNetworkRequest::ContentTypeHeader).toString();
-
-        if (contentType.startsWith("image")) {
-            QImage qimg;
-            if (qimg.loadFromData(imageData)) {
-                // Ensure the image is in RGB format
-                if (qimg.format() != QImage::Format_RGB888) {
-                    qimg = qimg.convertToFormat(QImage::Format_RGB888);
-                }
-
-                cv::Mat mat = ImageUtils::qimage_to_mat(qimg);
-
-                if (currentFrameIndex < m_imageFrames.size()) {
-                    qDebug() << "Setting image for frame" << currentFrameIndex;
-                    m_imageFrames[currentFrameIndex]->setImage(mat);
-                    currentFrameIndex++;
-
-                    // Reset counter if we've filled all frames
-                    if (currentFrameIndex >= m_imageFrames.size()) {
-                        qDebug("Filled all frames, resetting index");
-                        currentFrameIndex = 0;
-                    }
-                }
+        if (m_candidateReaders.contains(reply)) {
+            readCandidates(reply); // whatever arrived with the end of the stream
+            if (!m_candidateReaders[reply].isFinished()) {
+                qDebug() << "Image stream ended early";
+            }
+        } else {
+            QByteArray imageData = reply->readAll();
+            QString contentType = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+
+            const cv::Mat image = contentType.startsWith("image") ? decodeImage(imageData) : cv::Mat();
+            if (!image.empty()) {
+                const qint64 seed = reply->hasRawHeader("X-Seed") ? reply->rawHeader("X-Seed").toLongLong() : -1;
+                cacheResult(reply, 0, image, seed);
+                addCandidate(image, seed);
             }
         }
     }
+    m_candidateReaders.remove(reply);
     reply->deleteLater();
 }
 
+// Slot every image of a multipart/mixed batch in as soon as its part is complete
+void PickImagesPage::readCandidates(QNetworkReply* reply)
+{
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QByteArray contentType = reply->header(QNetworkRequest::ContentTypeHeader).toByteArray();
+    if (httpStatus < 200 || httpStatus >= 300 || !contentType.startsWith("multipart/")) {
+        return; // single images and errors are read once the reply has finished
+    }
+
+    if (!m_candidateReaders.contains(reply)) {
+        m_candidateReaders.insert(reply, MultipartReader(MultipartReader::boundaryOf(contentType)));
+    }
+    MultipartReader& reader = m_candidateReaders[reply];
+    if (!reader.isValid()) {
+        qDebug() << "Multipart reply without a boundary:" << contentType;
+        return;
+    }
+
+    for (const MultipartReader::Part& part : reader.feed(reply->readAll())) {
+        if (!part.headers.value("content-type").startsWith("image")) {
+            continue;
+        }
+
+        // Jobs send rough previews of each candidate while it is denoised, then the candidate itself
+        const int frameIndex = reply->property(FRAME_PROPERTY).toInt();
+        if (part.headers.contains("x-preview")) {
+            const int candidate = part.headers.value("x-candidate").toInt();
+            if (frameIndex < 0) {
+                showPreview(reply->property(FRAME_OFFSET_PROPERTY).toInt() + candidate, part.body);
+            }
+            continue;
+        }
+
+        const cv::Mat image = decodeImage(part.body);
+        if (image.empty()) {
+            continue;
+        }
+        const qint64 seed = part.headers.value("x-seed", "-1").toLongLong();
+        cacheResult(reply, part.headers.value("x-candidate", "0").toInt(), image, seed);
+        if (frameIndex >= 0) {
+            replaceCandidate(frameIndex, image, seed);
+        } else {
+            addCandidate(image, seed);
+        }
+
+        // The rest of the batch keeps coming, so give it the time a single image gets
+        if (m_replyTimers.contains(reply)) {
+            m_replyTimers[reply]->start(REQUEST_TIMEOUT_MS);
+        }
+    }
+}
+
+cv::Mat PickImagesPage::decodeImage(const QByteArray& imageData)
+{
+    QImage qimg;
+    if (!qimg.loadFromData(imageData)) {
+        qDebug() << "Failed to decode a generated image";
+        return cv::Mat();
+    }
+
+    // Ensure the image is in RGB format
+    if (qimg.format() != QImage::Format_RGB888) {
+        qimg = qimg.convertToFormat(QImage::Format_RGB888);
+    }
+
+    return ImageUtils::qimage_to_mat(qimg);
+}
+
+void PickImagesPage::showPreview(int frameIndex, const QByteArray& imageData)
+{
+    if (frameIndex < 0 || frameIndex >= m_imageFrames.size()) {
+        return;
+    }
+    cv::Mat mat = decodeImage(imageData);
+    if (!mat.empty()) {
+        m_imageFrames[frameIndex]->setPreview(mat);
+    }
+}
+
+void PickImagesPage::addCandidate(const cv::Mat& image, qint64 seed)
+{
+    if (m_nextFrameIndex < m_imageFrames.size()) {
+        qDebug() << "Setting image for frame" << m_nextFrameIndex;
+        m_imageFrames[m_nextFrameIndex]->setImage(image);
+        m_frameSeeds[m_nextFrameIndex] = seed;
+        m_nextFrameIndex++;
+
+        // Reset counter if we've filled all frames
+        if (m_nextFrameIndex >= m_imageFrames.size()) {
+            qDebug("Filled all frames, resetting index");
+            m_nextFrameIndex = 0;
+        }
+    }
+}
+
+// The final-quality render of a draft: same seed, so the same picture with more detail
+void PickImagesPage::replaceCandidate(int frameIndex, const cv::Mat& image, qint64 seed)
+{
+    if (frameIndex == m_finalRenderFrame) {
+        m_finalRenderFrame = -1; // arrived, nothing left to cancel
+        m_finalRenderJob.clear();
+    }
+    if (frameIndex < 0 || frameIndex >= m_imageFrames.size() || m_frameSeeds[frameIndex] != seed) {
+        return; // the frame has moved on to another image since
+    }
+
+    qDebug() << "Final render for frame" << frameIndex;
+    ClickableFrame* frame = m_imageFrames[frameIndex];
+    frame->setImage(image);
+    if (frame == m_selectedFrame) {
+        m_projectionWindow->setFinalFrame(frame->getImage(), ChannelOrder::RGB);
+    }
+}
+
+// Most drafts are thrown away, so only the one the user picks is rendered at final quality
+void PickImagesPage::requestFinalRender(int frameIndex)
+{
+    if (m_candidateProfile == FINAL_PROFILE || m_finalFrames.contains(frameIndex)
+        || m_frameSeeds.value(frameIndex, -1) < 0 || m_upload.isEmpty()) {
+        return;
+    }
+    m_finalFrames.insert(frameIndex);
+
+    const qint64 seed = m_frameSeeds[frameIndex];
+    const QByteArray key = cacheKey(FINAL_PROFILE, QString("seed:%1").arg(seed));
+    cv::Mat image;
+    qint64 cachedSeed = -1;
+    if (m_resultCache.lookup(key, image, cachedSeed)) {
+        replaceCandidate(frameIndex, image, seed);
+        return;
+    }
+
+    GenerationOptions options;
+    options.profile = FINAL_PROFILE;
+    options.seed = seed;
+    options.frameIndex = frameIndex;
+    options.cacheKeys.append(key);
+    qDebug() << "Requesting final render of frame" << frameIndex << "seed" << options.seed;
+    m_finalRenderFrame = frameIndex;
+    m_finalRenderJob.clear();
+    sendGenerationRequest(options);
+}
+
+// The user picked another frame before the final render of this one came back: stop it on the
+// server, and let the frame be rendered again if it is picked again
+void PickImagesPage::cancelFinalRender()
+{
+    if (m_finalRenderFrame < 0) {
+        return;
+    }
+    const int frameIndex = m_finalRenderFrame;
+    m_finalRenderFrame = -1;
+    m_finalFrames.remove(frameIndex);
+    if (!m_finalRenderJob.isEmpty()) {
+        m_activeJobs.remove(m_finalRenderJob);
+        cancelJob(m_finalRenderJob);
+        m_finalRenderJob.clear();
+    }
+
+    const QList<QNetworkReply*> replies = m_activeReplies;
+    for (QNetworkReply* reply : replies) {
+        if (!reply || reply->property(FRAME_PROPERTY).toInt() != frameIndex) {
+            continue;
+        }
+        m_activeReplies.removeOne(reply);
+        m_candidateReaders.remove(reply);
+        if (m_replyTimers.contains(reply)) {
+            QTimer* timer = m_replyTimers.take(reply);
+            timer->stop();
+            timer->deleteLater();
+        }
+        disconnect(reply, nullptr, this, nullptr);
+        if (reply->property(JOB_ID_PROPERTY).toString().isEmpty()) {
+            abandonJobCreation(reply); // cancels the job once the server names it
+        } else {
+            reply->abort();
+            reply->deleteLater();
+        }
+    }
+    qDebug() << "Cancelled final render of frame" << frameIndex;
+}
+
 
 void PickImagesPage::onRejectButtonClicked()
 {
     cleanupNetworkRequests();
+    m_roundSeeds.remove(m_roundKey); // new variations next time, even for the same prompt
     QTimer::singleShot(300, this, [this]() {
         emit navigateToTextVisionPage();
     });
@@ -445,6 +944,9 @@ void PickImagesPage::clearImages()
         m_selectedFrame = nullptr;
     }
     ui->selectImagesButton->setEnabled(false);
+    m_nextFrameIndex = 0;
+    m_frameSeeds.fill(-1);
+    m_finalFrames.clear();
 
     // Clear all frame images properly
     for (int i = 0; i < m_imageFrames.size(); ++i) {
@@ -464,7 +966,7 @@ void PickImagesPage::refreshImages()
     // Now fetch new images
     clearImages();
     qDebug() << "Fetching new images...";
-    fetchRandomImages(2);
+    fetchRandomImages(m_imageFrames.size());
 }
 
 
@@ -509,14 +1011,19 @@ QFrame *PickImagesPage::createImagesGrid()
     QGridLayout *gridLayout = new QGridLayout(gridFrame);
     gridLayout->setSpacing(10);
 
-    for (int i = 0; i < 2; ++i)
+    // Two columns up to four candidates, three beyond, with the frames shrunk to fit the grid's width
+    const int columns = m_candidateCount <= 4 ? 2 : 3;
+    const int frameWidth = qMin(450, (1000 - (columns - 1) * gridLayout->spacing()) / columns);
+    const int frameHeight = 330 * frameWidth / 450;
+
+    for (int i = 0; i < m_candidateCount; ++i)
     {
         ClickableFrame *imageFrame = new ClickableFrame(this);
-        imageFrame->setFixedSize(450, 330);
+        imageFrame->setFixedSize(frameWidth, frameHeight);
         connect(imageFrame, &ClickableFrame::clicked, this, [this, imageFrame]() {
             updateSelectedImages(imageFrame);
         });
-        gridLayout->addWidget(imageFrame, i / 2, i % 2);
+        gridLayout->addWidget(imageFrame, i / columns, i % columns);
         m_imageFrames.append(imageFrame);
     }
 
@@ -534,12 +1041,14 @@ void PickImagesPage::updateSelectedImages(ClickableFrame *clickedFrame)
     // if clicked frame is selected
     if (clickedFrame->isSelected()) {
         m_selectedFrame = clickedFrame;  // Update to the newly selected frame
-        cv::Mat finalFrame= clickedFrame->getImage();
-        cv::Mat BGR_image;
-        cv::cvtColor(finalFrame, BGR_image, cv::COLOR_RGB2BGR);
-        m_projectionWindow->setFinalFrame(BGR_image); // set final frame w this image
+        if (m_finalRenderFrame >= 0 && m_finalRenderFrame != m_imageFrames.indexOf(clickedFrame)) {
+            cancelFinalRender();
+        }
+        // RGB as received; the projection window swizzles it while warping
+        m_projectionWindow->setFinalFrame(clickedFrame->getImage(), ChannelOrder::RGB);
         m_projectionWindow->setProjectionState(ImageProjectionWindow::projectionState::IMAGE);
         // change proj to show new image
+        requestFinalRender(m_imageFrames.indexOf(clickedFrame));
     } else {
         m_selectedFrame = nullptr;  // Clear the selection if the frame was deselected
         // change proj to show rainbow
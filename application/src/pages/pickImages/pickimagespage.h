@@ -9,9 +9,17 @@
 #include <QPushButton>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QHttpMultiPart>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QSet>
+#include <QVector>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include "clickableframe.h"
+#include "utils/uploadencoder.h"
+#include "utils/multipartreader.h"
+#include "utils/resultcache.h"
 
 namespace Ui {
 class PickImagesPage;
@@ -35,6 +43,7 @@ class PickImagesPage : public QWidget
         double getLowThreshold() const { return m_lowThreshold; }
         double getHighThreshold() const { return m_highThreshold; }
         void fetchRandomImages(int numImages);
+        void prepareUpload(); // encodes the current still region in the background, once per still
 
         // Setters
         void setPrompt(const QString& prompt) { m_prompt = prompt; }
@@ -72,16 +81,92 @@ class PickImagesPage : public QWidget
         QMap<QNetworkReply*, QTimer*> m_replyTimers;
         QList<QNetworkReply*> m_activeReplies;  // Track active network replies
 
+        // encoded still region, shared by every request made for it
+        UploadEncoder m_uploadEncoder;
+        QFutureWatcher<UploadPayload> m_uploadWatcher;
+        UploadPayload m_upload;
+        int m_uploadRevision;   // still revision m_upload (or the running encode) was made from
+        int m_pendingRequests;  // requests waiting for the encode or the surface upload to finish
+
+        // m_upload as stored on the server; generation requests then only carry its id
+        static constexpr const char* SURFACE_ID_PROPERTY = "surfaceId";
+        QString m_surfaceId;
+        QNetworkReply* m_surfaceReply;
+
+        // candidates: GPMS_CANDIDATES of them, requested together and slotted in as they arrive
+        static constexpr int MIN_CANDIDATES = 2, MAX_CANDIDATES = 9;
+        static constexpr const char* COUNT_PROPERTY = "count";
+        static constexpr const char* PROFILE_PROPERTY = "profile";
+        static constexpr const char* SEED_PROPERTY = "seed";
+        static constexpr const char* FRAME_PROPERTY = "frame";
+        static constexpr const char* CACHE_KEYS_PROPERTY = "cacheKeys";
+        static constexpr int REQUEST_TIMEOUT_MS = 100000;
+        static constexpr int BATCH_TIMEOUT_MS = 30000; // more per extra candidate
+        int m_candidateCount;
+        int m_nextFrameIndex;
+
+        // candidates come as quick drafts (GPMS_CANDIDATE_PROFILE); the one picked is rendered again
+        // at final quality from its seed, in place
+        static constexpr const char* FINAL_PROFILE = "final";
+        struct GenerationOptions {
+            int count = 1;
+            QString profile;
+            qint64 seed = -1;    // of the first image, the rest follow on; -1: the server picks, and reports each image's seed
+            int frameIndex = -1; // frame a re-render replaces; -1 fills frames in order
+            QList<QByteArray> cacheKeys; // where each image it returns goes in the result cache, in order
+        };
+        QString m_candidateProfile;
+        QVector<qint64> m_frameSeeds; // seed of each frame's image, -1 if none
+
+        // first seed of the candidates last asked for, per surface, prompt and profile (see cacheKey)
+        static constexpr int MAX_SEED = 2147483647; // the server's seeds are below 2^31
+        QHash<QByteArray, qint64> m_roundSeeds;
+        QByteArray m_roundKey; // the round on screen
+        QSet<int> m_finalFrames;      // frames already re-rendered (or on their way)
+        int m_finalRenderFrame = -1;  // frame whose final render is on its way, if any
+        QString m_finalRenderJob;     // its job on the server, once created
+
+        // what this surface and prompt produced before; hits skip the server altogether
+        ResultCache m_resultCache;
+        QMap<QNetworkReply*, MultipartReader> m_candidateReaders;
+
+        // server-side jobs whose images are still streaming; cancelled rather than just dropped
+        static constexpr const char* JOB_ID_PROPERTY = "jobId";
+        static constexpr const char* FRAME_OFFSET_PROPERTY = "frameOffset"; // frame of the job's first candidate
+        QSet<QString> m_activeJobs;
+
         void cleanupNetworkRequests();  // New method for cleanup
         bool validateInputs(int numImages);
-        QNetworkRequest createNetworkRequest();
+        QNetworkRequest createNetworkRequest(const QString& endpoint = QString());
+        QString getSurfacesEndpoint();
+        QString getJobsEndpoint();
         QUrlQuery createQueryParameters();
-        cv::Mat prepareImageData();
-        QByteArray encodeToPNG(const cv::Mat& image);
-        void sendNetworkRequest(const QNetworkRequest& request, const QByteArray& postData);
-        void setupRequestTimeout(QNetworkReply* reply);
+        void onUploadEncoded();
+        void uploadSurface();
+        void onSurfaceStored(QNetworkReply* reply);
+        void sendPendingRequests();
+        QMap<QString, QString> createFormFields(const GenerationOptions& options);
+        QHttpMultiPart* createMultiPart(const UploadPayload& upload, const QMap<QString, QString>& formFields);
+        void sendNetworkRequest(const QNetworkRequest& request, const UploadPayload& upload, const GenerationOptions& options);
+        void sendSurfaceRequest(const QString& surfaceId, const GenerationOptions& options);
+        void sendGenerationRequest(const GenerationOptions& options);
+        void trackReply(QNetworkReply* reply, const GenerationOptions& options);
+        GenerationOptions optionsOf(QNetworkReply* reply) const;
+        QByteArray cacheKey(const QString& profile, const QString& variant) const;
+        void cacheResult(QNetworkReply* reply, int candidate, const cv::Mat& image, qint64 seed);
+        void requestFinalRender(int frameIndex);
+        void cancelFinalRender();
+        void setupRequestTimeout(QNetworkReply* reply, int timeoutMs);
         void setupResponseHandlers(QNetworkReply* reply);
         void handleNetworkReply(QNetworkReply* reply);
+        void onJobCreated(QNetworkReply* reply);
+        void abandonJobCreation(QNetworkReply* reply);
+        void cancelJob(const QString& jobId);
+        void readCandidates(QNetworkReply* reply);
+        void addCandidate(const cv::Mat& image, qint64 seed);
+        void replaceCandidate(int frameIndex, const cv::Mat& image, qint64 seed);
+        void showPreview(int frameIndex, const QByteArray& imageData);
+        cv::Mat decodeImage(const QByteArray& imageData);
         QString getApiKey();
 
 
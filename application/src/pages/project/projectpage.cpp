@@ -8,6 +8,11 @@ ProjectPage::ProjectPage(ImageProjectionWindow *projectionWindow, QWidget *paren
     : QWidget(parent)
     , ui(new Ui::ProjectPage)
     , m_imageLabel(nullptr)
+    , m_compensateButton(nullptr)
+    , m_addSurfaceButton(nullptr)
+    , m_panZoomButton(nullptr)
+    , m_interactButton(nullptr)
+    , m_occlusionButton(nullptr)
 {
     ui->setupUi(this);
     initializeUI();
@@ -36,6 +41,11 @@ void ProjectPage::initializeUI()
 
     connect(ui->doneButton, &QPushButton::clicked, this, &ProjectPage::onDoneButtonClicked);
     connect(ui->rejectButton, &QPushButton::clicked, this, &ProjectPage::onRejectButtonClicked);
+    connect(m_compensateButton, &QPushButton::clicked, this, &ProjectPage::requestCompensation);
+    connect(m_addSurfaceButton, &QPushButton::clicked, this, &ProjectPage::requestAnotherSurface);
+    connect(m_panZoomButton, &QPushButton::clicked, this, &ProjectPage::requestPanZoom);
+    connect(m_interactButton, &QPushButton::clicked, this, &ProjectPage::requestInteraction);
+    connect(m_occlusionButton, &QPushButton::clicked, this, &ProjectPage::requestOcclusion);
 }
 
 void ProjectPage::setSelectedImage(const cv::Mat& mat)
@@ -52,6 +62,38 @@ void ProjectPage::setSelectedImage(const cv::Mat& mat)
     m_imageLabel->setPixmap(QPixmap::fromImage(qimg).scaled(m_imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
 }
 
+// Compensation takes a few seconds of flat frames, keep the button honest meanwhile
+void ProjectPage::setCompensationState(bool active, bool busy)
+{
+    m_compensateButton->setEnabled(!busy);
+    if (busy) {
+        m_compensateButton->setText("MEASURING...");
+    } else {
+        m_compensateButton->setText(active ? "UNDO COMPENSATION" : "COMPENSATE SURFACE");
+    }
+}
+
+void ProjectPage::setPanZoomState(bool active)
+{
+    m_panZoomButton->setText(active ? "HOLD STILL" : "PAN & ZOOM");
+}
+
+void ProjectPage::setInteractionState(bool active)
+{
+    m_interactButton->setText(active ? "STOP INTERACTING" : "INTERACTIVE");
+}
+
+// Masking starts by measuring the unlit surface for about a second
+void ProjectPage::setOcclusionState(bool active, bool busy)
+{
+    m_occlusionButton->setEnabled(!busy);
+    if (busy) {
+        m_occlusionButton->setText("MEASURING...");
+    } else {
+        m_occlusionButton->setText(active ? "PROJECT ON PEOPLE" : "AVOID PEOPLE");
+    }
+}
+
 QLabel* ProjectPage::createTitleLabel()
 {
     QLabel *titleLabel = new QLabel("Projecting Your Image", this);
@@ -92,6 +134,16 @@ QHBoxLayout* ProjectPage::createButtonLayout()
 {
     QHBoxLayout *buttonLayout = new QHBoxLayout();
     buttonLayout->addWidget(styleButton(ui->rejectButton, "REVISE VISION", "#CD6F6F"));
+    m_compensateButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(m_compensateButton, "COMPENSATE SURFACE", "#6F81CD"));
+    m_addSurfaceButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(m_addSurfaceButton, "ADD ANOTHER SURFACE", "#6F81CD"));
+    m_panZoomButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(m_panZoomButton, "PAN & ZOOM", "#6F81CD"));
+    m_interactButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(m_interactButton, "INTERACTIVE", "#6F81CD"));
+    m_occlusionButton = new QPushButton(this);
+    buttonLayout->addWidget(styleButton(m_occlusionButton, "AVOID PEOPLE", "#6F81CD"));
     buttonLayout->addWidget(styleButton(ui->doneButton, "FINISHED PROJECTING", "#BB64C7"));
     return buttonLayout;
 }
@@ -20,11 +20,20 @@ public:
     explicit ProjectPage(ImageProjectionWindow *projectionWindow, QWidget *parent = nullptr);
     ~ProjectPage();
     void setSelectedImage(const cv::Mat& selectedImage);
+    void setCompensationState(bool active, bool busy = false);
+    void setPanZoomState(bool active);
+    void setInteractionState(bool active);
+    void setOcclusionState(bool active, bool busy = false);
 
 signals:
     void navigateToPickImagesPage(QString prompt = "", bool isRealistic = false);
     void navigateToCreatePage();
     void requestImageRefresh();
+    void requestCompensation(); // toggles surface compensation
+    void requestAnotherSurface(); // keep this projection and calibrate another surface
+    void requestPanZoom(); // toggles the pan and zoom animation
+    void requestInteraction(); // toggles ripples where people touch the surface
+    void requestOcclusion(); // toggles blacking out people in front of the surface
 
 private slots:
     void onRejectButtonClicked();
@@ -33,6 +42,11 @@ private slots:
 private:
     Ui::ProjectPage *ui;
     QLabel* m_imageLabel;
+    QPushButton* m_compensateButton;
+    QPushButton* m_addSurfaceButton;
+    QPushButton* m_panZoomButton;
+    QPushButton* m_interactButton;
+    QPushButton* m_occlusionButton;
 
     // UI methods
     void initializeUI();
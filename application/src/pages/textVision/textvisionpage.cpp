@@ -155,6 +155,8 @@ void TextVisionPage::setupUI()
 
     m_submitButton = createSubmitButton();
     m_submitButton->setEnabled(false); // Initially disabled
+    m_sketchButton = createSubmitButton("SKETCH");
+    m_sketchButton->setEnabled(false);
     // Set the hand cursor when hovering over the button
     m_realisticButton->setCursor(Qt::PointingHandCursor);
     m_animatedButton->setCursor(Qt::PointingHandCursor);
@@ -204,7 +206,12 @@ void TextVisionPage::setupLayouts()
     mainLayout->addWidget(m_title, 0, Qt::AlignHCenter);
     mainLayout->addLayout(optionsLayout);
     mainLayout->addWidget(m_visionInput, 0, Qt::AlignHCenter);
-    mainLayout->addWidget(m_submitButton, 0, Qt::AlignHCenter);
+    QHBoxLayout *submitLayout = new QHBoxLayout();
+    submitLayout->addStretch();
+    submitLayout->addWidget(m_submitButton);
+    submitLayout->addWidget(m_sketchButton);
+    submitLayout->addStretch();
+    mainLayout->addLayout(submitLayout);
 
     setLayout(mainLayout);
 }
@@ -214,9 +221,9 @@ void TextVisionPage::setupStyleSheets()
     m_visionInput->setStyleSheet("color: white; background-color: #2E2E2E; border-radius: 10px; padding: 20px");
 }
 
-QPushButton* TextVisionPage::createSubmitButton()
+QPushButton* TextVisionPage::createSubmitButton(const QString& text)
 {
-    QPushButton* submit_button = new QPushButton("+ SUBMIT", this);
+    QPushButton* submit_button = new QPushButton(text, this);
     submit_button->setFixedSize(120, 40);
     submit_button->setStyleSheet(
         "QPushButton {"
@@ -241,6 +248,7 @@ QPushButton* TextVisionPage::createSubmitButton()
 void TextVisionPage::setupConnections()
 {
     connect(m_submitButton, &QPushButton::clicked, this, &TextVisionPage::onSubmitButtonClicked);
+    connect(m_sketchButton, &QPushButton::clicked, this, &TextVisionPage::onSketchButtonClicked);
     connect(m_realisticButton, &QPushButton::clicked, this, &TextVisionPage::onRealisticButtonClicked);
     connect(m_animatedButton, &QPushButton::clicked, this, &TextVisionPage::onAnimatedButtonClicked);
     connect(m_visionInput, &QTextEdit::textChanged, this, &TextVisionPage::onTextChanged);
@@ -270,6 +278,25 @@ void TextVisionPage::onSubmitButtonClicked()
 }
 
 
+// Sketch mode submits on its own once the drawing on the board stops changing
+void TextVisionPage::onSketchButtonClicked()
+{
+    m_visionText = m_visionInput->toPlainText();
+    if (m_visionText.isEmpty() && !m_sketching) {
+        return;
+    }
+
+    emit requestSketch(m_visionText, m_isRealistic);
+}
+
+void TextVisionPage::setSketchState(bool watching)
+{
+    m_sketching = watching;
+    m_sketchButton->setText(watching ? "STOP" : "SKETCH");
+    m_submitButton->setEnabled(!watching && !m_visionInput->toPlainText().isEmpty());
+    m_visionInput->setEnabled(!watching);
+}
+
 void TextVisionPage::onRealisticButtonClicked()
 {
     m_isRealistic = true;
@@ -286,5 +313,6 @@ void TextVisionPage::onTextChanged()
 {
     bool hasText = !m_visionInput->toPlainText().isEmpty();
     m_submitButton->setEnabled(hasText);
+    m_sketchButton->setEnabled(hasText);
 }
 
@@ -24,15 +24,18 @@ public:
     void clearInput();
 
     void hideLoading(); // hide loading
+    void setSketchState(bool watching);
 
 signals:
     void navigateToPickImagesPage(QString prompt, bool isRealistic);
+    void requestSketch(QString prompt, bool isRealistic); // toggles watching the board for a finished sketch
 
 protected:
     bool eventFilter(QObject *obj, QEvent *event) override;
 
 private slots:
     void onSubmitButtonClicked();
+    void onSketchButtonClicked();
     void onRealisticButtonClicked();
     void onAnimatedButtonClicked();
     void onTextChanged();
@@ -50,7 +53,7 @@ private:
     void hideKeyboard();
 
     void updateButtonStyles();
-    QPushButton* createSubmitButton();
+    QPushButton* createSubmitButton(const QString& text = "+ SUBMIT");
 
     QString m_wvkbdPath; // keyboard path
     bool m_onRaspberryPi;
@@ -59,6 +62,8 @@ private:
     QPushButton *m_animatedButton;
     QTextEdit *m_visionInput;
     QPushButton *m_submitButton;
+    QPushButton *m_sketchButton;
+    bool m_sketching = false;
     bool isRunningOnRaspberryPi();
 
 
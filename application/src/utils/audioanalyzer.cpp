@@ -0,0 +1,426 @@
+// audioanalyzer.cpp
+
+#include "audioanalyzer.h"
+
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioDeviceInfo>
+#include <QAudioInput>
+#include <QDebug>
+#include <QFileInfo>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static constexpr float PI = 3.14159265358979f;
+
+// Band edges in Hz: bass, low mid, high mid, treble
+static constexpr float BAND_EDGES[AudioLevels::BANDS + 1] = {20.0f, 150.0f, 600.0f, 2500.0f, 10000.0f};
+
+AudioAnalyzer::AudioAnalyzer(QObject* parent)
+    : QObject(parent)
+    , m_sequence(0)
+    , m_pulse(0.0f)
+    , m_sampleTimeNs(0)
+    , m_context(new QObject)
+    , m_running(false)
+    , m_input(nullptr)
+    , m_inputDevice(nullptr)
+    , m_decoder(nullptr)
+    , m_inputLatencyNs(0)
+    , m_feedTimer(nullptr)
+    , m_feedStartNs(0)
+    , m_fileRate(SAMPLE_RATE)
+    , m_fileFed(0)
+    , m_sampleRate(SAMPLE_RATE)
+    , m_ringPos(0)
+    , m_sinceHop(0)
+    , m_pulseLevel(0.0f)
+{
+    for (std::atomic<float>& band : m_bands) {
+        band.store(0.0f);
+    }
+
+    m_context->moveToThread(&m_thread);
+    m_thread.setObjectName("AudioAnalyzer");
+    m_thread.start(QThread::TimeCriticalPriority); // late samples are late light
+}
+
+AudioAnalyzer::~AudioAnalyzer()
+{
+    stop();
+    m_thread.quit();
+    m_thread.wait();
+    delete m_context; // the thread is gone, safe to delete from here
+}
+
+void AudioAnalyzer::start(const QString& source)
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    QMetaObject::invokeMethod(m_context, [this, source]() { openSource(source); }, Qt::QueuedConnection);
+}
+
+void AudioAnalyzer::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    QMetaObject::invokeMethod(m_context, [this]() { closeSource(); }, Qt::BlockingQueuedConnection);
+}
+
+bool AudioAnalyzer::isRunning() const
+{
+    return m_running;
+}
+
+// Retries only while the analysis thread is mid-publish, which takes a handful of stores
+bool AudioAnalyzer::snapshot(AudioLevels& levels) const
+{
+    for (;;) {
+        const unsigned before = m_sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before & 1u) {
+            continue;
+        }
+
+        for (int b = 0; b < AudioLevels::BANDS; ++b) {
+            levels.bands[b] = m_bands[b].load(std::memory_order_relaxed);
+        }
+        levels.pulse = m_pulse.load(std::memory_order_relaxed);
+        levels.sampleTimeNs = m_sampleTimeNs.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+}
+
+qint64 AudioAnalyzer::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Analysis thread
+void AudioAnalyzer::openSource(const QString& source)
+{
+    const bool opened = QFileInfo::exists(source) ? openFile(source) : openInput(source);
+    if (!opened) {
+        qDebug() << "AudioAnalyzer: could not open" << source;
+    }
+}
+
+void AudioAnalyzer::closeSource()
+{
+    if (m_feedTimer) {
+        m_feedTimer->stop();
+    }
+    if (m_input) {
+        m_input->stop();
+        delete m_input;
+        m_input = nullptr;
+        m_inputDevice = nullptr;
+    }
+    if (m_decoder) {
+        m_decoder->stop();
+        delete m_decoder;
+        m_decoder = nullptr;
+    }
+    m_fileSamples.clear();
+    qDebug() << "AudioAnalyzer stopped";
+}
+
+bool AudioAnalyzer::openInput(const QString& source)
+{
+    QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+    if (source != "default") {
+        device = QAudioDeviceInfo();
+        for (const QAudioDeviceInfo& info : QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
+            if (info.deviceName() == source) {
+                device = info;
+                break;
+            }
+        }
+    }
+    if (device.isNull()) {
+        qDebug() << "AudioAnalyzer: no input device" << source;
+        return false;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(SAMPLE_RATE);
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+    if (!device.isFormatSupported(format)) {
+        format = device.nearestFormat(format);
+    }
+    m_format = format;
+
+    m_input = new QAudioInput(device, format, m_context);
+    m_input->setBufferSize(INPUT_BUFFER_FRAMES * format.bytesPerFrame()); // small, so samples arrive promptly
+    m_inputDevice = m_input->start();
+    if (!m_inputDevice) {
+        qDebug() << "AudioAnalyzer: input did not start, error" << m_input->error();
+        delete m_input;
+        m_input = nullptr;
+        return false;
+    }
+
+    prepareAnalysis(format.sampleRate());
+    m_inputLatencyNs = static_cast<qint64>(INPUT_BUFFER_FRAMES / 2) * 1000000000LL / format.sampleRate();
+    QObject::connect(m_inputDevice, &QIODevice::readyRead, m_context, [this]() { readInput(); });
+
+    qDebug() << "AudioAnalyzer listening on" << device.deviceName() << "at" << format.sampleRate() << "Hz,"
+             << format.channelCount() << "channel(s)";
+    return true;
+}
+
+// Decoded up front, then fed to the analysis at the pace it would play, looping
+bool AudioAnalyzer::openFile(const QString& path)
+{
+    QAudioFormat format;
+    format.setSampleRate(SAMPLE_RATE);
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+
+    m_decoder = new QAudioDecoder(m_context);
+    m_decoder->setAudioFormat(format);
+    m_decoder->setSourceFilename(path);
+
+    QObject::connect(m_decoder, &QAudioDecoder::bufferReady, m_context, [this]() {
+        const QAudioBuffer buffer = m_decoder->read();
+        m_fileRate = buffer.format().sampleRate();
+        appendMono(static_cast<const char*>(buffer.constData()), buffer.byteCount(), buffer.format(), m_fileSamples);
+    });
+    QObject::connect(m_decoder, QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error), m_context,
+                     [this](QAudioDecoder::Error) {
+        qDebug() << "AudioAnalyzer: decoding failed," << m_decoder->errorString();
+    });
+    QObject::connect(m_decoder, &QAudioDecoder::finished, m_context, [this, path]() {
+        if (m_fileSamples.empty()) {
+            qDebug() << "AudioAnalyzer: no samples in" << path;
+            return;
+        }
+
+        prepareAnalysis(m_fileRate);
+        m_fileFed = 0;
+        m_feedStartNs = nowNs();
+        if (!m_feedTimer) {
+            m_feedTimer = new QTimer(m_context);
+            m_feedTimer->setTimerType(Qt::PreciseTimer);
+            QObject::connect(m_feedTimer, &QTimer::timeout, m_context, [this]() { feedFile(); });
+        }
+        m_feedTimer->start(FEED_INTERVAL_MS);
+        qDebug() << "AudioAnalyzer playing" << path << "," << m_fileSamples.size() / m_fileRate << "s at" << m_fileRate << "Hz";
+    });
+
+    m_decoder->start();
+    return true;
+}
+
+void AudioAnalyzer::readInput()
+{
+    const QByteArray data = m_inputDevice->readAll();
+    const qint64 arrivalNs = nowNs();
+
+    m_mono.clear();
+    if (appendMono(data.constData(), data.size(), m_format, m_mono) && !m_mono.empty()) {
+        pushMono(m_mono.data(), static_cast<int>(m_mono.size()), arrivalNs - m_inputLatencyNs);
+    }
+}
+
+// Hand over every sample whose play time has come; each one is timestamped with that time
+void AudioAnalyzer::feedFile()
+{
+    const qint64 total = static_cast<qint64>(m_fileSamples.size());
+    const qint64 due = (nowNs() - m_feedStartNs) * m_fileRate / 1000000000LL;
+
+    while (m_fileFed < due) {
+        const qint64 offset = m_fileFed % total;
+        const int count = static_cast<int>(std::min(due - m_fileFed, total - offset));
+        const qint64 newestNs = m_feedStartNs + (m_fileFed + count) * 1000000000LL / m_fileRate;
+        pushMono(m_fileSamples.data() + offset, count, newestNs);
+        m_fileFed += count;
+    }
+}
+
+// Interleaved PCM to mono floats in [-1, 1]; little-endian data assumed
+bool AudioAnalyzer::appendMono(const char* data, qint64 bytes, const QAudioFormat& format, std::vector<float>& out)
+{
+    const int channels = format.channelCount();
+    const int frameBytes = format.bytesPerFrame();
+    if (channels <= 0 || frameBytes <= 0) {
+        return false;
+    }
+
+    const qint64 frames = bytes / frameBytes;
+    const size_t start = out.size();
+    out.resize(start + frames);
+    float* mono = out.data() + start;
+    const float scale = 1.0f / channels;
+
+    if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 16) {
+        for (qint64 f = 0; f < frames; ++f) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; ++c) {
+                qint16 sample;
+                std::memcpy(&sample, data + f * frameBytes + c * 2, 2);
+                sum += sample * (1.0f / 32768.0f);
+            }
+            mono[f] = sum * scale;
+        }
+    } else if (format.sampleType() == QAudioFormat::SignedInt && format.sampleSize() == 32) {
+        for (qint64 f = 0; f < frames; ++f) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; ++c) {
+                qint32 sample;
+                std::memcpy(&sample, data + f * frameBytes + c * 4, 4);
+                sum += sample * (1.0f / 2147483648.0f);
+            }
+            mono[f] = sum * scale;
+        }
+    } else if (format.sampleType() == QAudioFormat::Float && format.sampleSize() == 32) {
+        for (qint64 f = 0; f < frames; ++f) {
+            float sum = 0.0f;
+            for (int c = 0; c < channels; ++c) {
+                float sample;
+                std::memcpy(&sample, data + f * frameBytes + c * 4, 4);
+                sum += sample;
+            }
+            mono[f] = sum * scale;
+        }
+    } else {
+        out.resize(start);
+        qDebug() << "AudioAnalyzer: unsupported sample format" << format;
+        return false;
+    }
+    return true;
+}
+
+void AudioAnalyzer::prepareAnalysis(int sampleRate)
+{
+    m_sampleRate = sampleRate;
+    m_ring.assign(FFT_SIZE, 0.0f);
+    m_ringPos = 0;
+    m_sinceHop = 0;
+    m_peaks.fill(PEAK_FLOOR);
+    m_pulseLevel = 0.0f;
+
+    m_hann.resize(FFT_SIZE);
+    for (int n = 0; n < FFT_SIZE; ++n) {
+        m_hann[n] = 0.5f - 0.5f * std::cos(2.0f * PI * n / FFT_SIZE);
+    }
+
+    m_twiddles.resize(FFT_SIZE / 2);
+    for (int k = 0; k < FFT_SIZE / 2; ++k) {
+        m_twiddles[k] = std::polar(1.0f, -2.0f * PI * k / FFT_SIZE);
+    }
+
+    int bits = 0;
+    while ((1 << bits) < FFT_SIZE) {
+        ++bits;
+    }
+    m_bitReverse.resize(FFT_SIZE);
+    for (int n = 0; n < FFT_SIZE; ++n) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b) {
+            reversed |= ((n >> b) & 1) << (bits - 1 - b);
+        }
+        m_bitReverse[n] = reversed;
+    }
+    m_spectrum.resize(FFT_SIZE);
+
+    for (int b = 0; b <= AudioLevels::BANDS; ++b) {
+        const int bin = static_cast<int>(std::lround(BAND_EDGES[b] * FFT_SIZE / sampleRate));
+        m_bandBins[b] = std::min(std::max(bin, 1), FFT_SIZE / 2);
+    }
+    for (int b = 1; b <= AudioLevels::BANDS; ++b) {
+        m_bandBins[b] = std::max(m_bandBins[b], m_bandBins[b - 1] + 1); // at least one bin per band
+    }
+}
+
+// newestSampleNs is when the last of the samples arrived
+void AudioAnalyzer::pushMono(const float* samples, int count, qint64 newestSampleNs)
+{
+    for (int i = 0; i < count; ++i) {
+        m_ring[m_ringPos] = samples[i];
+        m_ringPos = (m_ringPos + 1) % FFT_SIZE;
+
+        if (++m_sinceHop >= HOP) {
+            m_sinceHop = 0;
+            analyse(newestSampleNs - static_cast<qint64>(count - 1 - i) * 1000000000LL / m_sampleRate);
+        }
+    }
+}
+
+void AudioAnalyzer::analyse(qint64 newestSampleNs)
+{
+    // Oldest sample first, windowed, straight into bit-reversed order for the in-place FFT
+    for (int n = 0; n < FFT_SIZE; ++n) {
+        m_spectrum[m_bitReverse[n]] = std::complex<float>(m_ring[(m_ringPos + n) % FFT_SIZE] * m_hann[n], 0.0f);
+    }
+    fft();
+
+    const float hopSeconds = static_cast<float>(HOP) / m_sampleRate;
+    const float peakDecay = std::exp2(-hopSeconds / PEAK_HALF_LIFE_S);
+    const float pulseRelease = std::exp(-hopSeconds / PULSE_RELEASE_S);
+
+    std::array<float, AudioLevels::BANDS> bands;
+    for (int b = 0; b < AudioLevels::BANDS; ++b) {
+        float energy = 0.0f;
+        for (int k = m_bandBins[b]; k < m_bandBins[b + 1]; ++k) {
+            energy += std::norm(m_spectrum[k]);
+        }
+        m_peaks[b] = std::max({energy, m_peaks[b] * peakDecay, PEAK_FLOOR});
+        bands[b] = std::sqrt(energy / m_peaks[b]);
+    }
+    m_pulseLevel = std::max(bands[0], m_pulseLevel * pulseRelease);
+
+    // The Hann window weights the middle of the block, half a window before the newest sample
+    publish(bands, m_pulseLevel, newestSampleNs - static_cast<qint64>(FFT_SIZE / 2) * 1000000000LL / m_sampleRate);
+}
+
+// Iterative radix-2 FFT over m_spectrum, input already in bit-reversed order
+void AudioAnalyzer::fft()
+{
+    for (int size = 2; size <= FFT_SIZE; size *= 2) {
+        const int half = size / 2;
+        const int step = FFT_SIZE / size;
+        for (int start = 0; start < FFT_SIZE; start += size) {
+            for (int k = 0; k < half; ++k) {
+                const std::complex<float> t = m_twiddles[k * step] * m_spectrum[start + k + half];
+                m_spectrum[start + k + half] = m_spectrum[start + k] - t;
+                m_spectrum[start + k] += t;
+            }
+        }
+    }
+}
+
+void AudioAnalyzer::publish(const std::array<float, AudioLevels::BANDS>& bands, float pulse, qint64 sampleTimeNs)
+{
+    const unsigned sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int b = 0; b < AudioLevels::BANDS; ++b) {
+        m_bands[b].store(bands[b], std::memory_order_relaxed);
+    }
+    m_pulse.store(pulse, std::memory_order_relaxed);
+    m_sampleTimeNs.store(sampleTimeNs, std::memory_order_relaxed);
+
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,111 @@
+// audioanalyzer.h
+
+#ifndef AUDIOANALYZER_H
+#define AUDIOANALYZER_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QAudioFormat>
+#include <array>
+#include <atomic>
+#include <complex>
+#include <vector>
+
+class QAudioInput;
+class QAudioDecoder;
+class QIODevice;
+
+// What the effects sample each frame
+struct AudioLevels {
+    static constexpr int BANDS = 4; // bass, low mid, high mid, treble
+
+    std::array<float, BANDS> bands{}; // 0..1, relative to each band's recent peak
+    float pulse = 0.0f;               // bass with an instant attack and a short release
+    qint64 sampleTimeNs = 0;          // AudioAnalyzer::nowNs() of the audio these describe
+};
+
+// Band energies of live audio (an input device) or a WAV/FLAC file played back in
+// real time, for testing. Capture and a 1024-point FFT every 256 samples run on
+// a thread of their own; results are published through a sequence lock so the
+// projection window can read them every frame without ever waiting on it.
+class AudioAnalyzer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AudioAnalyzer(QObject* parent = nullptr);
+    ~AudioAnalyzer();
+
+    // "default" for the default input, an input device name (e.g. an ALSA "hw:1,0"),
+    // or the path of an audio file
+    void start(const QString& source);
+    void stop();
+    bool isRunning() const;
+
+    // Any thread; false until the first analysis
+    bool snapshot(AudioLevels& levels) const;
+
+    static qint64 nowNs(); // steady clock shared with the consumers
+
+private:
+    static constexpr int FFT_SIZE = 1024;
+    static constexpr int HOP = 256;
+    static constexpr int SAMPLE_RATE = 48000;
+    static constexpr int INPUT_BUFFER_FRAMES = 512; // device buffer; half of it is latency
+    static constexpr int FEED_INTERVAL_MS = 5;      // file playback granularity
+    static constexpr float PEAK_HALF_LIFE_S = 3.0f;
+    static constexpr float PULSE_RELEASE_S = 0.15f;
+    static constexpr float PEAK_FLOOR = 1.0f; // keeps silence from being normalised up to full scale
+
+    // Published snapshot (sequence lock: odd while the analysis thread writes)
+    std::atomic<unsigned> m_sequence;
+    std::array<std::atomic<float>, AudioLevels::BANDS> m_bands;
+    std::atomic<float> m_pulse;
+    std::atomic<qint64> m_sampleTimeNs;
+
+    QThread m_thread;
+    QObject* m_context; // lives on m_thread; everything below is only touched from there
+    bool m_running;
+
+    QAudioFormat m_format;
+    QAudioInput* m_input;
+    QIODevice* m_inputDevice;
+    QAudioDecoder* m_decoder;
+    qint64 m_inputLatencyNs;  // average time a sample waits in the device buffer
+    QTimer* m_feedTimer;
+    qint64 m_feedStartNs;
+    std::vector<float> m_fileSamples; // decoded file, mono
+    int m_fileRate;
+    qint64 m_fileFed;                 // samples handed to the analysis since playback started
+    std::vector<float> m_mono;        // conversion scratch
+
+    // Analysis
+    int m_sampleRate;
+    std::vector<float> m_ring; // last FFT_SIZE samples
+    int m_ringPos;
+    int m_sinceHop;
+    std::vector<float> m_hann;
+    std::vector<std::complex<float>> m_twiddles;
+    std::vector<int> m_bitReverse;
+    std::vector<std::complex<float>> m_spectrum;
+    std::array<int, AudioLevels::BANDS + 1> m_bandBins; // band b covers bins [m_bandBins[b], m_bandBins[b + 1])
+    std::array<float, AudioLevels::BANDS> m_peaks;
+    float m_pulseLevel;
+
+    void openSource(const QString& source);
+    void closeSource();
+    bool openInput(const QString& source);
+    bool openFile(const QString& path);
+    void readInput();
+    void feedFile();
+
+    void prepareAnalysis(int sampleRate);
+    static bool appendMono(const char* data, qint64 bytes, const QAudioFormat& format, std::vector<float>& out);
+    void pushMono(const float* samples, int count, qint64 newestSampleNs);
+    void analyse(qint64 newestSampleNs);
+    void fft();
+    void publish(const std::array<float, AudioLevels::BANDS>& bands, float pulse, qint64 sampleTimeNs);
+};
+
+#endif // AUDIOANALYZER_H
@@ -0,0 +1,206 @@
+// cameramodel.cpp
+
+#include "cameramodel.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// Inner corners of the printed checkerboard
+static const cv::Size BOARD_SIZE(9, 6);
+
+// Detection runs on a downscaled copy; corners are refined at full resolution
+static constexpr double DETECT_SCALE = 0.5;
+
+CameraModel::CameraModel()
+{
+}
+
+bool CameraModel::isValid() const
+{
+    return !m_cameraMatrix.empty() && !m_distCoeffs.empty();
+}
+
+QString CameraModel::defaultPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/camera_model.yml";
+}
+
+cv::Size CameraModel::boardSize()
+{
+    return BOARD_SIZE;
+}
+
+bool CameraModel::load(const QString& path)
+{
+    if (!QFileInfo::exists(path)) {
+        qDebug() << "No camera model at" << path;
+        return false;
+    }
+
+    try {
+        cv::FileStorage fs(path.toStdString(), cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            qDebug() << "Failed to open camera model" << path;
+            return false;
+        }
+        fs["camera_matrix"] >> m_cameraMatrix;
+        fs["dist_coeffs"] >> m_distCoeffs;
+        int width = 0, height = 0;
+        fs["image_width"] >> width;
+        fs["image_height"] >> height;
+        m_imageSize = cv::Size(width, height);
+    } catch (const cv::Exception& e) {
+        qDebug() << "Error reading camera model:" << e.what();
+        m_cameraMatrix.release();
+        m_distCoeffs.release();
+        return false;
+    }
+
+    m_mapSize = cv::Size();
+    qDebug() << "Camera model loaded from" << path;
+    return isValid();
+}
+
+bool CameraModel::save(const QString& path) const
+{
+    if (!isValid()) {
+        qDebug() << "Camera model is not calibrated, nothing to save.";
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    cv::FileStorage fs(path.toStdString(), cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        qDebug() << "Failed to write camera model" << path;
+        return false;
+    }
+    fs << "camera_matrix" << m_cameraMatrix;
+    fs << "dist_coeffs" << m_distCoeffs;
+    fs << "image_width" << m_imageSize.width;
+    fs << "image_height" << m_imageSize.height;
+
+    qDebug() << "Camera model saved to" << path;
+    return true;
+}
+
+bool CameraModel::findCheckerboard(const cv::Mat& frame, std::vector<cv::Point2f>& corners) const
+{
+    if (frame.empty()) {
+        return false;
+    }
+
+    cv::Mat gray, small;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    cv::resize(gray, small, cv::Size(), DETECT_SCALE, DETECT_SCALE, cv::INTER_AREA);
+
+    if (!cv::findChessboardCorners(small, BOARD_SIZE, corners,
+                                   cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK)) {
+        return false;
+    }
+
+    for (cv::Point2f& corner : corners) {
+        corner *= static_cast<float>(1.0 / DETECT_SCALE);
+    }
+    cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+    return true;
+}
+
+void CameraModel::addView(const std::vector<cv::Point2f>& corners, const cv::Size& imageSize)
+{
+    if (!m_views.empty() && imageSize != m_imageSize) {
+        qDebug() << "Frame size changed during lens calibration, restarting collection.";
+        m_views.clear();
+    }
+    m_imageSize = imageSize;
+    m_views.push_back(corners);
+}
+
+void CameraModel::clearViews()
+{
+    m_views.clear();
+}
+
+int CameraModel::viewCount() const
+{
+    return static_cast<int>(m_views.size());
+}
+
+double CameraModel::calibrate()
+{
+    if (m_views.size() < 3) {
+        qDebug() << "Not enough checkerboard views to calibrate:" << m_views.size();
+        return -1.0;
+    }
+
+    // Board in its own plane, unit squares; scale doesn't matter for intrinsics
+    std::vector<cv::Point3f> board;
+    for (int y = 0; y < BOARD_SIZE.height; ++y) {
+        for (int x = 0; x < BOARD_SIZE.width; ++x) {
+            board.emplace_back(static_cast<float>(x), static_cast<float>(y), 0.0f);
+        }
+    }
+    const std::vector<std::vector<cv::Point3f>> objectPoints(m_views.size(), board);
+
+    cv::Mat cameraMatrix, distCoeffs;
+    std::vector<cv::Mat> rvecs, tvecs;
+    double rms = -1.0;
+    try {
+        rms = cv::calibrateCamera(objectPoints, m_views, m_imageSize, cameraMatrix, distCoeffs, rvecs, tvecs);
+    } catch (const cv::Exception& e) {
+        qDebug() << "Lens calibration failed:" << e.what();
+        return -1.0;
+    }
+
+    m_cameraMatrix = cameraMatrix;
+    m_distCoeffs = distCoeffs;
+    m_mapSize = cv::Size();
+    m_views.clear();
+
+    qDebug() << "Lens calibrated, RMS reprojection error:" << rms;
+    return rms;
+}
+
+void CameraModel::buildMaps(const cv::Size& size) const
+{
+    // Intrinsics scale with the frame if it's captured at a different resolution than calibrated
+    cv::Mat cameraMatrix = m_cameraMatrix.clone();
+    if (m_imageSize.area() > 0 && size != m_imageSize) {
+        cameraMatrix.row(0) *= static_cast<double>(size.width) / m_imageSize.width;
+        cameraMatrix.row(1) *= static_cast<double>(size.height) / m_imageSize.height;
+    }
+
+    // alpha = 0 keeps only valid pixels, so no black border shows up in the corners
+    const cv::Mat newCameraMatrix = cv::getOptimalNewCameraMatrix(cameraMatrix, m_distCoeffs, size, 0.0, size);
+    cv::initUndistortRectifyMap(cameraMatrix, m_distCoeffs, cv::Mat(), newCameraMatrix, size,
+                                CV_16SC2, m_map1, m_map2);
+    m_mapSize = size;
+}
+
+void CameraModel::undistort(const cv::Mat& src, cv::Mat& dst, const cv::Rect& roi) const
+{
+    if (src.empty()) {
+        dst.release();
+        return;
+    }
+
+    const cv::Rect frameRect(cv::Point(0, 0), src.size());
+    const cv::Rect region = roi.area() > 0 ? (roi & frameRect) : frameRect;
+
+    if (!isValid()) {
+        src(region).copyTo(dst);
+        return;
+    }
+
+    if (m_mapSize != src.size()) {
+        buildMaps(src.size());
+    }
+
+    // Slicing the tables yields the rectified crop directly, one remap for undistort + crop
+    cv::remap(src, dst, m_map1(region), m_map2(region), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+}
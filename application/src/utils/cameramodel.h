@@ -0,0 +1,48 @@
+// cameramodel.h
+
+#ifndef CAMERAMODEL_H
+#define CAMERAMODEL_H
+
+#include <QString>
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Camera intrinsics and lens distortion, calibrated from checkerboard views.
+// Undistortion goes through precomputed remap tables, and can produce just a
+// region of the rectified image so cropping costs no extra pass.
+class CameraModel
+{
+public:
+    CameraModel();
+
+    bool isValid() const;
+    bool load(const QString& path = defaultPath());
+    bool save(const QString& path = defaultPath()) const;
+    static QString defaultPath();
+
+    // Checkerboard collection for calibration
+    bool findCheckerboard(const cv::Mat& frame, std::vector<cv::Point2f>& corners) const;
+    void addView(const std::vector<cv::Point2f>& corners, const cv::Size& imageSize);
+    void clearViews();
+    int viewCount() const;
+    double calibrate(); // RMS reprojection error in pixels, negative on failure
+    static cv::Size boardSize();
+
+    // Writes the undistorted image (or only its roi) into dst; copies through when not calibrated
+    void undistort(const cv::Mat& src, cv::Mat& dst, const cv::Rect& roi = cv::Rect()) const;
+
+private:
+    cv::Mat m_cameraMatrix;
+    cv::Mat m_distCoeffs;
+    cv::Size m_imageSize;
+
+    std::vector<std::vector<cv::Point2f>> m_views;
+
+    // Rectification tables, built lazily for the frame size in use
+    mutable cv::Mat m_map1, m_map2;
+    mutable cv::Size m_mapSize;
+
+    void buildMaps(const cv::Size& size) const;
+};
+
+#endif // CAMERAMODEL_H
@@ -0,0 +1,235 @@
+// colorlut.cpp
+
+#include "colorlut.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QProcessEnvironment>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <algorithm>
+#include <opencv2/core/hal/intrin.hpp>
+
+ColorLut::ColorLut()
+    : m_size(0)
+{
+}
+
+bool ColorLut::isValid() const
+{
+    return m_size >= 2;
+}
+
+int ColorLut::size() const
+{
+    return m_size;
+}
+
+void ColorLut::clear()
+{
+    m_size = 0;
+    m_table.clear();
+}
+
+QString ColorLut::pathForScreen(const QString& screenName)
+{
+    const QString overridePath = QProcessEnvironment::systemEnvironment().value("GPMS_PROJECTOR_LUT");
+    if (!overridePath.isEmpty()) {
+        return overridePath;
+    }
+
+    QString fileName = screenName;
+    fileName.replace(QRegularExpression("[^A-Za-z0-9_-]"), "_");
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/luts/" + fileName + ".cube";
+}
+
+bool ColorLut::load(const QString& path)
+{
+    clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    int size = 0;
+    float domainMin[3] = {0.0f, 0.0f, 0.0f};
+    float domainMax[3] = {1.0f, 1.0f, 1.0f};
+    std::vector<float> table;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        const QStringList parts = line.split(QRegularExpression("\\s+"));
+        const QString& keyword = parts.first();
+
+        if (keyword == "TITLE") {
+            continue;
+        } else if (keyword == "LUT_3D_SIZE" && parts.size() == 2) {
+            size = parts[1].toInt();
+            if (size < 2 || size > 256) {
+                qDebug() << "ColorLut: unsupported LUT_3D_SIZE" << size << "in" << path;
+                return false;
+            }
+            table.reserve(static_cast<size_t>(size) * size * size * 3);
+        } else if (keyword == "LUT_1D_SIZE") {
+            qDebug() << "ColorLut: 1D LUTs are not supported:" << path;
+            return false;
+        } else if ((keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") && parts.size() == 4) {
+            float* domain = keyword == "DOMAIN_MIN" ? domainMin : domainMax;
+            for (int c = 0; c < 3; ++c) {
+                domain[c] = parts[c + 1].toFloat();
+            }
+        } else if (parts.size() == 3) {
+            for (const QString& part : parts) {
+                bool ok = false;
+                const float value = part.toFloat(&ok);
+                if (!ok) {
+                    qDebug() << "ColorLut: bad line" << line << "in" << path;
+                    return false;
+                }
+                table.push_back(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+            }
+        }
+    }
+
+    if (size == 0 || table.size() != static_cast<size_t>(size) * size * size * 3) {
+        qDebug() << "ColorLut: expected" << size << "^3 entries in" << path << "got" << table.size() / 3;
+        return false;
+    }
+    for (int c = 0; c < 3; ++c) {
+        if (domainMax[c] <= domainMin[c]) {
+            qDebug() << "ColorLut: empty domain in" << path;
+            return false;
+        }
+    }
+
+    m_size = size;
+    m_table.swap(table);
+    buildIndexTables(domainMin, domainMax);
+
+    qDebug() << "ColorLut: loaded" << m_size << "^3 LUT from" << path;
+    return true;
+}
+
+// Input channels are RGB order here (c = 0 is red)
+void ColorLut::buildIndexTables(const float domainMin[3], const float domainMax[3])
+{
+    const int last = m_size - 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            float position = (v / 255.0f - domainMin[c]) / (domainMax[c] - domainMin[c]) * last;
+            position = std::min(std::max(position, 0.0f), static_cast<float>(last));
+            // Keep index + 1 inside the lattice; the top value sits at fraction 1
+            const int index = std::min(static_cast<int>(position), last - 1);
+            m_index[c][v] = index;
+            m_fraction[c][v] = position - index;
+        }
+    }
+}
+
+void ColorLut::applyRow(unsigned char* row, int pixels, bool rgb) const
+{
+    const float* table = m_table.data();
+    const int strideG = m_size * 3;
+    const int strideB = m_size * m_size * 3;
+    const int redAt = rgb ? 0 : 2, blueAt = 2 - redAt;
+    int i = 0;
+
+#if CV_SIMD128
+    // Four pixels at a time without branches: the largest fraction picks the first edge of the walk,
+    // the smallest the last, and the sorted fractions weigh the four corners. Lattice indices and
+    // fractions come from the per-byte tables as below; the corners are gathered with v_lut.
+    const cv::v_int32x4 stepR = cv::v_setall_s32(3), stepG = cv::v_setall_s32(strideG), stepB = cv::v_setall_s32(strideB);
+    const cv::v_int32x4 across = cv::v_setall_s32(3 + strideG + strideB);
+    const cv::v_float32x4 one = cv::v_setall_f32(1.0f), half = cv::v_setall_f32(0.5f);
+    int base[4], out[3][4];
+    float fractions[3][4];
+    for (; i <= pixels - 4; i += 4, row += 12) {
+        for (int k = 0; k < 4; ++k) {
+            const unsigned char* pixel = row + 3 * k;
+            const int b = pixel[blueAt], g = pixel[1], r = pixel[redAt];
+            base[k] = m_index[2][b] * strideB + m_index[1][g] * strideG + m_index[0][r] * 3;
+            fractions[0][k] = m_fraction[0][r];
+            fractions[1][k] = m_fraction[1][g];
+            fractions[2][k] = m_fraction[2][b];
+        }
+        const cv::v_float32x4 fr = cv::v_load(fractions[0]), fg = cv::v_load(fractions[1]), fb = cv::v_load(fractions[2]);
+
+        // Ties go to red, then green, for the first edge and to blue, then green, for the last,
+        // so the two never coincide; tied edges carry no weight either way
+        const cv::v_int32x4 redFirst = cv::v_reinterpret_as_s32((fr >= fg) & (fr >= fb));
+        const cv::v_int32x4 greenFirst = cv::v_reinterpret_as_s32(fg >= fb);
+        const cv::v_int32x4 blueLast = cv::v_reinterpret_as_s32((fb <= fg) & (fb <= fr));
+        const cv::v_int32x4 greenLast = cv::v_reinterpret_as_s32(fg <= fr);
+        const cv::v_int32x4 first = cv::v_select(redFirst, stepR, cv::v_select(greenFirst, stepG, stepB));
+        const cv::v_int32x4 last = cv::v_select(blueLast, stepB, cv::v_select(greenLast, stepG, stepR));
+
+        const cv::v_float32x4 w0 = cv::v_max(fr, cv::v_max(fg, fb));
+        const cv::v_float32x4 w2 = cv::v_min(fr, cv::v_min(fg, fb));
+        const cv::v_float32x4 w1 = fr + fg + fb - w0 - w2;
+        const cv::v_float32x4 k000 = one - w0, kFirst = w0 - w1, kSecond = w1 - w2;
+
+        const cv::v_int32x4 c000 = cv::v_load(base);
+        const cv::v_int32x4 c111 = c000 + across;
+        const cv::v_int32x4 cFirst = c000 + first, cSecond = c111 - last;
+        for (int c = 0; c < 3; ++c) {
+            const float* channel = table + c;
+            cv::v_float32x4 value = cv::v_lut(channel, c000) * k000;
+            value = cv::v_muladd(cv::v_lut(channel, cFirst), kFirst, value);
+            value = cv::v_muladd(cv::v_lut(channel, cSecond), kSecond, value);
+            value = cv::v_muladd(cv::v_lut(channel, c111), w2, value);
+            cv::v_store(out[c], cv::v_floor(value + half));
+        }
+
+        // Table holds RGB, the row may be either way round
+        for (int k = 0; k < 4; ++k) {
+            for (int c = 0; c < 3; ++c) {
+                row[3 * k + (rgb ? c : 2 - c)] = static_cast<unsigned char>(out[c][k]);
+            }
+        }
+    }
+#endif
+
+    for (; i < pixels; ++i, row += 3) {
+        const int b = row[blueAt], g = row[1], r = row[redAt];
+        const float fr = m_fraction[0][r], fg = m_fraction[1][g], fb = m_fraction[2][b];
+
+        const float* c000 = table + m_index[2][b] * strideB + m_index[1][g] * strideG + m_index[0][r] * 3;
+        const float* c111 = c000 + strideB + strideG + 3;
+
+        // Tetrahedral interpolation: walk from c000 to c111 along the edges ordered by fraction
+        const float* first;
+        const float* second;
+        float w0, w1, w2;
+        if (fr > fg) {
+            if (fg > fb) {
+                first = c000 + 3; second = c000 + 3 + strideG; w0 = fr; w1 = fg; w2 = fb;
+            } else if (fr > fb) {
+                first = c000 + 3; second = c000 + 3 + strideB; w0 = fr; w1 = fb; w2 = fg;
+            } else {
+                first = c000 + strideB; second = c000 + 3 + strideB; w0 = fb; w1 = fr; w2 = fg;
+            }
+        } else {
+            if (fb > fg) {
+                first = c000 + strideB; second = c000 + strideG + strideB; w0 = fb; w1 = fg; w2 = fr;
+            } else if (fb > fr) {
+                first = c000 + strideG; second = c000 + strideG + strideB; w0 = fg; w1 = fb; w2 = fr;
+            } else {
+                first = c000 + strideG; second = c000 + 3 + strideG; w0 = fg; w1 = fr; w2 = fb;
+            }
+        }
+
+        // Table holds RGB, the row may be either way round
+        for (int c = 0; c < 3; ++c) {
+            const float value = c000[c] + w0 * (first[c] - c000[c])
+                              + w1 * (second[c] - first[c]) + w2 * (c111[c] - second[c]);
+            row[rgb ? c : 2 - c] = static_cast<unsigned char>(value + 0.5f);
+        }
+    }
+}
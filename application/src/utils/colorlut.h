@@ -0,0 +1,40 @@
+// colorlut.h
+
+#ifndef COLORLUT_H
+#define COLORLUT_H
+
+#include <QString>
+#include <array>
+#include <vector>
+
+// A 3D colour lookup table loaded from an Adobe/Resolve .cube file, used to
+// correct a projector's colour rendition. Applied per row with tetrahedral
+// interpolation so it can sit inside the render pass.
+class ColorLut
+{
+public:
+    ColorLut();
+
+    bool isValid() const;
+    int size() const;
+    bool load(const QString& path);
+    void clear();
+
+    // Per-projector table: GPMS_PROJECTOR_LUT if set, else <AppData>/luts/<screen name>.cube
+    static QString pathForScreen(const QString& screenName);
+
+    // In-place on a row of BGR pixels (RGB when rgb is set)
+    void applyRow(unsigned char* row, int pixels, bool rgb = false) const;
+
+private:
+    int m_size;
+    std::vector<float> m_table; // RGB triplets, red varies fastest (file order), scaled to 0..255
+
+    // Per input channel value: lower lattice index and fraction towards the next one
+    std::array<std::array<int, 256>, 3> m_index;
+    std::array<std::array<float, 256>, 3> m_fraction;
+
+    void buildIndexTables(const float domainMin[3], const float domainMax[3]);
+};
+
+#endif // COLORLUT_H
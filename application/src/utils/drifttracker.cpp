@@ -0,0 +1,149 @@
+// drifttracker.cpp
+
+#include "drifttracker.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+#include <opencv2/calib3d.hpp>
+#include <algorithm>
+
+DriftTracker::DriftTracker(QObject* parent)
+    : QObject(parent)
+    , m_pendingReset(false)
+    , m_enabled(false)
+    , m_hasReference(false)
+    , m_consistentCount(0)
+{
+}
+
+void DriftTracker::setCorners(const std::array<cv::Point2f, 4>& corners)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pendingCorners = corners;
+    m_pendingReset = true;
+    m_enabled = true;
+}
+
+void DriftTracker::clearCorners()
+{
+    QMutexLocker locker(&m_mutex);
+    m_enabled = false;
+    m_pendingReset = false;
+}
+
+int DriftTracker::intervalMs() const
+{
+    return INTERVAL_MS;
+}
+
+// Pick trackable features near the corners of the current frame
+void DriftTracker::resetReference(const cv::Mat& gray)
+{
+    cv::Mat mask = cv::Mat::zeros(gray.size(), CV_8UC1);
+    for (const cv::Point2f& corner : m_corners) {
+        cv::circle(mask, corner * static_cast<float>(TRACK_SCALE), FEATURE_RADIUS, cv::Scalar(255), -1);
+    }
+
+    m_referencePoints.clear();
+    cv::goodFeaturesToTrack(gray, m_referencePoints, 100, 0.01, 5.0, mask);
+    m_referenceGray = gray.clone();
+    m_hasReference = true;
+    m_consistentCount = 0;
+
+    if (static_cast<int>(m_referencePoints.size()) < MIN_POINTS) {
+        qDebug() << "DriftTracker: only" << m_referencePoints.size() << "features near the corners";
+    }
+}
+
+void DriftTracker::analyzeFrame(const cv::Mat& frame, qint64 timestampMs)
+{
+    Q_UNUSED(timestampMs);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_enabled) {
+            m_hasReference = false;
+            return;
+        }
+        if (m_pendingReset) {
+            m_corners = m_pendingCorners;
+            m_pendingReset = false;
+            m_hasReference = false;
+        }
+    }
+
+    cv::Mat gray;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    cv::resize(gray, gray, cv::Size(), TRACK_SCALE, TRACK_SCALE, cv::INTER_AREA);
+
+    if (!m_hasReference) {
+        resetReference(gray);
+        return;
+    }
+    if (static_cast<int>(m_referencePoints.size()) < MIN_POINTS) {
+        return;
+    }
+
+    // Track from the reference, not frame to frame, so small errors don't accumulate
+    std::vector<cv::Point2f> points;
+    std::vector<uchar> status;
+    std::vector<float> error;
+    cv::calcOpticalFlowPyrLK(m_referenceGray, gray, m_referencePoints, points, status, error,
+                             cv::Size(21, 21), 3);
+
+    std::vector<cv::Point2f> from, to;
+    for (size_t i = 0; i < status.size(); ++i) {
+        if (status[i]) {
+            from.push_back(m_referencePoints[i]);
+            to.push_back(points[i]);
+        }
+    }
+    if (static_cast<int>(from.size()) < MIN_POINTS) {
+        return;
+    }
+
+    // Rigid-ish motion of the whole rig: rotation, translation, uniform scale
+    const cv::Mat motion = cv::estimateAffinePartial2D(from, to, cv::noArray(), cv::RANSAC, 1.0);
+    if (motion.empty()) {
+        return;
+    }
+
+    std::array<cv::Point2f, 4> estimate;
+    float largestMove = 0.0f;
+    float largestChange = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        const cv::Point2f p = m_corners[i] * static_cast<float>(TRACK_SCALE);
+        const double x = motion.at<double>(0, 0) * p.x + motion.at<double>(0, 1) * p.y + motion.at<double>(0, 2);
+        const double y = motion.at<double>(1, 0) * p.x + motion.at<double>(1, 1) * p.y + motion.at<double>(1, 2);
+        estimate[i] = cv::Point2f(static_cast<float>(x / TRACK_SCALE), static_cast<float>(y / TRACK_SCALE));
+
+        largestMove = std::max(largestMove, static_cast<float>(cv::norm(estimate[i] - m_corners[i])));
+        largestChange = std::max(largestChange, static_cast<float>(cv::norm(estimate[i] - m_candidate[i])));
+    }
+
+    if (largestMove < MOVE_THRESHOLD) {
+        m_consistentCount = 0;
+        return;
+    }
+
+    // Only act once the same displacement shows up in consecutive samples (rig settled, not someone walking past)
+    m_consistentCount = (m_consistentCount > 0 && largestChange < CONSISTENCY_TOLERANCE) ? m_consistentCount + 1 : 1;
+    m_candidate = estimate;
+    if (m_consistentCount < CONSISTENT_SAMPLES) {
+        return;
+    }
+
+    m_corners = estimate;
+    qDebug() << "DriftTracker: rig moved by" << largestMove << "px, updating corners";
+
+    QPolygonF polygon;
+    for (const cv::Point2f& corner : m_corners) {
+        polygon << QPointF(corner.x, corner.y);
+    }
+    emit cornersDrifted(polygon);
+
+    // Future motion is measured against the new pose
+    resetReference(gray);
+}
@@ -0,0 +1,60 @@
+// drifttracker.h
+
+#ifndef DRIFTTRACKER_H
+#define DRIFTTRACKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QPolygonF>
+#include <array>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "utils/livefeed.h"
+
+// Follows features around the four calibrated corners in the live feed with
+// pyramidal Lucas-Kanade. When the rig gets bumped and the motion is
+// consistent over a few samples, it emits updated corners.
+class DriftTracker : public QObject, public FrameAnalyzer
+{
+    Q_OBJECT
+
+public:
+    explicit DriftTracker(QObject* parent = nullptr);
+
+    // GUI thread: corners to keep locked; the next live frame becomes the reference
+    void setCorners(const std::array<cv::Point2f, 4>& corners);
+    void clearCorners();
+
+    // FrameAnalyzer, feed thread
+    int intervalMs() const override;
+    void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) override;
+
+signals:
+    void cornersDrifted(const QPolygonF& corners);
+
+private:
+    static constexpr int INTERVAL_MS = 250;          // a few Hz is plenty to catch a bump
+    static constexpr double TRACK_SCALE = 0.5;       // tracking runs on a downscaled frame
+    static constexpr int FEATURE_RADIUS = 40;        // px (downscaled) around each corner
+    static constexpr int MIN_POINTS = 8;
+    static constexpr float MOVE_THRESHOLD = 2.0f;    // px (full res) before a correction is considered
+    static constexpr float CONSISTENCY_TOLERANCE = 1.5f;
+    static constexpr int CONSISTENT_SAMPLES = 2;
+
+    QMutex m_mutex;
+    bool m_pendingReset;
+    bool m_enabled;
+    std::array<cv::Point2f, 4> m_pendingCorners;
+
+    // Feed thread only
+    bool m_hasReference;
+    cv::Mat m_referenceGray;
+    std::vector<cv::Point2f> m_referencePoints;
+    std::array<cv::Point2f, 4> m_corners;   // corners currently applied, full res
+    std::array<cv::Point2f, 4> m_candidate; // last estimate waiting for confirmation
+    int m_consistentCount;
+
+    void resetReference(const cv::Mat& gray);
+};
+
+#endif // DRIFTTRACKER_H
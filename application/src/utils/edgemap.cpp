@@ -0,0 +1,41 @@
+// edgemap.cpp
+
+#include "edgemap.h"
+
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+
+namespace EdgeMap {
+
+cv::Size generationSize(const cv::Size& regionSize)
+{
+    if (regionSize.empty()) {
+        return cv::Size();
+    }
+    const double ratio = std::sqrt(static_cast<double>(TARGET_PIXELS) / regionSize.area());
+    return cv::Size(static_cast<int>(regionSize.width * ratio), static_cast<int>(regionSize.height * ratio));
+}
+
+cv::Mat compute(const cv::Mat& image, int loThreshold, int hiThreshold)
+{
+    if (image.empty()) {
+        return cv::Mat();
+    }
+
+    cv::Mat gray;
+    cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+
+    // Grey first, so only one channel is resampled
+    const cv::Size size = generationSize(image.size());
+    if (size != gray.size()) {
+        const int interpolation = size.area() < gray.size().area() ? cv::INTER_AREA : cv::INTER_LINEAR;
+        cv::resize(gray, gray, size, 0.0, 0.0, interpolation);
+    }
+
+    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 0.0);
+    cv::Mat edges;
+    cv::Canny(gray, edges, loThreshold, hiThreshold);
+    return edges;
+}
+
+}  // namespace EdgeMap
@@ -0,0 +1,24 @@
+// edgemap.h
+
+#ifndef EDGEMAP_H
+#define EDGEMAP_H
+
+#include <opencv2/core.hpp>
+
+// The edge map generation is conditioned on, computed the way the server used
+// to: scaled to about one megapixel, blurred and traced with Canny. The
+// projection window previews exactly this map and, in edges upload mode, it is
+// what gets uploaded, so the thresholds the user tunes are the ones used.
+namespace EdgeMap {
+
+constexpr int TARGET_PIXELS = 1024 * 1024;
+
+// Generation resolution for a region of this size (same rounding as the server)
+cv::Size generationSize(const cv::Size& regionSize);
+
+// CV_8UC1, 0 or 255, at generationSize(image.size())
+cv::Mat compute(const cv::Mat& image, int loThreshold, int hiThreshold);
+
+}  // namespace EdgeMap
+
+#endif // EDGEMAP_H
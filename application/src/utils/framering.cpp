@@ -0,0 +1,117 @@
+// framering.cpp
+
+#include "framering.h"
+
+#include <opencv2/imgproc.hpp>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+FrameRing::FrameRing(int capacity)
+    : m_frames(std::max(capacity, 1))
+    , m_next(0)
+    , m_count(0)
+{
+}
+
+void FrameRing::push(const cv::Mat& frame)
+{
+    if (frame.empty()) {
+        return;
+    }
+
+    // copyTo keeps the slot's buffer when size and type match
+    frame.copyTo(m_frames[m_next]);
+    m_next = (m_next + 1) % static_cast<int>(m_frames.size());
+    m_count = std::min(m_count + 1, static_cast<int>(m_frames.size()));
+}
+
+void FrameRing::clear()
+{
+    m_next = 0;
+    m_count = 0;
+}
+
+int FrameRing::size() const
+{
+    return m_count;
+}
+
+// Variance of the Laplacian, higher is sharper
+double FrameRing::sharpness(const cv::Mat& gray)
+{
+    cv::Mat laplacian;
+    cv::Laplacian(gray, laplacian, CV_32F);
+
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(laplacian, mean, stddev);
+    return stddev[0] * stddev[0];
+}
+
+cv::Mat FrameRing::bestStill(int averageCount) const
+{
+    if (m_count == 0) {
+        qDebug() << "Frame ring is empty, no still to pick.";
+        return cv::Mat();
+    }
+
+    // Rank every frame on a small grey copy
+    std::vector<cv::Mat> grays(m_count);
+    std::vector<std::pair<double, int>> ranked;
+    ranked.reserve(m_count);
+
+    for (int i = 0; i < m_count; ++i) {
+        cv::Mat gray;
+        cv::cvtColor(m_frames[i], gray, cv::COLOR_BGR2GRAY);
+        cv::resize(gray, gray, cv::Size(), RANK_SCALE, RANK_SCALE, cv::INTER_AREA);
+        gray.convertTo(grays[i], CV_32F);
+        ranked.emplace_back(sharpness(grays[i]), i);
+    }
+    std::sort(ranked.begin(), ranked.end(), std::greater<std::pair<double, int>>());
+
+    const int best = ranked.front().second;
+    averageCount = std::min(std::max(averageCount, 1), m_count);
+    if (averageCount == 1) {
+        return m_frames[best].clone();
+    }
+
+    // Accumulate the best frames in float; cv::accumulate is vectorised
+    cv::Mat accumulator = cv::Mat::zeros(m_frames[best].size(), CV_32FC3);
+    cv::accumulate(m_frames[best], accumulator);
+    int used = 1;
+
+    cv::Mat window;
+    cv::createHanningWindow(window, grays[best].size(), CV_32F);
+
+    cv::Mat aligned;
+    for (int r = 1; r < m_count && used < averageCount; ++r) {
+        const int candidate = ranked[r].second;
+
+        // Estimate the (sub-pixel) shift of this frame relative to the sharpest one
+        double response = 0.0;
+        const cv::Point2d shift = cv::phaseCorrelate(grays[best], grays[candidate], window, &response);
+        if (response < MIN_ALIGN_RESPONSE) {
+            qDebug() << "Skipping frame" << candidate << "for averaging, alignment response" << response;
+            continue;
+        }
+
+        const double dx = shift.x / RANK_SCALE;
+        const double dy = shift.y / RANK_SCALE;
+        if (std::abs(dx) < 0.5 && std::abs(dy) < 0.5) {
+            cv::accumulate(m_frames[candidate], accumulator);
+        } else {
+            const cv::Matx23d translation(1.0, 0.0, -dx,
+                                          0.0, 1.0, -dy);
+            cv::warpAffine(m_frames[candidate], aligned, translation, m_frames[candidate].size(),
+                           cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+            cv::accumulate(aligned, accumulator);
+        }
+        ++used;
+    }
+
+    cv::Mat still;
+    accumulator.convertTo(still, CV_8UC3, 1.0 / used);
+    qDebug() << "Still built from" << used << "frame(s), sharpness" << ranked.front().first;
+    return still;
+}
@@ -0,0 +1,35 @@
+// framering.h
+
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Fixed-size ring of the most recent camera frames, used to pick a clean still
+// without spending extra capture time: the ring is already full when it's needed.
+class FrameRing
+{
+public:
+    explicit FrameRing(int capacity = 8);
+
+    void push(const cv::Mat& frame);
+    void clear();
+    int size() const;
+
+    // Sharpest frame in the ring; with averageCount > 1 the next sharpest frames are
+    // aligned to it and averaged in to suppress sensor noise.
+    cv::Mat bestStill(int averageCount = 1) const;
+
+private:
+    static constexpr double RANK_SCALE = 0.5;        // ranking/alignment runs on a downscaled copy
+    static constexpr double MIN_ALIGN_RESPONSE = 0.3; // phase correlation peak below this means the scene changed
+
+    std::vector<cv::Mat> m_frames; // slots are reused in place to avoid reallocating every frame
+    int m_next;
+    int m_count;
+
+    static double sharpness(const cv::Mat& gray);
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,115 @@
+// interactiontracker.cpp
+
+#include "interactiontracker.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <opencv2/imgproc.hpp>
+
+InteractionTracker::InteractionTracker(QObject* parent)
+    : QObject(parent)
+    , m_enabled(false)
+    , m_pendingReset(false)
+    , m_framesLearnt(0)
+    , m_analysisMsSum(0.0)
+    , m_analysisFrames(0)
+{
+}
+
+void InteractionTracker::setEnabled(bool enabled, const cv::Rect& region)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pendingRegion = region;
+    m_pendingReset = enabled;
+    m_enabled = enabled;
+}
+
+bool InteractionTracker::isEnabled() const
+{
+    return m_enabled;
+}
+
+int InteractionTracker::intervalMs() const
+{
+    return INTERVAL_MS;
+}
+
+bool InteractionTracker::wantsFrame() const
+{
+    return m_enabled;
+}
+
+void InteractionTracker::resetBackground(const cv::Rect& region, const cv::Size& frameSize)
+{
+    const cv::Rect frame(cv::Point(0, 0), frameSize);
+    const cv::Rect watched = region.empty() ? frame : (region & frame);
+    m_region = cv::Rect(cvFloor(watched.x * TRACK_SCALE), cvFloor(watched.y * TRACK_SCALE),
+                        cvCeil(watched.width * TRACK_SCALE), cvCeil(watched.height * TRACK_SCALE))
+               & cv::Rect(0, 0, cvCeil(frameSize.width * TRACK_SCALE), cvCeil(frameSize.height * TRACK_SCALE));
+
+    m_subtractor = cv::createBackgroundSubtractorMOG2(HISTORY_FRAMES, VAR_THRESHOLD, true);
+    m_framesLearnt = 0;
+}
+
+void InteractionTracker::analyzeFrame(const cv::Mat& frame, qint64 timestampMs)
+{
+    Q_UNUSED(timestampMs);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pendingReset) {
+            resetBackground(m_pendingRegion, frame.size());
+            m_pendingReset = false;
+        }
+    }
+    if (!m_subtractor || m_region.empty()) {
+        return;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    cv::resize(frame, m_small, cv::Size(), TRACK_SCALE, TRACK_SCALE, cv::INTER_AREA);
+    const cv::Mat watched = m_small(m_region & cv::Rect(cv::Point(0, 0), m_small.size()));
+
+    // Shadows come back as 127 and are dropped; people's shadows on the surface shouldn't trigger effects
+    m_subtractor->apply(watched, m_foreground);
+    cv::threshold(m_foreground, m_foreground, 200, 255, cv::THRESH_BINARY);
+    if (++m_framesLearnt < WARMUP_FRAMES) {
+        return;
+    }
+
+    if (cv::countNonZero(m_foreground) > MAX_FOREGROUND * m_foreground.total()) {
+        // New content or a flat frame on the surface, not a person
+        m_subtractor->apply(watched, m_foreground, 1.0);
+        m_framesLearnt = 0;
+        return;
+    }
+
+    static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
+    cv::morphologyEx(m_foreground, m_foreground, cv::MORPH_OPEN, kernel);
+    cv::dilate(m_foreground, m_foreground, kernel, cv::Point(-1, -1), 2); // rejoin fingers
+
+    const int count = cv::connectedComponentsWithStats(m_foreground, m_labels, m_stats, m_centroids, 8, CV_32S);
+    QPolygonF contacts;
+    for (int label = 1; label < count; ++label) {
+        if (m_stats.at<int>(label, cv::CC_STAT_AREA) < MIN_BLOB_AREA) {
+            continue;
+        }
+        const double x = (m_centroids.at<double>(label, 0) + m_region.x + 0.5) / TRACK_SCALE;
+        const double y = (m_centroids.at<double>(label, 1) + m_region.y + 0.5) / TRACK_SCALE;
+        contacts << QPointF(x, y);
+    }
+
+    m_analysisMsSum += clock.nsecsElapsed() / 1000000.0;
+    if (++m_analysisFrames == LOG_FRAMES) {
+        qDebug() << "InteractionTracker:" << m_analysisMsSum / m_analysisFrames << "ms per frame";
+        m_analysisMsSum = 0.0;
+        m_analysisFrames = 0;
+    }
+
+    if (!contacts.isEmpty()) {
+        emit contactsDetected(contacts);
+    }
+}
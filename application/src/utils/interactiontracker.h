@@ -0,0 +1,65 @@
+// interactiontracker.h
+
+#ifndef INTERACTIONTRACKER_H
+#define INTERACTIONTRACKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QPolygonF>
+#include <atomic>
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+#include "utils/livefeed.h"
+
+// Finds hands and bodies in front of the projection surface: MOG2 background
+// subtraction on a downscaled live frame, cleaned up and split into blobs.
+// The centre of every blob large enough to be a hand is reported in
+// still-frame coordinates, which the projection window maps into each output
+// through its calibration homography.
+class InteractionTracker : public QObject, public FrameAnalyzer
+{
+    Q_OBJECT
+
+public:
+    explicit InteractionTracker(QObject* parent = nullptr);
+
+    // GUI thread: region of the still frame to watch; the background is relearnt
+    void setEnabled(bool enabled, const cv::Rect& region = cv::Rect());
+    bool isEnabled() const;
+
+    // FrameAnalyzer, feed thread
+    int intervalMs() const override;
+    bool wantsFrame() const override;
+    void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) override;
+
+signals:
+    void contactsDetected(const QPolygonF& points); // still-frame coordinates
+
+private:
+    static constexpr int INTERVAL_MS = 33;            // 30 Hz, so effects follow a hand without visible lag
+    static constexpr double TRACK_SCALE = 0.25;       // 1280x720 -> 320x180
+    static constexpr int HISTORY_FRAMES = 150;        // ~5 s for someone standing still to fade into the background
+    static constexpr double VAR_THRESHOLD = 25.0;
+    static constexpr int WARMUP_FRAMES = 15;          // learn before reporting anything
+    static constexpr int MIN_BLOB_AREA = 40;          // px (downscaled), about a hand at 2 m
+    static constexpr double MAX_FOREGROUND = 0.5;     // more than this changed at once: the projection changed, relearn
+    static constexpr int LOG_FRAMES = 300;
+
+    std::atomic<bool> m_enabled;
+
+    QMutex m_mutex;
+    bool m_pendingReset;
+    cv::Rect m_pendingRegion;
+
+    // Feed thread only
+    cv::Ptr<cv::BackgroundSubtractorMOG2> m_subtractor;
+    cv::Rect m_region; // downscaled
+    cv::Mat m_small, m_foreground, m_labels, m_stats, m_centroids;
+    int m_framesLearnt;
+    double m_analysisMsSum;
+    int m_analysisFrames;
+
+    void resetBackground(const cv::Rect& region, const cv::Size& frameSize);
+};
+
+#endif // INTERACTIONTRACKER_H
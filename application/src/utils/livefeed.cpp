@@ -0,0 +1,157 @@
+// livefeed.cpp
+
+#include "livefeed.h"
+
+#include <QDebug>
+#include <QProcessEnvironment>
+#include <algorithm>
+#include <climits>
+
+LiveFeed::LiveFeed(QObject* parent)
+    : QObject(parent)
+    , m_context(new QObject)
+    , m_timer(nullptr)
+    , m_running(false)
+{
+    m_context->moveToThread(&m_thread);
+    m_thread.setObjectName("LiveFeed");
+    m_thread.start(QThread::LowPriority);
+}
+
+LiveFeed::~LiveFeed()
+{
+    stop();
+    m_thread.quit();
+    m_thread.wait();
+    delete m_context; // the thread is gone, safe to delete from here
+}
+
+void LiveFeed::addAnalyzer(FrameAnalyzer* analyzer)
+{
+    QMetaObject::invokeMethod(m_context, [this, analyzer]() {
+        m_analyzers.push_back({analyzer, 0});
+    }, Qt::BlockingQueuedConnection);
+}
+
+void LiveFeed::setCameraModel(const CameraModel& cameraModel)
+{
+    QMetaObject::invokeMethod(m_context, [this, cameraModel]() {
+        m_cameraModel = cameraModel;
+    }, Qt::QueuedConnection);
+}
+
+void LiveFeed::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    QMetaObject::invokeMethod(m_context, [this]() { openSource(); }, Qt::QueuedConnection);
+}
+
+void LiveFeed::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    QMetaObject::invokeMethod(m_context, [this]() { closeSource(); }, Qt::BlockingQueuedConnection);
+}
+
+bool LiveFeed::isRunning() const
+{
+    return m_running;
+}
+
+// Worker thread
+void LiveFeed::openSource()
+{
+    const QString source = QProcessEnvironment::systemEnvironment().value("GPMS_FEED_SOURCE", "0");
+    bool isIndex = false;
+    const int index = source.toInt(&isIndex);
+
+    if (isIndex) {
+        m_capture.open(index);
+    } else {
+        m_capture.open(source.toStdString());
+    }
+
+    if (!m_capture.isOpened()) {
+        qDebug() << "LiveFeed: could not open source" << source;
+        return;
+    }
+
+    if (isIndex) {
+        m_capture.set(cv::CAP_PROP_FRAME_WIDTH, WIDTH);
+        m_capture.set(cv::CAP_PROP_FRAME_HEIGHT, HEIGHT);
+        m_capture.set(cv::CAP_PROP_BUFFERSIZE, 1); // we sample slowly, don't read stale frames
+    }
+
+    const int interval = grabInterval();
+    if (!m_timer) {
+        m_timer = new QTimer(m_context);
+        QObject::connect(m_timer, &QTimer::timeout, m_context, [this]() { grabFrame(); });
+    }
+    m_clock.start();
+    m_timer->start(interval);
+    qDebug() << "LiveFeed started on" << source << "every" << interval << "ms";
+}
+
+void LiveFeed::closeSource()
+{
+    if (m_timer) {
+        m_timer->stop();
+    }
+    if (m_capture.isOpened()) {
+        m_capture.release();
+    }
+    qDebug() << "LiveFeed stopped";
+}
+
+void LiveFeed::grabFrame()
+{
+    if (!m_capture.read(m_frame) || m_frame.empty()) {
+        qDebug() << "LiveFeed: could not read frame";
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    bool undistorted = false;
+
+    for (Analyzer& entry : m_analyzers) {
+        if (now - entry.lastRunMs < entry.analyzer->intervalMs() || !entry.analyzer->wantsFrame()) {
+            continue;
+        }
+
+        // Undistort lazily, only on ticks where someone actually looks at the frame
+        if (!undistorted) {
+            if (m_cameraModel.isValid()) {
+                m_cameraModel.undistort(m_frame, m_undistorted);
+            } else {
+                m_undistorted = m_frame;
+            }
+            undistorted = true;
+        }
+
+        entry.lastRunMs = now;
+        entry.analyzer->analyzeFrame(m_undistorted, now);
+    }
+
+    // Follow analyzers switching on and off, so a fast one only costs while it is in use
+    const int interval = grabInterval();
+    if (interval != m_timer->interval()) {
+        m_timer->setInterval(interval);
+    }
+}
+
+// The fastest rate any analyzer that currently wants frames asks for
+int LiveFeed::grabInterval() const
+{
+    int interval = INT_MAX;
+    for (const Analyzer& entry : m_analyzers) {
+        if (entry.analyzer->wantsFrame()) {
+            interval = std::min(interval, entry.analyzer->intervalMs());
+        }
+    }
+    return interval == INT_MAX ? IDLE_INTERVAL_MS : interval;
+}
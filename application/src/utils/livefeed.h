@@ -0,0 +1,76 @@
+// livefeed.h
+
+#ifndef LIVEFEED_H
+#define LIVEFEED_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <opencv2/videoio.hpp>
+#include <vector>
+#include "utils/cameramodel.h"
+
+// Work done on live camera frames, called on the feed's worker thread.
+class FrameAnalyzer
+{
+public:
+    virtual ~FrameAnalyzer() = default;
+
+    // How often this analyzer wants a frame; the feed grabs at the fastest rate requested
+    // by the analyzers that currently want frames
+    virtual int intervalMs() const = 0;
+
+    // Analyzers that are idle most of the time can opt out of a tick
+    virtual bool wantsFrame() const { return true; }
+
+    // frame is only valid for the duration of the call; copy whatever needs to be kept
+    virtual void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) = 0;
+};
+
+// Owns the camera while the pages don't need it (after calibration) and hands
+// undistorted frames to the registered analyzers on a background thread, so
+// tracking never competes with the GUI thread that renders the projection.
+// Set GPMS_FEED_SOURCE to a video file (or camera index) to replay recorded footage.
+class LiveFeed : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LiveFeed(QObject* parent = nullptr);
+    ~LiveFeed();
+
+    // Register before start(); analyzers must outlive the feed
+    void addAnalyzer(FrameAnalyzer* analyzer);
+    void setCameraModel(const CameraModel& cameraModel);
+
+    void start();
+    void stop(); // blocks until the camera is released, so a page can reopen it right after
+    bool isRunning() const;
+
+private:
+    static constexpr int WIDTH = 1280, HEIGHT = 720;
+    static constexpr int IDLE_INTERVAL_MS = 250; // nobody is looking, just keep the camera warm
+
+    struct Analyzer {
+        FrameAnalyzer* analyzer;
+        qint64 lastRunMs;
+    };
+
+    QThread m_thread;
+    QObject* m_context; // lives on m_thread; everything below is only touched from there
+    QTimer* m_timer;
+    cv::VideoCapture m_capture;
+    cv::Mat m_frame, m_undistorted;
+    CameraModel m_cameraModel;
+    std::vector<Analyzer> m_analyzers;
+    QElapsedTimer m_clock;
+    bool m_running;
+
+    void openSource();
+    void closeSource();
+    void grabFrame();
+    int grabInterval() const;
+};
+
+#endif // LIVEFEED_H
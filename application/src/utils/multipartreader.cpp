@@ -0,0 +1,102 @@
+// multipartreader.cpp
+
+#include "multipartreader.h"
+
+MultipartReader::MultipartReader(const QByteArray& boundary)
+    : m_delimiter(boundary.isEmpty() ? QByteArray() : "--" + boundary)
+    , m_started(false)
+    , m_finished(false)
+{
+}
+
+QByteArray MultipartReader::boundaryOf(const QByteArray& contentType)
+{
+    for (const QByteArray& parameter : contentType.split(';')) {
+        const QByteArray trimmed = parameter.trimmed();
+        if (trimmed.toLower().startsWith("boundary=")) {
+            QByteArray boundary = trimmed.mid(9);
+            if (boundary.size() >= 2 && boundary.startsWith('"') && boundary.endsWith('"')) {
+                boundary = boundary.mid(1, boundary.size() - 2);
+            }
+            return boundary;
+        }
+    }
+    return QByteArray();
+}
+
+bool MultipartReader::isValid() const
+{
+    return !m_delimiter.isEmpty();
+}
+
+bool MultipartReader::isFinished() const
+{
+    return m_finished;
+}
+
+QList<MultipartReader::Part> MultipartReader::feed(const QByteArray& data)
+{
+    QList<Part> parts;
+    if (!isValid() || m_finished) {
+        return parts;
+    }
+    m_buffer.append(data);
+
+    // Anything before the first delimiter is preamble
+    if (!m_started) {
+        const int first = m_buffer.indexOf(m_delimiter);
+        if (first < 0) {
+            return parts;
+        }
+        m_buffer.remove(0, first + m_delimiter.size());
+        m_started = true;
+    }
+
+    // The buffer always starts just after a delimiter: "--" closes, anything else opens a part
+    const QByteArray next = "\r\n" + m_delimiter;
+    while (m_buffer.size() >= 2) {
+        if (m_buffer.startsWith("--")) {
+            m_finished = true;
+            m_buffer.clear();
+            break;
+        }
+
+        const int end = m_buffer.indexOf(next);
+        if (end < 0) {
+            break; // rest of the part still on its way
+        }
+        parts.append(parsePart(m_buffer.left(end)));
+        m_buffer.remove(0, end + next.size());
+    }
+    return parts;
+}
+
+// A part as it follows its delimiter: the rest of the delimiter line, headers, a blank line, the body
+MultipartReader::Part MultipartReader::parsePart(const QByteArray& chunk)
+{
+    Part part;
+    const int lineEnd = chunk.indexOf("\r\n");
+    if (lineEnd < 0) {
+        return part;
+    }
+
+    QByteArray headers;
+    int bodyStart = lineEnd + 4;
+    if (chunk.mid(lineEnd, 4) != "\r\n\r\n") {
+        const int headersEnd = chunk.indexOf("\r\n\r\n", lineEnd + 2);
+        if (headersEnd < 0) {
+            return part;
+        }
+        headers = chunk.mid(lineEnd + 2, headersEnd - lineEnd - 2);
+        bodyStart = headersEnd + 4;
+    }
+
+    for (const QByteArray& line : headers.split('\n')) {
+        const int colon = line.indexOf(':');
+        if (colon > 0) {
+            part.headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+        }
+    }
+    part.body = chunk.mid(bodyStart);
+    return part;
+}
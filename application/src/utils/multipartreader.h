@@ -0,0 +1,39 @@
+// multipartreader.h
+
+#ifndef MULTIPARTREADER_H
+#define MULTIPARTREADER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+
+// Splits a multipart/mixed response into its parts as the bytes arrive, so a
+// batch of generated images can be shown one by one instead of all at the end.
+class MultipartReader
+{
+public:
+    struct Part {
+        QMap<QByteArray, QByteArray> headers; // names lower-cased
+        QByteArray body;
+    };
+
+    explicit MultipartReader(const QByteArray& boundary = QByteArray());
+
+    // The boundary parameter of a multipart Content-Type header, empty if it has none
+    static QByteArray boundaryOf(const QByteArray& contentType);
+
+    bool isValid() const;
+    bool isFinished() const; // the closing delimiter has been seen
+
+    QList<Part> feed(const QByteArray& data); // parts completed by this data, in order
+
+private:
+    QByteArray m_delimiter; // "--" + boundary
+    QByteArray m_buffer;
+    bool m_started;
+    bool m_finished;
+
+    static Part parsePart(const QByteArray& chunk);
+};
+
+#endif // MULTIPARTREADER_H
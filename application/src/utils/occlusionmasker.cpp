@@ -0,0 +1,347 @@
+// occlusionmasker.cpp
+
+#include "occlusionmasker.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QTimer>
+#include <opencv2/imgproc.hpp>
+
+OcclusionMasker::OcclusionMasker(QObject* parent)
+    : QObject(parent)
+    , m_phase(IDLE)
+    , m_generation(0)
+    , m_updatePending(false)
+    , m_running(false)
+    , m_feedGeneration(0)
+    , m_darkFrames(0)
+    , m_framesLearnt(0)
+{
+    m_clock.start();
+}
+
+void OcclusionMasker::begin()
+{
+    if (m_running) {
+        return;
+    }
+
+    m_running = true;
+    const int generation = ++m_generation;
+    m_phase = SETTLING;
+    emit darkRequested();
+
+    QTimer::singleShot(SETTLE_MS, this, [this, generation]() {
+        int expected = SETTLING;
+        if (m_running && m_generation == generation) {
+            m_phase.compare_exchange_strong(expected, MEASURING_DARK);
+        }
+    });
+}
+
+void OcclusionMasker::stop()
+{
+    m_running = false;
+    m_phase = IDLE;
+
+    QMutexLocker locker(&m_mutex);
+    m_published.release();
+    m_updatePending = false;
+}
+
+bool OcclusionMasker::isRunning() const
+{
+    return m_running;
+}
+
+bool OcclusionMasker::isMeasuring() const
+{
+    return m_running && m_phase != TRACKING;
+}
+
+bool OcclusionMasker::wantsExpectedFrames() const
+{
+    return m_running && m_phase == TRACKING;
+}
+
+void OcclusionMasker::addExpectedFrame(const cv::Mat& expected)
+{
+    if (!wantsExpectedFrames() || expected.empty() || expected.type() != CV_8UC1) {
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    QMutexLocker locker(&m_mutex);
+    m_expected.push_back({now, expected});
+    // The newest frame older than the latency window stays: it is still up when the window opens
+    while (m_expected.size() > 1 && now - m_expected[1].timestampMs > MAX_LATENCY_MS) {
+        m_expected.pop_front();
+    }
+}
+
+cv::Mat OcclusionMasker::mask()
+{
+    QMutexLocker locker(&m_mutex);
+    m_updatePending = false;
+    return m_published; // a fresh Mat every frame, so sharing it is safe
+}
+
+int OcclusionMasker::intervalMs() const
+{
+    return INTERVAL_MS;
+}
+
+bool OcclusionMasker::wantsFrame() const
+{
+    const int phase = m_phase;
+    return phase == MEASURING_DARK || phase == TRACKING;
+}
+
+void OcclusionMasker::analyzeFrame(const cv::Mat& frame, qint64 timestampMs)
+{
+    Q_UNUSED(timestampMs);
+
+    const int generation = m_generation;
+    if (generation != m_feedGeneration) {
+        m_feedGeneration = generation;
+        m_darkFrames = 0;
+        m_accumulator.release();
+        m_subtractor.reset();
+        m_hold.release();
+        m_history.clear();
+        m_framesLearnt = 0;
+        m_gain.release();
+    }
+
+    cv::resize(frame, m_small, cv::Size(), TRACK_SCALE, TRACK_SCALE, cv::INTER_AREA);
+    cv::cvtColor(m_small, m_gray, cv::COLOR_BGR2GRAY);
+    cv::GaussianBlur(m_gray, m_gray, cv::Size(5, 5), 0.0);
+
+    switch (m_phase) {
+    case MEASURING_DARK:
+        measureDark();
+        break;
+    case TRACKING:
+        track();
+        break;
+    default:
+        break;
+    }
+}
+
+// Average a few frames of the surface with the projector showing black
+void OcclusionMasker::measureDark()
+{
+    if (m_accumulator.size() != m_gray.size()) {
+        m_accumulator = cv::Mat::zeros(m_gray.size(), CV_32FC1);
+    }
+    cv::accumulate(m_gray, m_accumulator);
+    if (++m_darkFrames < DARK_FRAMES) {
+        return;
+    }
+
+    m_accumulator.convertTo(m_darkReference, CV_8UC1, 1.0 / DARK_FRAMES);
+    int expected = MEASURING_DARK;
+    if (m_phase.compare_exchange_strong(expected, RESTORING)) {
+        QMetaObject::invokeMethod(this, [this]() { onDarkMeasured(); }, Qt::QueuedConnection);
+    }
+}
+
+void OcclusionMasker::onDarkMeasured()
+{
+    if (!m_running) {
+        return;
+    }
+    emit ready();
+
+    // The lit scene has to be back on the surface before the background model sees it
+    const int generation = m_generation;
+    QTimer::singleShot(SETTLE_MS, this, [this, generation]() {
+        int expected = RESTORING;
+        if (m_running && m_generation == generation) {
+            m_phase.compare_exchange_strong(expected, TRACKING);
+        }
+    });
+    qDebug() << "OcclusionMasker: ambient reference taken, masking";
+}
+
+void OcclusionMasker::track()
+{
+    if (!m_subtractor) {
+        m_subtractor = cv::createBackgroundSubtractorMOG2(HISTORY_FRAMES, VAR_THRESHOLD, true);
+        m_hold = cv::Mat::zeros(m_gray.size(), CV_8UC1);
+        m_history.clear();
+        m_framesLearnt = 0;
+    }
+
+    // Animated projection: the model keeps what it learnt of the still picture until it is back
+    const bool detected = expectedRange(m_clock.elapsed()) ? detectAgainstExpected() : detectWithModel();
+    if (!detected) {
+        return;
+    }
+
+    static const cv::Mat open = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3));
+    static const cv::Mat close = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(7, 7));
+    cv::morphologyEx(m_foreground, m_foreground, cv::MORPH_OPEN, open);
+    cv::morphologyEx(m_foreground, m_foreground, cv::MORPH_CLOSE, close); // fill in bodies
+
+    // Seen now: hold for a while so a still, unlit person doesn't blink back into the light
+    cv::subtract(m_hold, cv::Scalar(1), m_hold);
+    m_hold.setTo(cv::Scalar(HOLD_FRAMES), m_foreground);
+
+    cv::Mat mask;
+    cv::compare(m_hold, cv::Scalar(0), mask, cv::CMP_GT);
+    m_history.push_back(mask);
+    if (static_cast<int>(m_history.size()) > LATENCY_FRAMES + 1) {
+        m_history.pop_front();
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_phase != TRACKING) {
+            return; // stopped meanwhile
+        }
+        m_published = mask;
+    }
+    if (!m_updatePending.exchange(true)) {
+        emit maskUpdated();
+    }
+}
+
+// MOG2 against the lit scene, the unlit surface where we black out; false while the model warms up
+bool OcclusionMasker::detectWithModel()
+{
+    // The mask published LATENCY_FRAMES ago is what the surface shows now
+    static const cv::Mat margin = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * MARGIN + 1, 2 * MARGIN + 1));
+    static const cv::Mat band = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * EDGE_BAND + 1, 2 * EDGE_BAND + 1));
+    if (static_cast<int>(m_history.size()) > LATENCY_FRAMES) {
+        cv::dilate(m_history.front(), m_blackedOut, margin);
+        cv::dilate(m_blackedOut, m_edge, band);
+        cv::erode(m_blackedOut, m_blackedOut, band);
+    } else {
+        m_blackedOut = cv::Mat::zeros(m_gray.size(), CV_8UC1);
+        m_edge = m_blackedOut;
+    }
+
+    // Pixels we black out would drag the lit model towards dark; show it its own background there
+    m_input = m_small;
+    if (cv::countNonZero(m_edge) > 0) {
+        m_subtractor->getBackgroundImage(m_background);
+        m_input = m_small.clone();
+        m_background.copyTo(m_input, m_edge);
+    }
+
+    // Shadows come back as 127 and are dropped
+    m_subtractor->apply(m_input, m_lit);
+    cv::threshold(m_lit, m_lit, 200, 255, cv::THRESH_BINARY);
+    if (++m_framesLearnt < WARMUP_FRAMES) {
+        return false;
+    }
+    if (cv::countNonZero(m_lit) > MAX_FOREGROUND * m_lit.total()) {
+        // New content on the surface, not a crowd
+        m_subtractor->apply(m_small, m_lit, 1.0);
+        m_framesLearnt = 0;
+        return false;
+    }
+
+    // Under the blackout only ambient light reaches the surface, so compare with the surface measured that way.
+    // The lit test there only sees the substituted background, so on the edge it is taken from the raw frame.
+    cv::absdiff(m_gray, m_darkReference, m_dark);
+    cv::threshold(m_dark, m_dark, DARK_THRESHOLD, 255, cv::THRESH_BINARY);
+    m_lit.copyTo(m_foreground);
+    if (cv::countNonZero(m_edge) > 0) {
+        cv::Mat background, litEdge;
+        cv::cvtColor(m_background, background, cv::COLOR_BGR2GRAY);
+        cv::GaussianBlur(background, background, cv::Size(5, 5), 0.0);
+        cv::absdiff(m_gray, background, litEdge);
+        cv::threshold(litEdge, litEdge, DARK_THRESHOLD, 255, cv::THRESH_BINARY);
+        cv::bitwise_and(litEdge, m_dark, m_both);
+        m_both.copyTo(m_foreground, m_edge);
+        m_dark.copyTo(m_foreground, m_blackedOut);
+    }
+    return true;
+}
+
+// Darkest and brightest of every frame the projector may be showing the camera now: those rendered within
+// the latency window, and the one already up when it opened; widened by a few pixels for calibration error.
+// False when nothing has been rendered for longer than that: the picture is still, and the model takes it.
+bool OcclusionMasker::expectedRange(qint64 now)
+{
+    std::vector<cv::Mat> frames;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_expected.empty() || now - m_expected.back().timestampMs > MAX_LATENCY_MS) {
+            return false;
+        }
+        for (size_t i = 0; i < m_expected.size(); ++i) {
+            const qint64 shownUntil = i + 1 < m_expected.size() ? m_expected[i + 1].timestampMs : now;
+            if (shownUntil >= now - MAX_LATENCY_MS && m_expected[i].timestampMs <= now - MIN_LATENCY_MS) {
+                frames.push_back(m_expected[i].frame);
+            }
+        }
+    }
+    if (frames.empty()) {
+        return false;
+    }
+
+    static const cv::Mat spread = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+    for (size_t i = 0; i < frames.size(); ++i) {
+        cv::Mat frame = frames[i], low, high;
+        if (frame.size() != m_gray.size()) {
+            cv::resize(frame, frame, m_gray.size(), 0.0, 0.0, cv::INTER_AREA);
+        }
+        cv::erode(frame, low, spread);
+        cv::dilate(frame, high, spread);
+        if (i == 0) {
+            m_expectedLow = low;
+            m_expectedHigh = high;
+        } else {
+            cv::min(m_expectedLow, low, m_expectedLow);
+            cv::max(m_expectedHigh, high, m_expectedHigh);
+        }
+    }
+    return true;
+}
+
+// The camera should see the unlit surface plus gain times the projected grey, somewhere between the
+// expected extremes; someone in the way is lit (or shades the surface) differently. Where nothing is
+// projected this is the unlit-surface test. The gain is learnt where the content holds still.
+bool OcclusionMasker::detectAgainstExpected()
+{
+    m_gray.convertTo(m_lit32, CV_32F);
+    cv::Mat dark32, low32, high32;
+    m_darkReference.convertTo(dark32, CV_32F);
+    m_expectedLow.convertTo(low32, CV_32F);
+    m_expectedHigh.convertTo(high32, CV_32F);
+    m_lit32 -= dark32;
+
+    // Bright content that isn't changing much: the only place the gain can be read off
+    cv::Mat steady, mid = (low32 + high32) * 0.5;
+    cv::Mat spreadOk;
+    cv::compare(high32 - low32, 24.0, spreadOk, cv::CMP_LT);
+    cv::compare(low32, 48.0, steady, cv::CMP_GT);
+    steady &= spreadOk;
+    cv::divide(m_lit32, cv::max(mid, 1.0), m_ratio);
+    m_ratio = cv::min(cv::max(m_ratio, 0.0), MAX_GAIN);
+
+    if (m_gain.empty()) {
+        if (cv::countNonZero(steady) < 0.01 * steady.total()) {
+            return false; // nothing lit to learn the surface from yet
+        }
+        m_gain = cv::Mat(m_gray.size(), CV_32F, cv::mean(m_ratio, steady));
+    }
+
+    cv::Mat slack = m_gain.mul(high32) * EXPECTED_SLACK + DARK_THRESHOLD;
+    cv::Mat below, above;
+    cv::compare(m_lit32, m_gain.mul(low32) - slack, below, cv::CMP_LT);
+    cv::compare(m_lit32, m_gain.mul(high32) + slack, above, cv::CMP_GT);
+    cv::bitwise_or(below, above, m_foreground);
+
+    // Nobody seen there lately: let the gain follow the surface
+    cv::Mat learn;
+    cv::compare(m_hold, cv::Scalar(0), learn, cv::CMP_EQ);
+    learn &= steady;
+    learn.setTo(0, m_foreground);
+    cv::accumulateWeighted(m_ratio, m_gain, GAIN_RATE, learn);
+    return true;
+}
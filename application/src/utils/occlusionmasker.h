@@ -0,0 +1,116 @@
+// occlusionmasker.h
+
+#ifndef OCCLUSIONMASKER_H
+#define OCCLUSIONMASKER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <atomic>
+#include <deque>
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+#include "utils/livefeed.h"
+
+// Finds people standing between the projector and the surface so the
+// projection window can black them out. Works on a quarter-resolution frame:
+// MOG2 against the lit scene, except where the projection is already blacked
+// out, where the frame is compared to the surface under ambient light only
+// (measured once by projecting black when masking starts). Along the edge of
+// the blackout, where it is unclear which applies, both have to agree. A
+// short hold keeps the mask from flickering. Projected content that moves on
+// its own would look like people to the model, so while the projection
+// animates the model is left alone and each frame is compared with what the
+// projector showed instead (see addExpectedFrame): the unlit surface plus a
+// learnt per-pixel gain times the projected frame.
+class OcclusionMasker : public QObject, public FrameAnalyzer
+{
+    Q_OBJECT
+
+public:
+    explicit OcclusionMasker(QObject* parent = nullptr);
+
+    // GUI thread
+    void begin(); // measures the unlit surface, then masks until stop()
+    void stop();
+    bool isRunning() const;
+    bool isMeasuring() const;
+
+    // GUI thread, while the projection animates: what the camera should see of each projected frame,
+    // grey and at the tracking resolution of the still frame (0 where nothing is projected)
+    bool wantsExpectedFrames() const;
+    void addExpectedFrame(const cv::Mat& expected);
+
+    // Latest mask over the whole camera frame at reduced resolution, 255 where someone is in the way
+    cv::Mat mask();
+
+    // FrameAnalyzer, feed thread
+    int intervalMs() const override;
+    bool wantsFrame() const override;
+    void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) override;
+
+signals:
+    void darkRequested();  // project black everywhere until ready()
+    void ready();          // ambient reference taken, masking has started
+    void maskUpdated();    // mask() has a new result; not emitted again until it is read
+
+private:
+    enum Phase { IDLE, SETTLING, MEASURING_DARK, RESTORING, TRACKING };
+
+    static constexpr int INTERVAL_MS = 33;            // 30 Hz
+    static constexpr double TRACK_SCALE = 0.25;
+    static constexpr int SETTLE_MS = 600;             // projector and camera exposure catch up
+    static constexpr int DARK_FRAMES = 4;
+    static constexpr int HISTORY_FRAMES = 900;        // ~30 s, so someone pausing isn't learnt as background
+    static constexpr double VAR_THRESHOLD = 25.0;
+    static constexpr int WARMUP_FRAMES = 15;
+    static constexpr double DARK_THRESHOLD = 18.0;    // grey levels above the unlit surface
+    static constexpr double MAX_FOREGROUND = 0.7;     // more than this changed at once: the projection changed, relearn
+    static constexpr int HOLD_FRAMES = 10;            // keep masking this long after someone was last seen
+    static constexpr int LATENCY_FRAMES = 3;          // frames before a published mask shows on the surface
+    static constexpr int MARGIN = 4;                  // px (downscaled) the blackout reaches past the mask, roughly
+    static constexpr int EDGE_BAND = 3;               // px (downscaled) around that where both tests must agree
+    static constexpr int MIN_LATENCY_MS = 20;         // from rendering a frame to the camera seeing it
+    static constexpr int MAX_LATENCY_MS = 250;
+    static constexpr double EXPECTED_SLACK = 0.25;    // of the expected brightness, on top of DARK_THRESHOLD
+    static constexpr double GAIN_RATE = 0.05;         // how fast the per-pixel gain follows the surface
+    static constexpr double MAX_GAIN = 4.0;
+
+    std::atomic<int> m_phase;
+    std::atomic<int> m_generation; // bumped by begin() so the feed thread starts from scratch
+    std::atomic<bool> m_updatePending;
+
+    QMutex m_mutex;
+    cv::Mat m_published;
+    bool m_running; // GUI thread
+
+    // Projected frames of the last MAX_LATENCY_MS or so, under m_mutex; one clock for them and the camera
+    struct ExpectedFrame {
+        qint64 timestampMs;
+        cv::Mat frame;
+    };
+    std::deque<ExpectedFrame> m_expected;
+    QElapsedTimer m_clock;
+
+    // Feed thread only
+    int m_feedGeneration;
+    cv::Ptr<cv::BackgroundSubtractorMOG2> m_subtractor;
+    cv::Mat m_small, m_gray, m_input, m_background, m_lit, m_dark, m_both, m_foreground;
+    cv::Mat m_accumulator, m_darkReference;
+    cv::Mat m_hold;                 // frames left before a pixel is released
+    std::deque<cv::Mat> m_history;  // last published masks, oldest first
+    cv::Mat m_blackedOut, m_edge;   // what the surface shows dark now, and a band around it
+    cv::Mat m_expectedLow, m_expectedHigh; // darkest and brightest the camera may see of the projection now
+    cv::Mat m_gain, m_lit32, m_ratio;      // camera minus the unlit surface, per unit of projected grey
+    int m_darkFrames;
+    int m_framesLearnt;
+
+    void measureDark();
+    void track();
+    bool expectedRange(qint64 now);
+    bool detectWithModel();
+    bool detectAgainstExpected();
+    void onDarkMeasured();
+};
+
+#endif // OCCLUSIONMASKER_H
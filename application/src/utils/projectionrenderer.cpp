@@ -0,0 +1,532 @@
+// projectionrenderer.cpp
+
+#include "projectionrenderer.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+ProjectionMask::ProjectionMask(const cv::Mat& alpha)
+    : m_alpha(alpha.clone())
+    , m_runs(alpha.rows)
+{
+    CV_DbgAssert(alpha.type() == CV_8UC1);
+
+    // Pixels fall in three classes: hidden (0), opaque (255) and feathered; a run is a stretch of one
+    // non-zero class, so a feathered outline gives a row three runs and a notch splits it further
+    auto classOf = [](uchar a) { return a == 0 ? 0 : a == 255 ? 1 : 2; };
+
+    int emptyRows = 0;
+    for (int y = 0; y < m_alpha.rows; ++y) {
+        const uchar* a = m_alpha.ptr<uchar>(y);
+        std::vector<Run>& runs = m_runs[y];
+        int x = 0;
+        while (x < m_alpha.cols) {
+            const int begin = x;
+            const int type = classOf(a[x]);
+            while (x < m_alpha.cols && classOf(a[x]) == type) {
+                ++x;
+            }
+            if (type != 0) {
+                runs.push_back({begin, x, type == 1});
+            }
+        }
+        emptyRows += runs.empty();
+    }
+
+    qDebug() << "Mask set," << emptyRows << "of" << m_alpha.rows << "rows fully masked";
+}
+
+bool ProjectionMask::isEmpty() const
+{
+    return m_alpha.empty();
+}
+
+const cv::Mat& ProjectionMask::alpha() const
+{
+    return m_alpha;
+}
+
+const std::vector<ProjectionMask::Run>& ProjectionMask::runs(int y) const
+{
+    return m_runs[y];
+}
+
+ProjectionRenderer::ProjectionRenderer(const cv::Size& outputSize)
+    : m_outputSize(outputSize)
+{
+}
+
+const cv::Size& ProjectionRenderer::outputSize() const
+{
+    return m_outputSize;
+}
+
+void ProjectionRenderer::setCompensation(const cv::Mat& gain, const cv::Mat& offset, double gamma)
+{
+    if (gain.empty() || gain.type() != CV_32FC3 || offset.size() != gain.size() || offset.type() != CV_32FC3) {
+        qDebug() << "Invalid compensation maps, expected two CV_32FC3 maps of equal size.";
+        return;
+    }
+
+    m_gain = gain.clone();
+    m_offset = offset.clone();
+    cv::cvtColor(m_gain, m_gainRgb, cv::COLOR_BGR2RGB);
+    cv::cvtColor(m_offset, m_offsetRgb, cv::COLOR_BGR2RGB);
+
+    // Content is display-encoded: linearise it, and invert the projector's response on the way out
+    for (int v = 0; v < 256; ++v) {
+        m_linearise[v] = static_cast<float>(255.0 * std::pow(v / 255.0, gamma));
+    }
+    for (int i = 0; i < RESPONSE_SIZE; ++i) {
+        const double x = static_cast<double>(i) / (RESPONSE_SIZE - 1);
+        m_response[i] = cv::saturate_cast<uchar>(255.0 * std::pow(x, 1.0 / gamma));
+    }
+
+    // Horizontal expansion table, pixel centres aligned between map and output
+    const int mapWidth = m_gain.cols;
+    m_mapX0.resize(m_outputSize.width);
+    m_mapX1.resize(m_outputSize.width);
+    m_mapWx.resize(m_outputSize.width);
+    for (int x = 0; x < m_outputSize.width; ++x) {
+        float mx = (x + 0.5f) * mapWidth / m_outputSize.width - 0.5f;
+        mx = std::min(std::max(mx, 0.0f), static_cast<float>(mapWidth - 1));
+        const int x0 = static_cast<int>(mx);
+        m_mapX0[x] = x0;
+        m_mapX1[x] = std::min(x0 + 1, mapWidth - 1);
+        m_mapWx[x] = mx - x0;
+    }
+
+    qDebug() << "Compensation set:" << m_gain.cols << "x" << m_gain.rows << "maps, gamma" << gamma;
+}
+
+void ProjectionRenderer::clearCompensation()
+{
+    m_gain.release();
+    m_offset.release();
+    m_gainRgb.release();
+    m_offsetRgb.release();
+}
+
+bool ProjectionRenderer::hasCompensation() const
+{
+    return !m_gain.empty();
+}
+
+void ProjectionRenderer::setOcclusion(const cv::Mat& keep)
+{
+    if (keep.empty() || keep.type() != CV_8UC1) {
+        qDebug() << "Invalid occlusion map, expected CV_8UC1.";
+        return;
+    }
+
+    if (keep.cols != m_occlusion.cols || m_occlusionX.empty()) {
+        m_occlusionX.resize(m_outputSize.width);
+        for (int x = 0; x < m_outputSize.width; ++x) {
+            m_occlusionX[x] = std::min(x * keep.cols / m_outputSize.width, keep.cols - 1);
+        }
+    }
+    m_occlusion = keep;
+
+    // Most rows have nobody in them; those are skipped without looking at a pixel
+    m_occlusionRowClear.resize(keep.rows);
+    for (int y = 0; y < keep.rows; ++y) {
+        const uchar* row = keep.ptr<uchar>(y);
+        m_occlusionRowClear[y] = std::all_of(row, row + keep.cols, [](uchar a) { return a == 255; });
+    }
+}
+
+void ProjectionRenderer::clearOcclusion()
+{
+    m_occlusion.release();
+}
+
+bool ProjectionRenderer::hasOcclusion() const
+{
+    return !m_occlusion.empty();
+}
+
+void ProjectionRenderer::occlude(cv::Mat& image, const cv::Point& offset) const
+{
+    if (!hasOcclusion() || image.type() != CV_8UC3) {
+        return;
+    }
+
+    // Clipped to the output; whatever lies outside it is never shown
+    const cv::Rect area = cv::Rect(offset, image.size()) & cv::Rect(cv::Point(0, 0), m_outputSize);
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        occludeRow(y, area.x, area.x + area.width, image.ptr<uchar>(y - offset.y) + 3 * (area.x - offset.x));
+    }
+}
+
+void ProjectionRenderer::setColorLut(const ColorLut& lut)
+{
+    m_colorLut = lut;
+}
+
+void ProjectionRenderer::clearColorLut()
+{
+    m_colorLut.clear();
+}
+
+bool ProjectionRenderer::hasColorLut() const
+{
+    return m_colorLut.isValid();
+}
+
+void ProjectionRenderer::render(const cv::Mat& src, const cv::Matx33d& homography, cv::Mat& dst) const
+{
+    ProjectionLayer layer;
+    layer.source = src;
+    layer.homography = homography;
+    render(std::vector<ProjectionLayer>{layer}, dst);
+}
+
+void ProjectionRenderer::render(const std::vector<ProjectionLayer>& layers, cv::Mat& dst, ChannelOrder order) const
+{
+    std::vector<PreparedLayer> prepared;
+    prepared.reserve(layers.size());
+    for (const ProjectionLayer& layer : layers) {
+        if (layer.source.empty() || layer.source.type() != CV_8UC3) {
+            qDebug() << "ProjectionRenderer expects non-empty CV_8UC3 sources, skipping a layer.";
+            continue;
+        }
+        if (layer.mask && !layer.mask->isEmpty() && layer.mask->alpha().size() != m_outputSize) {
+            qDebug() << "ProjectionRenderer: mask does not match the output size, skipping a layer.";
+            continue;
+        }
+        prepared.push_back(prepareLayer(layer));
+    }
+
+    dst.create(m_outputSize, CV_8UC3);
+
+    const bool rgb = order == ChannelOrder::RGB;
+    const bool correctColour = hasColorLut();
+    const bool compensate = hasCompensation();
+    const bool occlude = hasOcclusion();
+    const cv::Mat& gain = rgb ? m_gainRgb : m_gain;
+    const cv::Mat& offset = rgb ? m_offsetRgb : m_offset;
+    const int rowChannels = m_outputSize.width * 3;
+    const int lowFloats = compensate ? m_gain.cols * 3 : 0;
+
+    cv::parallel_for_(cv::Range(0, m_outputSize.height), [&](const cv::Range& rows) {
+        // Per-stripe scratch, reused across its rows
+        std::vector<float> scratch(compensate ? 2 * rowChannels + lowFloats : 0);
+        std::vector<uchar> layerRow(rowChannels); // a feathered segment, before it is blended
+        std::vector<Segment> segments;
+        std::vector<ProjectionMask::Run> runs, cover;
+
+        // Sample and correct one segment into target, indexed by output column
+        auto paint = [&](const PreparedLayer& layer, int y, int begin, int end, uchar* target) {
+            warpRow(layer.layer->source, layer.inverse, layer.layer->order != order, y, begin, end, target);
+            if (correctColour) {
+                m_colorLut.applyRow(target + 3 * begin, end - begin, rgb);
+            }
+            if (compensate) {
+                compensateRow(gain, offset, y, begin, end, target,
+                              scratch.data(), scratch.data() + rowChannels, scratch.data() + 2 * rowChannels);
+            }
+        };
+
+        for (int y = rows.start; y < rows.end; ++y) {
+            uchar* row = dst.ptr<uchar>(y);
+            rowSegments(prepared, y, segments, runs, cover);
+
+            // Black wherever no opaque segment paints: the gaps, and under feathered edges with nothing beneath
+            int x = 0;
+            for (const ProjectionMask::Run& covered : cover) {
+                std::fill(row + 3 * x, row + 3 * covered.begin, uchar(0));
+                x = covered.end;
+            }
+            std::fill(row + 3 * x, row + rowChannels, uchar(0));
+
+            // Bottom layer first; opaque segments never overlap, so each of their pixels is sampled once
+            int paintedBegin = m_outputSize.width, paintedEnd = 0;
+            for (const Segment& segment : segments) {
+                const PreparedLayer& layer = prepared[segment.layer];
+                if (segment.opaque) {
+                    paint(layer, y, segment.begin, segment.end, row);
+                } else {
+                    paint(layer, y, segment.begin, segment.end, layerRow.data());
+                    blendRow(layer.layer->mask->alpha(), y, segment.begin, segment.end, layerRow.data(), row);
+                }
+                paintedBegin = std::min(paintedBegin, segment.begin);
+                paintedEnd = std::max(paintedEnd, segment.end);
+            }
+
+            if (occlude && paintedBegin < paintedEnd) {
+                occludeRow(y, paintedBegin, paintedEnd, row + 3 * paintedBegin);
+            }
+        }
+    });
+}
+
+ProjectionRenderer::PreparedLayer ProjectionRenderer::prepareLayer(const ProjectionLayer& layer) const
+{
+    PreparedLayer prepared;
+    prepared.layer = &layer;
+
+    // Sampling runs backwards: output pixel -> source pixel
+    prepared.inverse = layer.homography.inv();
+
+    // Only the ratio matters; make w positive over the output so the validity test is a sign check
+    const cv::Matx33d& inverse = prepared.inverse;
+    const double centreW = inverse(2, 0) * m_outputSize.width * 0.5
+                         + inverse(2, 1) * m_outputSize.height * 0.5 + inverse(2, 2);
+    if (centreW < 0.0) {
+        prepared.inverse *= -1.0;
+    }
+
+    // Where the source's pixel area lands; a quad with a corner behind the projection isn't bounded
+    const float right = layer.source.cols - 0.5f, bottom = layer.source.rows - 0.5f;
+    const cv::Point2f corners[4] = {{-0.5f, -0.5f}, {right, -0.5f}, {right, bottom}, {-0.5f, bottom}};
+    const cv::Matx33d& h = layer.homography;
+    const double sign = h(2, 0) * layer.source.cols * 0.5 + h(2, 1) * layer.source.rows * 0.5 + h(2, 2) < 0.0 ? -1.0 : 1.0;
+
+    prepared.bounded = true;
+    for (int i = 0; i < 4; ++i) {
+        const cv::Vec3d p = h * cv::Vec3d(corners[i].x, corners[i].y, 1.0) * sign;
+        prepared.bounded = prepared.bounded && p[2] > 1e-9;
+        prepared.outline[i] = cv::Point2f(static_cast<float>(p[0] / p[2]), static_cast<float>(p[1] / p[2]));
+    }
+    return prepared;
+}
+
+// Runs of row y whose pixel centres fall inside the layer where its mask is non-zero
+void ProjectionRenderer::layerRuns(const PreparedLayer& layer, int y, std::vector<ProjectionMask::Run>& runs) const
+{
+    runs.clear();
+    int begin = 0;
+    int end = m_outputSize.width;
+
+    if (layer.bounded) {
+        float minX = 0.0f, maxX = -1.0f;
+        bool hit = false;
+        for (int i = 0; i < 4; ++i) {
+            const cv::Point2f& p = layer.outline[i];
+            const cv::Point2f& q = layer.outline[(i + 1) % 4];
+            if ((p.y <= y && y < q.y) || (q.y <= y && y < p.y)) {
+                const float x = p.x + (y - p.y) * (q.x - p.x) / (q.y - p.y);
+                minX = hit ? std::min(minX, x) : x;
+                maxX = hit ? std::max(maxX, x) : x;
+                hit = true;
+            }
+        }
+        if (!hit) {
+            return;
+        }
+        begin = std::max(begin, static_cast<int>(std::ceil(minX)));
+        end = std::min(end, static_cast<int>(std::floor(maxX)) + 1);
+    }
+    if (end <= begin) {
+        return;
+    }
+
+    const ProjectionMask* mask = layer.layer->mask;
+    if (!mask || mask->isEmpty()) {
+        runs.push_back({begin, end, true});
+        return;
+    }
+    for (const ProjectionMask::Run& run : mask->runs(y)) {
+        const int runBegin = std::max(begin, run.begin);
+        const int runEnd = std::min(end, run.end);
+        if (runBegin < runEnd) {
+            runs.push_back({runBegin, runEnd, run.opaque});
+        }
+    }
+}
+
+// Split row y between the layers as segments in painting order, bottom layer first. Each layer
+// keeps its runs less what the opaque runs of the layers above it hide; cover ends up as the
+// sorted union of all opaque runs, which is exactly where the segments paint every pixel.
+void ProjectionRenderer::rowSegments(const std::vector<PreparedLayer>& layers, int y, std::vector<Segment>& segments,
+                                     std::vector<ProjectionMask::Run>& runs, std::vector<ProjectionMask::Run>& cover) const
+{
+    segments.clear();
+    cover.clear();
+
+    for (int l = static_cast<int>(layers.size()) - 1; l >= 0; --l) {
+        layerRuns(layers[l], y, runs);
+
+        // Subtract the cover from each run; cover is sorted and disjoint
+        for (const ProjectionMask::Run& run : runs) {
+            int begin = run.begin;
+            for (const ProjectionMask::Run& covered : cover) {
+                if (covered.begin >= run.end || begin >= run.end) {
+                    break;
+                }
+                if (covered.end <= begin) {
+                    continue;
+                }
+                if (covered.begin > begin) {
+                    segments.push_back(Segment{begin, covered.begin, l, run.opaque});
+                }
+                begin = std::max(begin, covered.end);
+            }
+            if (begin < run.end) {
+                segments.push_back(Segment{begin, run.end, l, run.opaque});
+            }
+        }
+
+        // This layer's opaque runs hide the layers beneath as well
+        bool grew = false;
+        for (const ProjectionMask::Run& run : runs) {
+            if (run.opaque) {
+                cover.push_back(run);
+                grew = true;
+            }
+        }
+        if (grew) {
+            std::sort(cover.begin(), cover.end(), [](const ProjectionMask::Run& a, const ProjectionMask::Run& b) {
+                return a.begin < b.begin;
+            });
+            size_t merged = 0;
+            for (const ProjectionMask::Run& run : cover) {
+                if (merged > 0 && run.begin <= cover[merged - 1].end) {
+                    cover[merged - 1].end = std::max(cover[merged - 1].end, run.end);
+                } else {
+                    cover[merged++] = run;
+                }
+            }
+            cover.resize(merged);
+        }
+    }
+
+    std::reverse(segments.begin(), segments.end());
+}
+
+// Bilinear sample of one output row; outside the source is black. swap reverses the
+// channel order on the way out, so the swizzle costs nothing beyond the sample itself
+void ProjectionRenderer::warpRow(const cv::Mat& src, const cv::Matx33d& inverse, bool swap, int y, int begin, int end, uchar* row) const
+{
+    const int lastX = src.cols - 1, lastY = src.rows - 1;
+    const float maxX = static_cast<float>(lastX), maxY = static_cast<float>(lastY);
+
+    // Homogeneous source coordinates at x = begin, stepped incrementally along the row
+    const double dX = inverse(0, 0), dY = inverse(1, 0), dW = inverse(2, 0);
+    double X = dX * begin + inverse(0, 1) * y + inverse(0, 2);
+    double Y = dY * begin + inverse(1, 1) * y + inverse(1, 2);
+    double W = dW * begin + inverse(2, 1) * y + inverse(2, 2);
+
+    uchar* out = row + 3 * begin;
+    for (int x = begin; x < end; ++x, X += dX, Y += dY, W += dW, out += 3) {
+        const float sx = static_cast<float>(X / W);
+        const float sy = static_cast<float>(Y / W);
+
+        // Written so NaN (w == 0) also lands in the black branch
+        if (!(W > 0.0 && sx > -0.5f && sy > -0.5f && sx < maxX + 0.5f && sy < maxY + 0.5f)) {
+            out[0] = out[1] = out[2] = 0;
+            continue;
+        }
+
+        const float cx = std::min(std::max(sx, 0.0f), maxX);
+        const float cy = std::min(std::max(sy, 0.0f), maxY);
+        const int x0 = static_cast<int>(cx), y0 = static_cast<int>(cy);
+        const int x1 = std::min(x0 + 1, lastX), y1 = std::min(y0 + 1, lastY);
+        const float fx = cx - x0, fy = cy - y0;
+
+        const uchar* top = src.ptr<uchar>(y0);
+        const uchar* bottom = src.ptr<uchar>(y1);
+        const uchar* p00 = top + x0 * 3;
+        const uchar* p01 = top + x1 * 3;
+        const uchar* p10 = bottom + x0 * 3;
+        const uchar* p11 = bottom + x1 * 3;
+
+        for (int c = 0; c < 3; ++c) {
+            const float upper = p00[c] + fx * (p01[c] - p00[c]);
+            const float lower = p10[c] + fx * (p11[c] - p10[c]);
+            out[swap ? 2 - c : c] = static_cast<uchar>(upper + fy * (lower - upper) + 0.5f);
+        }
+    }
+}
+
+// Bilinear expansion of one reduced-resolution map row to output columns [begin, end)
+void ProjectionRenderer::expandMapRow(const cv::Mat& map, int y, int begin, int end, float* low, float* out) const
+{
+    float my = (y + 0.5f) * map.rows / m_outputSize.height - 0.5f;
+    my = std::min(std::max(my, 0.0f), static_cast<float>(map.rows - 1));
+    const int y0 = static_cast<int>(my);
+    const int y1 = std::min(y0 + 1, map.rows - 1);
+    const float wy = my - y0;
+
+    const float* a = map.ptr<float>(y0);
+    const float* b = map.ptr<float>(y1);
+    const int lowFloats = map.cols * 3;
+    for (int i = 0; i < lowFloats; ++i) {
+        low[i] = a[i] + wy * (b[i] - a[i]);
+    }
+
+    for (int x = begin; x < end; ++x) {
+        const float* l = low + m_mapX0[x] * 3;
+        const float* r = low + m_mapX1[x] * 3;
+        const float wx = m_mapWx[x];
+        out[3 * x + 0] = l[0] + wx * (r[0] - l[0]);
+        out[3 * x + 1] = l[1] + wx * (r[1] - l[1]);
+        out[3 * x + 2] = l[2] + wx * (r[2] - l[2]);
+    }
+}
+
+void ProjectionRenderer::compensateRow(const cv::Mat& gain, const cv::Mat& offset, int y, int begin, int end,
+                                       uchar* row, float* gainRow, float* offsetRow, float* low) const
+{
+    expandMapRow(gain, y, begin, end, low, gainRow);
+    expandMapRow(offset, y, begin, end, low, offsetRow);
+
+    // Work on the span only; all three buffers are indexed by output column
+    const int n = (end - begin) * 3;
+    row += 3 * begin;
+    gainRow += 3 * begin;
+    offsetRow += 3 * begin;
+    const float toIndex = static_cast<float>(RESPONSE_SIZE - 1) / 255.0f;
+
+    // Linearise (table lookup), then a straight multiply-add-clamp over contiguous floats
+    // that the compiler vectorises, then the inverse response lookup
+    for (int i = 0; i < n; ++i) {
+        gainRow[i] *= m_linearise[row[i]];
+    }
+    for (int i = 0; i < n; ++i) {
+        const float v = (gainRow[i] + offsetRow[i]) * toIndex;
+        gainRow[i] = std::min(std::max(v, 0.0f), static_cast<float>(RESPONSE_SIZE - 1));
+    }
+    for (int i = 0; i < n; ++i) {
+        row[i] = m_response[static_cast<int>(gainRow[i] + 0.5f)];
+    }
+}
+
+// Blend a feathered segment over what is already in the row: out = (layer * alpha + row * (255 - alpha)) / 255,
+// in integer arithmetic the compiler turns into a multiply-shift
+void ProjectionRenderer::blendRow(const cv::Mat& mask, int y, int begin, int end, const uchar* layerRow, uchar* row) const
+{
+    const uchar* alpha = mask.ptr<uchar>(y);
+    for (int x = begin; x < end; ++x) {
+        const unsigned a = alpha[x];
+        const unsigned b = 255 - a;
+        const uchar* layer = layerRow + 3 * x;
+        uchar* pixel = row + 3 * x;
+        pixel[0] = static_cast<uchar>((layer[0] * a + pixel[0] * b + 127) / 255);
+        pixel[1] = static_cast<uchar>((layer[1] * a + pixel[1] * b + 127) / 255);
+        pixel[2] = static_cast<uchar>((layer[2] * a + pixel[2] * b + 127) / 255);
+    }
+}
+
+// Nearest sample of the occlusion map; it is soft-edged already, so blocks don't show
+void ProjectionRenderer::occludeRow(int y, int begin, int end, uchar* pixels) const
+{
+    const int mapY = std::min(y * m_occlusion.rows / m_outputSize.height, m_occlusion.rows - 1);
+    if (m_occlusionRowClear[mapY]) {
+        return;
+    }
+
+    const uchar* keep = m_occlusion.ptr<uchar>(mapY);
+    for (int x = begin; x < end; ++x, pixels += 3) {
+        const unsigned a = keep[m_occlusionX[x]];
+        if (a == 255) {
+            continue;
+        }
+        pixels[0] = static_cast<uchar>((pixels[0] * a + 127) / 255);
+        pixels[1] = static_cast<uchar>((pixels[1] * a + 127) / 255);
+        pixels[2] = static_cast<uchar>((pixels[2] * a + 127) / 255);
+    }
+}
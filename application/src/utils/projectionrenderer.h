@@ -0,0 +1,133 @@
+// projectionrenderer.h
+
+#ifndef PROJECTIONRENDERER_H
+#define PROJECTIONRENDERER_H
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <vector>
+#include "utils/colorlut.h"
+
+// Feathered alpha in projector space, with each row split once into runs of non-zero
+// alpha so the renderer never samples what the mask hides.
+class ProjectionMask
+{
+public:
+    struct Run {
+        int begin, end; // non-zero alpha in [begin, end)
+        bool opaque;    // alpha is 255 across the whole run, otherwise it is below 255 throughout
+    };
+
+    ProjectionMask() = default;
+    explicit ProjectionMask(const cv::Mat& alpha); // CV_8UC1
+
+    bool isEmpty() const;
+    const cv::Mat& alpha() const;
+    const std::vector<Run>& runs(int y) const; // sorted by column
+
+private:
+    cv::Mat m_alpha;
+    std::vector<std::vector<Run>> m_runs;
+};
+
+// Byte order of a CV_8UC3 image: OpenCV's BGR, or RGB as QImage::Format_RGB888 holds it
+enum class ChannelOrder { BGR, RGB };
+
+// One warped source in the output; mask is optional and must outlive the render call.
+// Where the mask is 0 the layers beneath show through, where it is feathered it is blended over them.
+struct ProjectionLayer {
+    cv::Mat source;          // CV_8UC3
+    ChannelOrder order = ChannelOrder::BGR;
+    cv::Matx33d homography;  // source pixels -> output pixels
+    const ProjectionMask* mask = nullptr;
+};
+
+// Warps sources into projector space in a single pass. Each output row is
+// split into segments by the layers' alpha runs: a layer's opaque runs own
+// their pixels outright, so anything under them is never sampled, and only
+// its feathered runs are blended over the layer beneath. Each segment runs
+// through the per-pixel output corrections while it is still in cache, so
+// neither extra layers nor corrections cost another full-frame pass.
+class ProjectionRenderer
+{
+public:
+    explicit ProjectionRenderer(const cv::Size& outputSize);
+
+    const cv::Size& outputSize() const;
+
+    // Radiometric compensation in projector space: out = response[linearise[in] * gain + offset].
+    // gain/offset are CV_32FC3 maps at reduced resolution, expanded bilinearly row by row;
+    // gamma is the projector's measured response exponent.
+    void setCompensation(const cv::Mat& gain, const cv::Mat& offset, double gamma);
+    void clearCompensation();
+    bool hasCompensation() const;
+
+    // Projector colour correction, applied to each row before compensation
+    void setColorLut(const ColorLut& lut);
+    void clearColorLut();
+    bool hasColorLut() const;
+
+    // People in front of the surface: a CV_8UC1 map at reduced resolution, 255 where the output is
+    // shown and 0 where it is blacked out. Applied to every layer as the last row stage.
+    void setOcclusion(const cv::Mat& keep);
+    void clearOcclusion();
+    bool hasOcclusion() const;
+    // Occlusion for something drawn over a rendered frame; image (CV_8UC3) covers the output from offset
+    void occlude(cv::Mat& image, const cv::Point& offset) const;
+
+    // Composite layers (later ones on top) into dst at outputSize; uncovered pixels are black.
+    // Sources are swizzled to the output order as they are sampled, so rendering straight into
+    // a QImage's buffer needs no conversion pass. A dst of the right size and type is written in place.
+    void render(const std::vector<ProjectionLayer>& layers, cv::Mat& dst,
+                ChannelOrder order = ChannelOrder::BGR) const;
+    void render(const cv::Mat& src, const cv::Matx33d& homography, cv::Mat& dst) const;
+
+private:
+    static constexpr int RESPONSE_SIZE = 1024; // finer than 8 bits so dark tones survive the inverse gamma
+
+    // A layer prepared for one render call
+    struct PreparedLayer {
+        const ProjectionLayer* layer;
+        cv::Matx33d inverse;                // output -> source
+        std::array<cv::Point2f, 4> outline; // source bounds in the output
+        bool bounded;                       // outline is a proper convex quad
+    };
+
+    struct Segment {
+        int begin, end;
+        int layer;
+        bool opaque; // false: blended over the segments painted before it
+    };
+
+    cv::Size m_outputSize;
+
+    ColorLut m_colorLut;
+
+    // Compensation
+    cv::Mat m_gain, m_offset;
+    cv::Mat m_gainRgb, m_offsetRgb; // the same maps for RGB output
+    std::array<float, 256> m_linearise;
+    std::array<uchar, RESPONSE_SIZE> m_response;
+    std::vector<int> m_mapX0, m_mapX1; // per output column: neighbouring map columns
+    std::vector<float> m_mapWx;        // and the weight of the right one
+
+    // Occlusion
+    cv::Mat m_occlusion;
+    std::vector<int> m_occlusionX;     // per output column: occlusion map column
+    std::vector<uchar> m_occlusionRowClear; // per occlusion map row: nothing blacked out
+
+    PreparedLayer prepareLayer(const ProjectionLayer& layer) const;
+    void layerRuns(const PreparedLayer& layer, int y, std::vector<ProjectionMask::Run>& runs) const;
+    void rowSegments(const std::vector<PreparedLayer>& layers, int y, std::vector<Segment>& segments,
+                     std::vector<ProjectionMask::Run>& runs, std::vector<ProjectionMask::Run>& cover) const;
+
+    // Row stages, each working on the columns [begin, end)
+    void warpRow(const cv::Mat& src, const cv::Matx33d& inverse, bool swap, int y, int begin, int end, uchar* row) const;
+    void expandMapRow(const cv::Mat& map, int y, int begin, int end, float* low, float* out) const;
+    void compensateRow(const cv::Mat& gain, const cv::Mat& offset, int y, int begin, int end,
+                       uchar* row, float* gainRow, float* offsetRow, float* low) const;
+    void blendRow(const cv::Mat& alpha, int y, int begin, int end, const uchar* layerRow, uchar* row) const;
+    void occludeRow(int y, int begin, int end, uchar* pixels) const; // pixels: column begin onwards
+};
+
+#endif // PROJECTIONRENDERER_H
@@ -0,0 +1,62 @@
+// renderworker.cpp
+
+#include "renderworker.h"
+
+#include <QDebug>
+#include <exception>
+
+RenderWorker::RenderWorker()
+    : m_busy(false)
+    , m_quit(false)
+    , m_thread(&RenderWorker::loop, this)
+{
+}
+
+RenderWorker::~RenderWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void RenderWorker::post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = std::move(job);
+        m_busy = true;
+    }
+    m_wake.notify_one();
+}
+
+void RenderWorker::finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return !m_busy; });
+}
+
+void RenderWorker::loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this]() { return m_busy || m_quit; });
+        if (m_quit) {
+            return;
+        }
+
+        std::function<void()> job = std::move(m_job);
+        m_job = nullptr;
+        lock.unlock();
+        try {
+            job();
+        } catch (const std::exception& e) {
+            qDebug() << "RenderWorker: job failed:" << e.what(); // the output keeps its last frame
+        }
+        lock.lock();
+        m_busy = false;
+        m_done.notify_all();
+    }
+}
@@ -0,0 +1,39 @@
+// renderworker.h
+
+#ifndef RENDERWORKER_H
+#define RENDERWORKER_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// A thread kept for the life of one projector output. The projection window hands it
+// that output's render every frame instead of starting a thread per frame, and waits
+// for it so all outputs are shown together.
+class RenderWorker
+{
+public:
+    RenderWorker();
+    ~RenderWorker();
+
+    RenderWorker(const RenderWorker&) = delete;
+    RenderWorker& operator=(const RenderWorker&) = delete;
+
+    // job may refer to the caller's locals: it is done by the time finish() returns
+    void post(std::function<void()> job);
+    void finish();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::function<void()> m_job;
+    bool m_busy;
+    bool m_quit;
+    std::thread m_thread;
+
+    void loop();
+};
+
+#endif // RENDERWORKER_H
@@ -0,0 +1,253 @@
+// resultcache.cpp
+
+#include "resultcache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QProcessEnvironment>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+ResultCache::ResultCache()
+    : m_map(nullptr)
+    , m_budgetBytes(0)
+{
+    const int budgetMb = QProcessEnvironment::systemEnvironment().value("GPMS_RESULT_CACHE_MB", "256").toInt();
+    if (budgetMb <= 0) {
+        return;
+    }
+    m_budgetBytes = static_cast<qint64>(budgetMb) * 1024 * 1024;
+
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/results";
+    if (!QDir().mkpath(m_directory) || !openIndex()) {
+        qDebug() << "ResultCache: cannot open" << m_directory << "- caching disabled";
+        m_budgetBytes = 0;
+    }
+}
+
+ResultCache::~ResultCache()
+{
+    if (m_map) {
+        m_indexFile.unmap(m_map);
+    }
+}
+
+bool ResultCache::isEnabled() const
+{
+    return m_map != nullptr;
+}
+
+QByteArray ResultCache::key(const QByteArray& surface, const QStringList& fields)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    auto addPart = [&hash](const QByteArray& part) {
+        const quint32 size = static_cast<quint32>(part.size());
+        hash.addData(reinterpret_cast<const char*>(&size), sizeof(size));
+        hash.addData(part);
+    };
+    addPart(surface);
+    for (const QString& field : fields) {
+        addPart(field.toUtf8());
+    }
+    return hash.result();
+}
+
+ResultCache::Header* ResultCache::header() const
+{
+    return reinterpret_cast<Header*>(m_map);
+}
+
+ResultCache::Slot* ResultCache::slots() const
+{
+    return reinterpret_cast<Slot*>(m_map + sizeof(Header));
+}
+
+bool ResultCache::openIndex()
+{
+    const qint64 indexSize = sizeof(Header) + static_cast<qint64>(sizeof(Slot)) * CAPACITY;
+    m_indexFile.setFileName(m_directory + "/index.bin");
+    if (!m_indexFile.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    const bool fresh = m_indexFile.size() != indexSize;
+    if (fresh && !m_indexFile.resize(indexSize)) {
+        return false;
+    }
+    m_map = m_indexFile.map(0, indexSize); // shared: writes to the table land in the file
+    if (!m_map) {
+        return false;
+    }
+
+    Header* h = header();
+    if (fresh || h->magic != MAGIC || h->version != VERSION || h->capacity != CAPACITY) {
+        // Unknown or damaged table: start over, and drop the images it pointed at
+        std::memset(m_map, 0, indexSize);
+        h->magic = MAGIC;
+        h->version = VERSION;
+        h->capacity = CAPACITY;
+        QDir directory(m_directory);
+        for (const QString& file : directory.entryList({ "*.rgb" }, QDir::Files)) {
+            directory.remove(file);
+        }
+    }
+    qDebug() << "ResultCache:" << h->count << "images," << h->totalBytes / (1024 * 1024) << "MB in" << m_directory;
+    return true;
+}
+
+quint32 ResultCache::homeOf(const char* key)
+{
+    quint32 start = 0;
+    std::memcpy(&start, key, sizeof(start));
+    return start & (CAPACITY - 1);
+}
+
+// Linear probing from the key's first bytes; the first empty slot ends it. Removal keeps that true
+// without tombstones, so a miss stops as soon as a hit would have.
+int ResultCache::find(const QByteArray& key) const
+{
+    const quint32 start = homeOf(key.constData());
+    for (quint32 probe = 0; probe < CAPACITY; ++probe) {
+        const int index = static_cast<int>((start + probe) & (CAPACITY - 1));
+        const Slot& slot = slots()[index];
+        if (slot.state == EMPTY) {
+            return -1;
+        }
+        if (std::memcmp(slot.key, key.constData(), KEY_SIZE) == 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+QString ResultCache::pathOf(const Slot& slot) const
+{
+    const QByteArray name = QByteArray(reinterpret_cast<const char*>(slot.key), KEY_SIZE).toHex();
+    return m_directory + "/" + QString::fromLatin1(name) + ".rgb";
+}
+
+// Backward-shift deletion: later slots of the run move into the hole unless that would take them
+// before their home slot. Files are named by key, so moving a slot leaves its image in place.
+void ResultCache::remove(int index)
+{
+    Slot* table = slots();
+    QFile::remove(pathOf(table[index]));
+    header()->totalBytes -= static_cast<quint64>(table[index].rows) * table[index].cols * 3;
+    header()->count--;
+    table[index].state = EMPTY;
+
+    quint32 hole = static_cast<quint32>(index);
+    for (quint32 next = (hole + 1) & (CAPACITY - 1); table[next].state == LIVE; next = (next + 1) & (CAPACITY - 1)) {
+        // Stays if its home lies cyclically in (hole, next]: the hole is not on its probe sequence
+        const quint32 home = homeOf(reinterpret_cast<const char*>(table[next].key));
+        const bool stays = hole < next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (stays) {
+            continue;
+        }
+        table[hole] = table[next];
+        table[next].state = EMPTY;
+        hole = next;
+    }
+}
+
+bool ResultCache::lookup(const QByteArray& key, cv::Mat& image, qint64& seed)
+{
+    if (!isEnabled() || key.size() != KEY_SIZE) {
+        return false;
+    }
+    const int index = find(key);
+    if (index < 0) {
+        return false;
+    }
+
+    Slot& slot = slots()[index];
+    QFile file(pathOf(slot));
+    const qint64 size = static_cast<qint64>(slot.rows) * slot.cols * 3;
+    if (!file.open(QIODevice::ReadOnly) || file.size() != size) {
+        remove(index); // the file went missing behind our back
+        return false;
+    }
+
+    image.create(static_cast<int>(slot.rows), static_cast<int>(slot.cols), CV_8UC3);
+    if (file.read(reinterpret_cast<char*>(image.data), size) != size) {
+        image.release();
+        remove(index);
+        return false;
+    }
+    seed = slot.seed;
+    slot.lastUsed = ++header()->clock;
+    return true;
+}
+
+// Oldest first, until the new image fits the byte budget and the table stays at most 3/4 full
+void ResultCache::evictFor(qint64 bytes)
+{
+    while (header()->count > 0
+           && (static_cast<qint64>(header()->totalBytes) + bytes > m_budgetBytes
+               || header()->count >= CAPACITY * 3 / 4)) {
+        int oldest = -1;
+        for (int index = 0; index < static_cast<int>(CAPACITY); ++index) {
+            const Slot& slot = slots()[index];
+            if (slot.state == LIVE && (oldest < 0 || slot.lastUsed < slots()[oldest].lastUsed)) {
+                oldest = index;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+        remove(oldest);
+    }
+}
+
+void ResultCache::insert(const QByteArray& key, const cv::Mat& image, qint64 seed)
+{
+    if (!isEnabled() || key.size() != KEY_SIZE || image.empty() || image.type() != CV_8UC3) {
+        return;
+    }
+    const qint64 size = static_cast<qint64>(image.total()) * 3;
+    if (size > m_budgetBytes) {
+        return;
+    }
+
+    const int existing = find(key);
+    if (existing >= 0) {
+        remove(existing);
+    }
+    evictFor(size);
+
+    // First free slot on the key's probe sequence
+    const quint32 start = homeOf(key.constData());
+    int index = -1;
+    for (quint32 probe = 0; probe < CAPACITY && index < 0; ++probe) {
+        const int candidate = static_cast<int>((start + probe) & (CAPACITY - 1));
+        if (slots()[candidate].state == EMPTY) {
+            index = candidate;
+        }
+    }
+    if (index < 0) {
+        return;
+    }
+
+    Slot& slot = slots()[index];
+    std::memcpy(slot.key, key.constData(), KEY_SIZE);
+    slot.rows = static_cast<quint32>(image.rows);
+    slot.cols = static_cast<quint32>(image.cols);
+    slot.seed = seed;
+
+    // Written in full before the slot goes live, so a crash never leaves a slot pointing at half a file
+    QSaveFile file(pathOf(slot));
+    const cv::Mat continuous = image.isContinuous() ? image : image.clone();
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(reinterpret_cast<const char*>(continuous.data), size) != size
+        || !file.commit()) {
+        qDebug() << "ResultCache: failed to write" << file.fileName();
+        return;
+    }
+
+    slot.lastUsed = ++header()->clock;
+    slot.state = LIVE;
+    header()->count++;
+    header()->totalBytes += static_cast<quint64>(size);
+}
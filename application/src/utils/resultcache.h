@@ -0,0 +1,76 @@
+// resultcache.h
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <opencv2/core.hpp>
+
+// Generated images kept on disk, decoded, under a key that hashes everything
+// that went into them (see key()), so asking again for the same surface and
+// prompt fills the frames without a trip to the server. The index is a fixed
+// open-addressing table in a memory-mapped file: opening it is one map() call
+// however full it is, and a lookup touches one or two slots. Least recently
+// used images are dropped once the files exceed GPMS_RESULT_CACHE_MB (256 by
+// default, 0 turns the cache off). GUI thread only.
+class ResultCache
+{
+public:
+    ResultCache();
+    ~ResultCache();
+
+    bool isEnabled() const;
+
+    // Hash of the surface (the uploaded bytes) and the request fields that shape the image;
+    // parts are length-prefixed so no two different lists hash alike
+    static QByteArray key(const QByteArray& surface, const QStringList& fields);
+
+    bool lookup(const QByteArray& key, cv::Mat& image, qint64& seed); // image is CV_8UC3 RGB
+    void insert(const QByteArray& key, const cv::Mat& image, qint64 seed);
+
+private:
+    static constexpr quint32 MAGIC = 0x434d5047; // "GPMC"
+    static constexpr quint32 VERSION = 2;        // 2: removal shifts slots back instead of leaving tombstones
+    static constexpr quint32 CAPACITY = 4096;    // slots, a power of two; kept at most 3/4 full
+    static constexpr int KEY_SIZE = 32;          // SHA-256
+
+    enum SlotState : quint32 { EMPTY = 0, LIVE = 1 };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 capacity;
+        quint32 count;      // live slots
+        quint64 totalBytes; // size of the live slots' files
+        quint64 clock;      // bumped on every use, for LRU
+    };
+
+    struct Slot {
+        uchar key[KEY_SIZE];
+        quint64 lastUsed;
+        qint64 seed;
+        quint32 rows;
+        quint32 cols;
+        quint32 state;
+        quint32 reserved;
+    };
+
+    QString m_directory;
+    QFile m_indexFile;
+    uchar* m_map;
+    qint64 m_budgetBytes;
+
+    Header* header() const;
+    Slot* slots() const;
+    bool openIndex();
+    static quint32 homeOf(const char* key); // first slot of the key's probe sequence
+    int find(const QByteArray& key) const; // slot index, -1 if absent
+    void remove(int index);
+    void evictFor(qint64 bytes);
+    QString pathOf(const Slot& slot) const;
+};
+
+#endif // RESULTCACHE_H
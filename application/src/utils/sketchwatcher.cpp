@@ -0,0 +1,172 @@
+// sketchwatcher.cpp
+
+#include "sketchwatcher.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QProcessEnvironment>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+SketchWatcher::SketchWatcher(QObject* parent)
+    : QObject(parent)
+    , m_armed(false)
+    , m_generation(0)
+    , m_settleMs(static_cast<qint64>(1000.0 * std::max(
+          QProcessEnvironment::systemEnvironment().value("GPMS_SKETCH_SETTLE_SECONDS", "3").toDouble(), 0.5)))
+    , m_running(false)
+    , m_feedGeneration(0)
+    , m_changed(false)
+    , m_lastChangeMs(0)
+    , m_beganMs(0)
+{
+}
+
+void SketchWatcher::begin(const cv::Rect& region)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pendingRegion = region;
+        m_still.release();
+    }
+    ++m_generation;
+    m_running = true;
+    m_armed = true;
+}
+
+void SketchWatcher::cancel()
+{
+    m_running = false;
+    m_armed = false;
+}
+
+bool SketchWatcher::isRunning() const
+{
+    return m_running;
+}
+
+cv::Mat SketchWatcher::still()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_still;
+}
+
+int SketchWatcher::intervalMs() const
+{
+    return INTERVAL_MS;
+}
+
+bool SketchWatcher::wantsFrame() const
+{
+    return m_armed;
+}
+
+void SketchWatcher::reset(const cv::Size& frameSize, qint64 timestampMs)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_region = m_pendingRegion;
+    }
+    const cv::Rect frame(cv::Point(0, 0), frameSize);
+    m_region = m_region.empty() ? frame : (m_region & frame);
+
+    const int tile = BLOCK * TILE_BLOCKS;
+    m_tiles = cv::Size((m_region.width + tile - 1) / tile, (m_region.height + tile - 1) / tile);
+    m_counts.assign(m_tiles.area(), 0);
+    m_accumulator.create(m_region.size(), CV_32FC3);
+    m_previous.release();
+    m_changed = false;
+    m_lastChangeMs = timestampMs;
+    m_beganMs = timestampMs;
+}
+
+cv::Rect SketchWatcher::tileRect(int tx, int ty) const
+{
+    const int tile = BLOCK * TILE_BLOCKS;
+    return cv::Rect(tx * tile, ty * tile, tile, tile) & cv::Rect(cv::Point(0, 0), m_region.size());
+}
+
+void SketchWatcher::analyzeFrame(const cv::Mat& frame, qint64 timestampMs)
+{
+    if (!m_armed) {
+        return;
+    }
+
+    const int generation = m_generation;
+    if (generation != m_feedGeneration) {
+        m_feedGeneration = generation;
+        reset(frame.size(), timestampMs);
+    }
+    if (m_region.empty()) {
+        return;
+    }
+    if (timestampMs - m_beganMs < SETTLE_MS) {
+        return; // still switching to the white board; that is not a stroke
+    }
+
+    // Block means are the whole per-tick cost once the board is quiet
+    const cv::Mat region = frame(m_region);
+    const cv::Size blocks((m_region.width + BLOCK - 1) / BLOCK, (m_region.height + BLOCK - 1) / BLOCK);
+    cv::resize(region, m_small, blocks, 0.0, 0.0, cv::INTER_AREA);
+    cv::cvtColor(m_small, m_signature, cv::COLOR_BGR2GRAY);
+    if (m_previous.empty()) {
+        m_signature.copyTo(m_previous);
+        return;
+    }
+    cv::absdiff(m_signature, m_previous, m_diff);
+    std::swap(m_signature, m_previous);
+
+    bool anyChanged = false;
+    bool allSettled = true;
+    for (int ty = 0; ty < m_tiles.height; ++ty) {
+        for (int tx = 0; tx < m_tiles.width; ++tx) {
+            const cv::Rect blockRect = cv::Rect(tx * TILE_BLOCKS, ty * TILE_BLOCKS, TILE_BLOCKS, TILE_BLOCKS)
+                                       & cv::Rect(cv::Point(0, 0), blocks);
+            double change = 0.0;
+            cv::minMaxLoc(m_diff(blockRect), nullptr, &change);
+
+            int& count = m_counts[ty * m_tiles.width + tx];
+            if (change > CHANGE_THRESHOLD) {
+                count = 0; // being drawn on, start its average over once it stops
+                anyChanged = true;
+            } else if (count < STILL_FRAMES) {
+                // Only tiles that changed recently are touched at full resolution
+                const cv::Rect rect = tileRect(tx, ty);
+                cv::Mat sum = m_accumulator(rect);
+                if (count == 0) {
+                    region(rect).convertTo(sum, CV_32FC3);
+                } else {
+                    cv::accumulate(region(rect), sum);
+                }
+                ++count;
+            }
+            allSettled = allSettled && count == STILL_FRAMES;
+        }
+    }
+
+    if (anyChanged) {
+        m_changed = true;
+        m_lastChangeMs = timestampMs;
+        return;
+    }
+    if (!m_changed || !allSettled || timestampMs - m_lastChangeMs < m_settleMs) {
+        return;
+    }
+
+    // Settled: the latest frame, with the watched region replaced by its per-tile averages
+    cv::Mat still = frame.clone();
+    cv::Mat stillRegion = still(m_region);
+    m_accumulator.convertTo(stillRegion, CV_8UC3, 1.0 / STILL_FRAMES);
+    {
+        QMutexLocker locker(&m_mutex);
+        m_still = still;
+    }
+    m_armed = false;
+    qDebug() << "SketchWatcher: sketch settled for" << m_settleMs << "ms";
+    QMetaObject::invokeMethod(this, [this]() {
+        if (m_running) {
+            m_running = false;
+            emit settled();
+        }
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,74 @@
+// sketchwatcher.h
+
+#ifndef SKETCHWATCHER_H
+#define SKETCHWATCHER_H
+
+#include <QObject>
+#include <QMutex>
+#include <atomic>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "utils/livefeed.h"
+
+// Watches a whiteboard in the live feed and reports when a sketch is done:
+// something changed since begin(), and nothing has changed for a few seconds.
+// Frames are ignored for a moment after begin() while the board is lit.
+// The region is split into tiles compared by their 8x8 block means; each tile
+// averages a handful of frames once it stops changing and is left alone after
+// that, so a finished board costs one downscale per tick. The result is the
+// latest frame with the averaged (denoised) region pasted in.
+class SketchWatcher : public QObject, public FrameAnalyzer
+{
+    Q_OBJECT
+
+public:
+    explicit SketchWatcher(QObject* parent = nullptr);
+
+    // GUI thread: region of the (undistorted) frame to watch
+    void begin(const cv::Rect& region);
+    void cancel();
+    bool isRunning() const;
+
+    cv::Mat still(); // valid after settled()
+
+    // FrameAnalyzer, feed thread
+    int intervalMs() const override;
+    bool wantsFrame() const override;
+    void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) override;
+
+signals:
+    void settled();
+
+private:
+    static constexpr int INTERVAL_MS = 100;
+    static constexpr int SETTLE_MS = 600;        // projector and camera exposure catch up with the white board
+    static constexpr int BLOCK = 8;              // px per signature sample
+    static constexpr int TILE_BLOCKS = 4;        // tiles are 32x32 px
+    static constexpr double CHANGE_THRESHOLD = 6.0; // grey levels in any block mean; well above sensor noise
+    static constexpr int STILL_FRAMES = 8;       // averaged per tile once it settles
+
+    std::atomic<bool> m_armed;
+    std::atomic<int> m_generation;
+    qint64 m_settleMs;
+
+    QMutex m_mutex;
+    cv::Rect m_pendingRegion;
+    cv::Mat m_still;
+    bool m_running; // GUI thread
+
+    // Feed thread only
+    int m_feedGeneration;
+    cv::Rect m_region;
+    cv::Size m_tiles;
+    cv::Mat m_small, m_signature, m_previous, m_diff;
+    cv::Mat m_accumulator;     // CV_32FC3 over the region, filled tile by tile
+    std::vector<int> m_counts; // frames accumulated per tile
+    bool m_changed;
+    qint64 m_lastChangeMs;
+    qint64 m_beganMs;          // first frame after begin(); the baseline is taken SETTLE_MS later
+
+    void reset(const cv::Size& frameSize, qint64 timestampMs);
+    cv::Rect tileRect(int tx, int ty) const; // in region coordinates
+};
+
+#endif // SKETCHWATCHER_H
@@ -0,0 +1,243 @@
+// surfacecompensator.cpp
+
+#include "surfacecompensator.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QTimer>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// q in [0, 1]; values is reordered
+float percentile(std::vector<float>& values, double q)
+{
+    if (values.empty()) {
+        return 0.0f;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(q * (values.size() - 1)));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+SurfaceCompensator::SurfaceCompensator(QObject* parent)
+    : QObject(parent)
+    , m_armed(false)
+    , m_generation(0)
+    , m_step(0)
+    , m_framesCaptured(0)
+    , m_running(false)
+    , m_gamma(DEFAULT_GAMMA)
+{
+}
+
+void SurfaceCompensator::begin(const cv::Mat& homography, const cv::Size& projectorSize)
+{
+    if (m_running) {
+        qDebug() << "SurfaceCompensator: already running";
+        return;
+    }
+    if (homography.empty() || projectorSize.area() == 0) {
+        qDebug() << "SurfaceCompensator: needs a calibrated homography";
+        emit finished(false);
+        return;
+    }
+
+    m_homography = homography;
+    m_projectorSize = projectorSize;
+    m_running = true;
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_generation;
+        m_step = 0;
+    }
+    requestLevel();
+}
+
+bool SurfaceCompensator::isRunning() const
+{
+    return m_running;
+}
+
+// Levels already captured by the feed thread are dropped on arrival: they carry the old generation
+void SurfaceCompensator::cancel()
+{
+    m_running = false;
+    m_armed = false;
+
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_framesCaptured = 0;
+    m_accumulator.release();
+    for (cv::Mat& capture : m_captures) {
+        capture.release();
+    }
+}
+
+const cv::Mat& SurfaceCompensator::gainMap() const
+{
+    return m_gain;
+}
+
+const cv::Mat& SurfaceCompensator::offsetMap() const
+{
+    return m_offset;
+}
+
+double SurfaceCompensator::gamma() const
+{
+    return m_gamma;
+}
+
+int SurfaceCompensator::intervalMs() const
+{
+    return INTERVAL_MS;
+}
+
+bool SurfaceCompensator::wantsFrame() const
+{
+    return m_armed.load();
+}
+
+// Project the current level, then arm the capture once the picture has settled
+void SurfaceCompensator::requestLevel()
+{
+    int step;
+    {
+        QMutexLocker locker(&m_mutex);
+        step = m_step;
+        m_framesCaptured = 0;
+        m_accumulator.release();
+    }
+
+    emit levelRequested(LEVELS[step]);
+    const int generation = m_generation;
+    QTimer::singleShot(SETTLE_MS, this, [this, generation]() {
+        m_armed = m_running && generation == m_generation;
+    });
+}
+
+void SurfaceCompensator::analyzeFrame(const cv::Mat& frame, qint64 timestampMs)
+{
+    Q_UNUSED(timestampMs);
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_armed) {
+        return;
+    }
+
+    if (m_accumulator.size() != frame.size()) {
+        m_accumulator = cv::Mat::zeros(frame.size(), CV_32FC3);
+    }
+    cv::accumulate(frame, m_accumulator);
+
+    if (++m_framesCaptured < FRAMES_PER_LEVEL) {
+        return;
+    }
+
+    // Averaging takes the sensor noise out of the measurement
+    m_accumulator.convertTo(m_captures[m_step], CV_32FC3, 1.0 / FRAMES_PER_LEVEL);
+    m_armed = false;
+    const int generation = m_generation;
+    QMetaObject::invokeMethod(this, [this, generation]() { onLevelCaptured(generation); }, Qt::QueuedConnection);
+}
+
+void SurfaceCompensator::onLevelCaptured(int generation)
+{
+    if (!m_running || generation != m_generation) {
+        return; // cancelled while the last frames were on their way
+    }
+
+    bool done;
+    {
+        QMutexLocker locker(&m_mutex);
+        done = ++m_step >= LEVEL_COUNT;
+    }
+
+    if (!done) {
+        requestLevel();
+        return;
+    }
+
+    const bool success = computeMaps();
+    m_running = false;
+    for (cv::Mat& capture : m_captures) {
+        capture.release();
+    }
+    emit finished(success);
+}
+
+bool SurfaceCompensator::computeMaps()
+{
+    const cv::Size mapSize(m_projectorSize.width / MAP_SCALE, m_projectorSize.height / MAP_SCALE);
+
+    // Camera -> reduced projector grid; blur first so the 8x reduction doesn't alias surface texture
+    const cv::Matx33d toMap = cv::Matx33d(1.0 / MAP_SCALE, 0.0, 0.0,
+                                          0.0, 1.0 / MAP_SCALE, 0.0,
+                                          0.0, 0.0, 1.0) * m_homography;
+    cv::Mat projected[LEVEL_COUNT];
+    for (int i = 0; i < LEVEL_COUNT; ++i) {
+        cv::Mat smoothed;
+        cv::blur(m_captures[i], smoothed, cv::Size(MAP_SCALE + 1, MAP_SCALE + 1));
+        cv::warpPerspective(smoothed, projected[i], toMap, mapSize, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    }
+
+    // One value per pixel and channel
+    const cv::Mat black = projected[0].reshape(1);
+    const cv::Mat grey = projected[1].reshape(1);
+    const cv::Mat white = projected[2].reshape(1);
+    const int count = static_cast<int>(black.total());
+    const float* b = black.ptr<float>();
+    const float* g = grey.ptr<float>();
+    const float* w = white.ptr<float>();
+
+    // Target range every pixel can reach: the brightest black to the dimmest white (robustly),
+    // shared across channels so the tint of the surface goes too
+    std::vector<float> blacks(b, b + count), whites(w, w + count);
+    const float lo = percentile(blacks, 0.95);
+    const float hi = percentile(whites, 0.05);
+    if (hi - lo < MIN_RANGE) {
+        qDebug() << "SurfaceCompensator: usable range too small (" << lo << "to" << hi
+                 << "), too much ambient light or too dark a surface";
+        return false;
+    }
+
+    // Projector gamma from where mid grey lands between black and white
+    std::vector<float> gammas;
+    const double logHalf = std::log(128.0 / 255.0);
+    for (int i = 0; i < count; ++i) {
+        const float range = w[i] - b[i];
+        if (range < MIN_RANGE) {
+            continue;
+        }
+        const float ratio = (g[i] - b[i]) / range;
+        if (ratio > 0.02f && ratio < 0.98f) {
+            gammas.push_back(static_cast<float>(std::log(ratio) / logHalf));
+        }
+    }
+    m_gamma = gammas.empty() ? DEFAULT_GAMMA : std::min(std::max(static_cast<double>(percentile(gammas, 0.5)), 1.0), 3.0);
+
+    // Linear light needed from each pixel so it shows lo + (hi - lo) * content
+    m_gain.create(mapSize, CV_32FC3);
+    m_offset.create(mapSize, CV_32FC3);
+    float* gain = m_gain.ptr<float>();
+    float* offset = m_offset.ptr<float>();
+    for (int i = 0; i < count; ++i) {
+        const float range = w[i] - b[i];
+        if (range < MIN_PIXEL_RANGE) {
+            gain[i] = 1.0f; // outside the projector's reach, leave it alone
+            offset[i] = 0.0f;
+            continue;
+        }
+        gain[i] = (hi - lo) / range;
+        offset[i] = 255.0f * (lo - b[i]) / range;
+    }
+
+    qDebug() << "SurfaceCompensator: range" << lo << "to" << hi << "gamma" << m_gamma;
+    return true;
+}
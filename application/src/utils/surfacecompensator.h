@@ -0,0 +1,74 @@
+// surfacecompensator.h
+
+#ifndef SURFACECOMPENSATOR_H
+#define SURFACECOMPENSATOR_H
+
+#include <QObject>
+#include <QMutex>
+#include <atomic>
+#include <opencv2/core.hpp>
+#include "utils/livefeed.h"
+
+// Measures how the projection surface responds by projecting flat black, grey
+// and white and averaging a few live frames of each. From that it derives
+// per-pixel gain/offset maps (projector space, reduced resolution) that even
+// out texture, tint and falloff, and the projector's gamma.
+class SurfaceCompensator : public QObject, public FrameAnalyzer
+{
+    Q_OBJECT
+
+public:
+    explicit SurfaceCompensator(QObject* parent = nullptr);
+
+    // GUI thread: start the sequence; homography maps camera pixels to projector pixels
+    void begin(const cv::Mat& homography, const cv::Size& projectorSize);
+    bool isRunning() const;
+    void cancel(); // abandons the sequence without emitting finished()
+
+    // Valid after finished(true)
+    const cv::Mat& gainMap() const;
+    const cv::Mat& offsetMap() const;
+    double gamma() const;
+
+    // FrameAnalyzer, feed thread
+    int intervalMs() const override;
+    bool wantsFrame() const override;
+    void analyzeFrame(const cv::Mat& frame, qint64 timestampMs) override;
+
+signals:
+    void levelRequested(int level); // project this flat level across the whole output
+    void finished(bool success);
+
+private:
+    static constexpr int LEVEL_COUNT = 3;
+    static constexpr int LEVELS[LEVEL_COUNT] = {0, 128, 255}; // black, grey, white
+    static constexpr int SETTLE_MS = 600;        // projector and camera exposure catch up
+    static constexpr int FRAMES_PER_LEVEL = 4;
+    static constexpr int INTERVAL_MS = 100;
+    static constexpr int MAP_SCALE = 8;          // maps are 1/8 of the projector resolution
+    static constexpr float MIN_RANGE = 24.0f;    // usable black-to-white range, camera units
+    static constexpr float MIN_PIXEL_RANGE = 8.0f;
+    static constexpr double DEFAULT_GAMMA = 2.2;
+
+    // Shared with the feed thread
+    QMutex m_mutex;
+    std::atomic<bool> m_armed;
+    int m_generation; // written on the GUI thread; a new one for every begin() and cancel()
+    int m_step;
+    int m_framesCaptured;
+    cv::Mat m_accumulator;
+    cv::Mat m_captures[LEVEL_COUNT];
+
+    // GUI thread only
+    bool m_running;
+    cv::Matx33d m_homography;
+    cv::Size m_projectorSize;
+    cv::Mat m_gain, m_offset;
+    double m_gamma;
+
+    void requestLevel();
+    void onLevelCaptured(int generation);
+    bool computeMaps();
+};
+
+#endif // SURFACECOMPENSATOR_H
@@ -0,0 +1,213 @@
+// surfacesegmentation.cpp
+
+#include "surfacesegmentation.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace SurfaceSegmentation {
+
+namespace {
+
+constexpr int COARSE_MAX_WIDTH = 320;    // pyramid level the first pass runs on
+constexpr int COARSE_ITERATIONS = 3;
+constexpr int REFINE_ITERATIONS = 1;
+constexpr int REFINE_BAND = 6;           // px (full res) either side of the coarse edge left undecided
+constexpr double SEED_RADIUS = 0.03;     // fraction of the frame width that is surely surface
+constexpr int FLOOD_TOLERANCE = 12;      // colour distance for the initial guess around the seed
+constexpr double MIN_AREA = 0.01;        // fraction of the frame; smaller results are rejected
+constexpr double OUTLINE_EPSILON = 0.004; // fraction of the perimeter
+
+// Nearest pixel of a mat of the given size; rounding a point in the last column or row can land past it
+cv::Point pixelAt(const cv::Point2f& point, const cv::Size& size)
+{
+    return cv::Point(std::min(std::max(cvRound(point.x), 0), size.width - 1),
+                     std::min(std::max(cvRound(point.y), 0), size.height - 1));
+}
+
+// The binary region of mask (GC_FGD / GC_PR_FGD) connected to seed
+cv::Mat seedComponent(const cv::Mat& gcMask, const cv::Point& seed)
+{
+    if (!cv::Rect(0, 0, gcMask.cols, gcMask.rows).contains(seed)) {
+        return cv::Mat();
+    }
+    cv::Mat foreground = gcMask & cv::Scalar(1); // GC_FGD and GC_PR_FGD are the odd values
+    foreground *= 255;
+
+    cv::Mat component = cv::Mat::zeros(foreground.rows + 2, foreground.cols + 2, CV_8UC1);
+    if (foreground.at<uchar>(seed) == 0) {
+        return cv::Mat();
+    }
+    cv::floodFill(foreground, component, seed, cv::Scalar(255), nullptr, cv::Scalar(), cv::Scalar(),
+                  4 | cv::FLOODFILL_MASK_ONLY | (255 << 8));
+    return component(cv::Rect(1, 1, foreground.cols, foreground.rows)).clone();
+}
+
+// GrabCut needs samples of both classes to fit its colour models, and throws otherwise
+bool hasBothLabels(const cv::Mat& gcMask)
+{
+    const int foreground = cv::countNonZero(gcMask & cv::Scalar(1)); // GC_FGD and GC_PR_FGD
+    return foreground > 0 && foreground < static_cast<int>(gcMask.total());
+}
+
+// Simplify the outline to four corners; falls back to the minimum-area rectangle
+std::array<cv::Point2f, 4> fitQuad(const std::vector<cv::Point>& contour)
+{
+    const double perimeter = cv::arcLength(contour, true);
+    std::vector<cv::Point> approx;
+    for (double epsilon = 0.01; epsilon <= 0.1; epsilon += 0.01) {
+        cv::approxPolyDP(contour, approx, epsilon * perimeter, true);
+        if (approx.size() <= 4) {
+            break;
+        }
+    }
+
+    std::array<cv::Point2f, 4> quad;
+    if (approx.size() == 4 && cv::isContourConvex(approx)) {
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = approx[i];
+        }
+    } else {
+        cv::Point2f box[4];
+        cv::minAreaRect(contour).points(box);
+        std::copy(box, box + 4, quad.begin());
+    }
+
+    // Clockwise (in image coordinates) from the corner closest to the top left
+    cv::Point2f centre(0.0f, 0.0f);
+    for (const cv::Point2f& point : quad) {
+        centre += point * 0.25f;
+    }
+    std::sort(quad.begin(), quad.end(), [centre](const cv::Point2f& a, const cv::Point2f& b) {
+        return std::atan2(a.y - centre.y, a.x - centre.x) < std::atan2(b.y - centre.y, b.x - centre.x);
+    });
+    const auto topLeft = std::min_element(quad.begin(), quad.end(), [](const cv::Point2f& a, const cv::Point2f& b) {
+        return a.x + a.y < b.x + b.y;
+    });
+    std::rotate(quad.begin(), topLeft, quad.end());
+    return quad;
+}
+
+} // namespace
+
+bool findSurface(const cv::Mat& frame, const cv::Point2f& seed,
+                 std::vector<cv::Point2f>& outline, std::array<cv::Point2f, 4>& quad)
+{
+    if (frame.empty() || frame.type() != CV_8UC3 || !cv::Rect(0, 0, frame.cols, frame.rows).contains(seed)) {
+        qDebug() << "findSurface: needs a BGR frame and a seed inside it";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Coarse pass on a small pyramid level
+    cv::Mat coarse = frame;
+    int scale = 1;
+    while (coarse.cols > COARSE_MAX_WIDTH) {
+        cv::pyrDown(coarse, coarse);
+        scale *= 2;
+    }
+    const cv::Point coarseSeed = pixelAt(seed * (1.0f / scale), coarse.size());
+
+    // Initial guess: similar colours flooding out from the seed are probably surface,
+    // a small disc around the seed surely is, everything else is probably background
+    cv::Mat gcMask(coarse.size(), CV_8UC1, cv::Scalar(cv::GC_PR_BGD));
+    cv::Mat flood = cv::Mat::zeros(coarse.rows + 2, coarse.cols + 2, CV_8UC1);
+    cv::Mat blurred;
+    cv::GaussianBlur(coarse, blurred, cv::Size(5, 5), 0);
+    cv::floodFill(blurred, flood, coarseSeed, cv::Scalar(), nullptr, cv::Scalar::all(FLOOD_TOLERANCE),
+                  cv::Scalar::all(FLOOD_TOLERANCE), 8 | cv::FLOODFILL_MASK_ONLY | (255 << 8));
+    gcMask.setTo(cv::GC_PR_FGD, flood(cv::Rect(1, 1, coarse.cols, coarse.rows)));
+    cv::circle(gcMask, coarseSeed, std::max(2, cvRound(SEED_RADIUS * coarse.cols)), cv::Scalar(cv::GC_FGD), -1);
+
+    // A large uniform wall floods the whole frame: nothing is left to tell the surface from
+    if (!hasBothLabels(gcMask)) {
+        qDebug() << "findSurface: no background around the seed";
+        return false;
+    }
+
+    cv::Mat bgdModel, fgdModel;
+    try {
+        cv::grabCut(coarse, gcMask, cv::Rect(), bgdModel, fgdModel, COARSE_ITERATIONS, cv::GC_INIT_WITH_MASK);
+    } catch (const cv::Exception& e) {
+        qDebug() << "findSurface: coarse pass failed:" << e.what();
+        return false;
+    }
+
+    cv::Mat coarseSurface = seedComponent(gcMask, coarseSeed);
+    if (coarseSurface.empty()) {
+        qDebug() << "findSurface: the seed ended up in the background";
+        return false;
+    }
+    const qint64 coarseMs = timer.elapsed();
+
+    // Refine at full resolution: only a band around the coarse edge is left for GrabCut to decide,
+    // and only within the surface's bounding box (plus the band)
+    cv::Mat surface;
+    cv::resize(coarseSurface, surface, frame.size(), 0, 0, cv::INTER_LINEAR);
+    cv::threshold(surface, surface, 127, 255, cv::THRESH_BINARY);
+
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    cv::Rect box = cv::boundingRect(surface);
+    const int margin = REFINE_BAND + scale;
+    box = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & frameRect;
+
+    const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * REFINE_BAND + 1, 2 * REFINE_BAND + 1));
+    cv::Mat inner, outer;
+    cv::erode(surface(box), inner, kernel);
+    cv::dilate(surface(box), outer, kernel);
+
+    cv::Mat refineMask(box.size(), CV_8UC1, cv::Scalar(cv::GC_BGD));
+    refineMask.setTo(cv::GC_PR_BGD, outer);
+    refineMask.setTo(cv::GC_PR_FGD, surface(box));
+    refineMask.setTo(cv::GC_FGD, inner);
+
+    // A box clipped by the frame edges may hold no background at all; the coarse result stands then
+    cv::Mat refined;
+    if (hasBothLabels(refineMask)) {
+        try {
+            cv::grabCut(frame(box), refineMask, cv::Rect(), bgdModel, fgdModel, REFINE_ITERATIONS, cv::GC_INIT_WITH_MASK);
+            const cv::Point boxSeed = pixelAt(seed - cv::Point2f(box.tl()), box.size());
+            refined = seedComponent(refineMask, boxSeed);
+        } catch (const cv::Exception& e) {
+            qDebug() << "findSurface: refinement failed:" << e.what();
+        }
+    }
+    if (refined.empty()) {
+        refined = surface(box).clone(); // refinement lost the seed, keep the coarse result
+    }
+
+    // Outline of the surface in frame coordinates
+    std::vector<std::vector<cv::Point>> contours;
+    cv::findContours(refined, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, box.tl());
+    const auto largest = std::max_element(contours.begin(), contours.end(),
+                                          [](const std::vector<cv::Point>& a, const std::vector<cv::Point>& b) {
+                                              return cv::contourArea(a) < cv::contourArea(b);
+                                          });
+    if (largest == contours.end() || cv::contourArea(*largest) < MIN_AREA * frame.total()) {
+        qDebug() << "findSurface: surface too small";
+        return false;
+    }
+
+    std::vector<cv::Point> simplified;
+    cv::approxPolyDP(*largest, simplified, OUTLINE_EPSILON * cv::arcLength(*largest, true), true);
+    outline.assign(simplified.begin(), simplified.end());
+    quad = fitQuad(*largest);
+
+    qDebug() << "findSurface:" << outline.size() << "outline points in" << timer.elapsed()
+             << "ms (coarse" << coarseMs << "ms at 1/" << scale << ")";
+    return true;
+}
+
+Surface findSurface(const cv::Mat& frame, const cv::Point2f& seed)
+{
+    Surface surface;
+    surface.found = findSurface(frame, seed, surface.outline, surface.quad);
+    return surface;
+}
+
+} // namespace SurfaceSegmentation
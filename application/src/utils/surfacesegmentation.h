@@ -0,0 +1,32 @@
+// surfacesegmentation.h
+
+#ifndef SURFACESEGMENTATION_H
+#define SURFACESEGMENTATION_H
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <vector>
+
+namespace SurfaceSegmentation {
+
+// Segments the surface under seed with GrabCut: a coarse pass on a downscaled
+// pyramid level, then a single refinement pass at full resolution limited to
+// the surface's bounding box. Produces the surface outline (for the projection
+// mask) and the quad that best fits it (for the corners, clockwise from the
+// top left). Returns false if nothing sensible was found, including when the
+// tap lands on something so uniform that GrabCut has no background to learn.
+// Takes a few hundred ms at camera resolution; const inputs only, any thread.
+bool findSurface(const cv::Mat& frame, const cv::Point2f& seed,
+                 std::vector<cv::Point2f>& outline, std::array<cv::Point2f, 4>& quad);
+
+// findSurface's results as one value, for running it off the GUI thread
+struct Surface {
+    bool found = false;
+    std::vector<cv::Point2f> outline;
+    std::array<cv::Point2f, 4> quad;
+};
+Surface findSurface(const cv::Mat& frame, const cv::Point2f& seed);
+
+} // namespace SurfaceSegmentation
+
+#endif // SURFACESEGMENTATION_H
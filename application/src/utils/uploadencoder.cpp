@@ -0,0 +1,120 @@
+// uploadencoder.cpp
+
+#include "uploadencoder.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QProcessEnvironment>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <vector>
+
+UploadEncoder::UploadEncoder()
+    : m_mode(Mode::EDGES)
+    , m_codec(Codec::PNG)
+    , m_param(DEFAULT_PNG_LEVEL)
+{
+    const QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    const QString mode = env.value("GPMS_UPLOAD_MODE", "edges").trimmed().toLower();
+    if (mode == "photo") {
+        m_mode = Mode::PHOTO;
+    } else if (mode != "edges") {
+        qDebug() << "UploadEncoder: unknown mode" << mode << "- uploading edges";
+    }
+
+    const QString setting = env.value("GPMS_UPLOAD_CODEC", "png").trimmed().toLower();
+    const QString name = setting.section(':', 0, 0);
+    bool hasParam = false;
+    const int param = setting.section(':', 1, 1).toInt(&hasParam);
+
+    if (name == "jpeg" || name == "jpg") {
+        m_codec = Codec::JPEG;
+        m_param = hasParam ? std::clamp(param, 1, 100) : DEFAULT_JPEG_QUALITY;
+    } else if (name == "webp") {
+        m_codec = Codec::WEBP;
+        m_param = hasParam ? std::clamp(param, 1, 101) : DEFAULT_WEBP_QUALITY;
+    } else {
+        if (name != "png") {
+            qDebug() << "UploadEncoder: unknown codec" << setting << "- using png";
+        }
+        m_codec = Codec::PNG;
+        m_param = hasParam ? std::clamp(param, 0, 9) : DEFAULT_PNG_LEVEL;
+    }
+}
+
+UploadEncoder::Codec UploadEncoder::codec() const
+{
+    return m_codec;
+}
+
+UploadEncoder::Mode UploadEncoder::mode() const
+{
+    return m_mode;
+}
+
+UploadPayload UploadEncoder::encode(const cv::Mat& image) const
+{
+    if (image.empty()) {
+        return UploadPayload();
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    UploadPayload payload;
+    std::vector<int> params;
+    const char* extension = ".png";
+
+    cv::Mat source = image;
+    if (m_mode == Mode::EDGES) {
+        // Already at generation resolution; one bit per pixel, and deflate all but run-length codes the gaps
+        params = { cv::IMWRITE_PNG_BILEVEL, 1, cv::IMWRITE_PNG_COMPRESSION, 9 };
+        payload.mimeType = "image/png";
+        payload.fileName = "edges.png";
+        payload.mode = "edges";
+    } else {
+        if (image.cols > MAX_WIDTH || image.rows > MAX_HEIGHT) {
+            const double scale = std::min(static_cast<double>(MAX_WIDTH) / image.cols,
+                                          static_cast<double>(MAX_HEIGHT) / image.rows);
+            cv::resize(image, source, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+
+        payload.mode = "photo";
+        switch (m_codec) {
+        case Codec::JPEG:
+            extension = ".jpg";
+            params = { cv::IMWRITE_JPEG_QUALITY, m_param };
+            payload.mimeType = "image/jpeg";
+            payload.fileName = "image.jpg";
+            break;
+        case Codec::WEBP:
+            extension = ".webp";
+            params = { cv::IMWRITE_WEBP_QUALITY, m_param };
+            payload.mimeType = "image/webp";
+            payload.fileName = "image.webp";
+            break;
+        case Codec::PNG:
+            params = { cv::IMWRITE_PNG_COMPRESSION, m_param };
+            payload.mimeType = "image/png";
+            payload.fileName = "image.png";
+            break;
+        }
+    }
+
+    std::vector<uchar> buffer;
+    try {
+        if (!cv::imencode(extension, source, buffer, params)) {
+            qDebug() << "UploadEncoder: failed to encode" << extension;
+            return UploadPayload();
+        }
+    } catch (const cv::Exception& e) {
+        qDebug() << "UploadEncoder: failed to encode" << extension << e.what();
+        return UploadPayload();
+    }
+
+    payload.data = QByteArray(reinterpret_cast<const char*>(buffer.data()), static_cast<int>(buffer.size()));
+    qDebug() << "UploadEncoder:" << source.cols << "x" << source.rows << "to" << payload.data.size()
+             << "bytes of" << payload.mimeType << "in" << clock.elapsed() << "ms";
+    return payload;
+}
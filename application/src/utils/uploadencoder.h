@@ -0,0 +1,51 @@
+// uploadencoder.h
+
+#ifndef UPLOADENCODER_H
+#define UPLOADENCODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <opencv2/core.hpp>
+
+// An encoded image ready to go into a multipart upload. The bytes are
+// implicitly shared, so every request built from it points at one buffer.
+struct UploadPayload {
+    QByteArray data;
+    QByteArray mimeType;
+    QString fileName;
+    QString mode; // "photo" or "edges", tells the server what it is getting
+
+    bool isEmpty() const { return data.isEmpty(); }
+};
+
+// Encodes the still region for the generation server with the codec picked by
+// GPMS_UPLOAD_CODEC: "png[:level]" (default, level 1), "jpeg[:quality]" or
+// "webp[:quality]" (101 is lossless). The server only traces edges and resizes
+// to 640x360, so a fast PNG level or a high JPEG quality loses nothing it uses.
+// GPMS_UPLOAD_MODE=edges uploads the previewed edge map instead (see EdgeMap)
+// as a 1-bit PNG, whatever the codec; the server then skips its own tracing.
+// encode() is const and keeps no state, so it may run on any thread.
+class UploadEncoder
+{
+public:
+    enum class Codec { PNG, JPEG, WEBP };
+    enum class Mode { PHOTO, EDGES };
+
+    UploadEncoder();
+
+    UploadPayload encode(const cv::Mat& image) const; // the still region, or the edge map in EDGES mode; empty on failure
+    Codec codec() const;
+    Mode mode() const;
+
+private:
+    static constexpr int MAX_WIDTH = 1280, MAX_HEIGHT = 720; // generation runs at ~1MP anyway
+    static constexpr int DEFAULT_PNG_LEVEL = 1;
+    static constexpr int DEFAULT_JPEG_QUALITY = 95;
+    static constexpr int DEFAULT_WEBP_QUALITY = 90;
+
+    Mode m_mode;
+    Codec m_codec;
+    int m_param; // PNG compression level, or JPEG/WebP quality
+};
+
+#endif // UPLOADENCODER_H
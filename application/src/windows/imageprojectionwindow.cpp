@@ -6,17 +6,24 @@
 #include <QPixmap>
 #include <QTransform>
 #include <QPainter>
+#include <QProcessEnvironment>
+#include <algorithm>
+#include <cmath>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include "utils/edgemap.h"
 
 // Constructor
 ImageProjectionWindow::ImageProjectionWindow(QWidget* parent)
     : QWidget(parent, Qt::Window | Qt::FramelessWindowHint)  // Changed from QWidget constructor // | Qt::FramelessWindowHint
     , m_loSensitivity(50) // Default sensitivity values
     , m_hiSensitivity(150)
+    , m_maskFeather(QProcessEnvironment::systemEnvironment().value("GPMS_MASK_FEATHER", "16").toInt())
+    , m_blendWidth(QProcessEnvironment::systemEnvironment().value("GPMS_BLEND_WIDTH", "60").toInt())
     , m_state(projectionState::LOGO)
     , m_rainbowTimer(new QTimer(this))
-    , m_frameCount(0)
+    , m_panZoomSeconds(std::max(QProcessEnvironment::systemEnvironment().value("GPMS_PAN_ZOOM_SECONDS", "30").toDouble(), 1.0))
+    , m_panZoomTimer(new QTimer(this))
 {
 
     setAttribute(Qt::WA_DeleteOnClose, false);
@@ -29,16 +36,31 @@ ImageProjectionWindow::ImageProjectionWindow(QWidget* parent)
     // Set fixed size
     setFixedSize(FIXED_SIZE);
 
+    m_outputs.emplace_back(nullptr); // this window; showOnProjector adds the others
+    m_rainbowClock.start();
+    m_rippleClock.start();
+
+    updateRegionOfInterest(); // whole frame until corners are chosen
+
     setupUI();
     setProjectionState(projectionState::LOGO); // Initialize with LOGO state
 
     connect(m_rainbowTimer, &QTimer::timeout, this, &ImageProjectionWindow::updateRainbowEdges);
+    connect(m_panZoomTimer, &QTimer::timeout, this, &ImageProjectionWindow::activateImage);
+}
+
+ImageProjectionWindow::Output::Output(ProjectorOutput* window)
+    : window(window)
+    , renderer(cv::Size(WIDTH, HEIGHT))
+    , worker(window ? new RenderWorker() : nullptr)
+{
 }
 
 // attempt to show on projector
 void ImageProjectionWindow::showOnProjector()
 {
-    QScreen* projectorScreen = findProjectorScreen();
+    const QList<QScreen*> projectorScreens = findProjectorScreens();
+    QScreen* projectorScreen = projectorScreens.isEmpty() ? nullptr : projectorScreens.first();
 
     if (projectorScreen) {
         qDebug() << "Moving to projector screen:" << projectorScreen->name();
@@ -55,34 +77,76 @@ void ImageProjectionWindow::showOnProjector()
         setWindowFlags(windowFlags() & ~Qt::WindowStaysOnTopHint);
     }
 
+    loadColorLut(m_outputs.front(), projectorScreen ? projectorScreen->name() : QString("default"));
+
+    // Every further projector screen gets an output of its own
+    for (int i = 1; i < projectorScreens.size(); ++i) {
+        if (i >= getOutputCount()) {
+            m_outputs.emplace_back(new ProjectorOutput(FIXED_SIZE, this));
+        }
+        m_outputs[i].window->showOnScreen(projectorScreens[i]);
+        loadColorLut(m_outputs[i], projectorScreens[i]->name());
+    }
+    qDebug() << "Projecting on" << getOutputCount() << "output(s)";
+
+    setProjectionState(m_state);
+
     show();
     debugPositionInfo();
     raise();
     activateWindow();
 }
 
-QScreen* ImageProjectionWindow::findProjectorScreen()
+// Each projector gets its own colour correction, if one has been made for it
+void ImageProjectionWindow::loadColorLut(Output& output, const QString& screenName)
+{
+    ColorLut lut;
+    const QString path = ColorLut::pathForScreen(screenName);
+    if (lut.load(path)) {
+        output.renderer.setColorLut(lut);
+    } else {
+        qDebug() << "No colour LUT for" << screenName << "at" << path;
+        output.renderer.clearColorLut();
+    }
+}
+
+// Projector screens in output order: the ones named in GPMS_PROJECTOR_SCREENS (comma separated),
+// otherwise every screen but the primary
+QList<QScreen*> ImageProjectionWindow::findProjectorScreens()
 {
     const QList<QScreen*>& screens = QApplication::screens();
     QScreen* primaryScreen = QApplication::primaryScreen();
+    QList<QScreen*> projectorScreens;
+
+    const QString names = QProcessEnvironment::systemEnvironment().value("GPMS_PROJECTOR_SCREENS");
+    if (!names.isEmpty()) {
+        for (const QString& name : names.split(',')) {
+            for (QScreen* screen : screens) {
+                if (screen->name() == name.trimmed()) {
+                    projectorScreens.append(screen);
+                }
+            }
+        }
+        qDebug() << "GPMS_PROJECTOR_SCREENS matched" << projectorScreens.size() << "screen(s)";
+        return projectorScreens;
+    }
 
     if (screens.size() <= 1) {
         qDebug() << "Only found 1 screen";
-        return nullptr;
+        return projectorScreens;
     }
 
-    // First try to find a screen that matches projector characteristics
     for (QScreen* screen : screens) {
         if (screen != primaryScreen) {
             QRect screenGeometry = screen->geometry();
             qDebug() << "Found screen:" << screen->name()
                      << "Geometry:" << screenGeometry
                      << "Size:" << screen->size();
-            return screen;  // Return first non-primary screen
+            projectorScreens.append(screen);
         }
     }
 
-    return nullptr;
+    return projectorScreens;
 }
 
 // Setup UI
@@ -126,7 +190,7 @@ void ImageProjectionWindow::debugPositionInfo()
 }
 
 // Setters
-void ImageProjectionWindow::setStillFrame(const cv::Mat &mat)
+void ImageProjectionWindow::setStillFrame(const cv::Mat &mat, bool undistorted)
 {
     if (mat.empty()) {
         qDebug() << "Empty Mat provided to setStillFrame.";
@@ -134,17 +198,23 @@ void ImageProjectionWindow::setStillFrame(const cv::Mat &mat)
     }
 
     m_updateEdgeDetectionFrame = true;
+    m_updateStillRegion = true;
     m_stillFrame = mat.clone();
+    m_stillFrameUndistorted = undistorted;
+    updateRegionOfInterest();
 }
 
-void ImageProjectionWindow::setFinalFrame(const cv::Mat &mat)
+// Generated images arrive RGB; the renderer swizzles them as it samples, so they are kept as they are
+void ImageProjectionWindow::setFinalFrame(const cv::Mat &mat, ChannelOrder order)
 {
     if (mat.empty()) {
         qDebug() << "Empty Mat provided to setStillFrame.";
         return;
     }
 
-    m_finalFrame = mat.clone();
+    m_finalFrame = mat; // callers hand over a fresh image and never write to it again
+    m_finalFrameOrder = order;
+    m_finalFrameRegion = m_roi; // generated from the current crop; stays anchored there if corners drift
     setProjectionState(m_state);
 }
 
@@ -160,23 +230,295 @@ void ImageProjectionWindow::setSensitivity(int lo, int hi)
 
 void ImageProjectionWindow::setTransformCorners(const std::array<cv::Point2f, 4>& transformCorners)
 {
-    m_transformCorners = transformCorners;
-    m_updatePerspectiveMatrix = true;
+    setActiveCorners(transformCorners);
     setProjectionState(projectionState::EDGE_DETECTION);
 }
 
-void ImageProjectionWindow::setProjectionState(projectionState state)
+// Incremental corner corrections (drift tracking); re-renders whatever is currently projected.
+// The still was taken before the drift, so it stays cropped with the ROI it was captured under:
+// cropping it with the drifted quad's ROI would shift its content along with the corners
+void ImageProjectionWindow::refineTransformCorners(const std::array<cv::Point2f, 4>& transformCorners)
 {
-    // Check if the current state is RAINBOW_EDGE and the new state is different
-    if (m_state == projectionState::RAINBOW_EDGE && state != projectionState::RAINBOW_EDGE) {
-        if (m_rainbowTimer->isActive()) {
-            m_rainbowTimer->stop();
-            qDebug() << "Rainbow timer stopped as state changed from RAINBOW_EDGE to another state.";
-        } else {
-            qDebug() << "Rainbow timer was not active when changing state from RAINBOW_EDGE.";
+    setActiveCorners(transformCorners, true);
+
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+    // RAINBOW_EDGE picks the new corners up on its next tick
+}
+
+// Still frames arrive as captured; the lens correction is applied when cropping to the ROI
+void ImageProjectionWindow::setCameraModel(const CameraModel& cameraModel)
+{
+    m_cameraModel = cameraModel;
+    m_updateStillRegion = true;
+    m_updateEdgeDetectionFrame = true;
+    updateRegionOfInterest();
+}
+
+// Uniform grey across the whole projector frame, used to measure the surface's response
+void ImageProjectionWindow::setFlatLevel(int level)
+{
+    m_flatLevel = std::min(std::max(level, 0), 255);
+    setProjectionState(projectionState::FLAT);
+}
+
+void ImageProjectionWindow::setCompensation(const cv::Mat& gain, const cv::Mat& offset, double gamma)
+{
+    activeOutput().renderer.setCompensation(gain, offset, gamma);
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+void ImageProjectionWindow::clearCompensation()
+{
+    activeOutput().renderer.clearCompensation();
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+// Polygon drawn on the still frame; stored in each output's projector space so it stays put if the corners are refined
+void ImageProjectionWindow::setMaskPolygon(const std::vector<cv::Point2f>& stillPolygon)
+{
+    if (stillPolygon.size() < 3) {
+        clearMask();
+        return;
+    }
+
+    for (Output& output : m_outputs) {
+        output.calibration.maskPolygon.clear();
+        if (output.calibration.calibrated) {
+            cv::perspectiveTransform(stillPolygon, output.calibration.maskPolygon, output.calibration.perspectiveMatrix);
+        }
+    }
+    updateOutputMasks();
+
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+void ImageProjectionWindow::setMaskFeather(int pixels)
+{
+    m_maskFeather = std::max(pixels, 0);
+    updateOutputMasks();
+
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+void ImageProjectionWindow::clearMask()
+{
+    for (Output& output : m_outputs) {
+        output.calibration.maskPolygon.clear();
+    }
+    updateOutputMasks();
+
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+void ImageProjectionWindow::setPanZoom(bool enabled)
+{
+    if (enabled && !m_panZoom) {
+        m_panZoomClock.start();
+    }
+    m_panZoom = enabled;
+
+    if (m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+}
+
+void ImageProjectionWindow::setAudioAnalyzer(const AudioAnalyzer* analyzer)
+{
+    m_audio = analyzer;
+    m_audioBrightness = 1.0f;
+    m_audioSampleTimeNs = 0;
+    setProjectionState(m_state);
+}
+
+void ImageProjectionWindow::addRipples(const QPolygonF& stillPoints)
+{
+    if (m_state != projectionState::EDGE_DETECTION && m_state != projectionState::RAINBOW_EDGE
+        && m_state != projectionState::IMAGE) {
+        return; // nothing to interact with while calibrating or measuring
+    }
+
+    const qint64 now = m_rippleClock.elapsed();
+    bool added = false;
+    for (const QPointF& point : stillPoints) {
+        const cv::Point2f center(static_cast<float>(point.x()), static_cast<float>(point.y()));
+        const bool recent = std::any_of(m_ripples.begin(), m_ripples.end(), [&](const Ripple& ripple) {
+            return now - ripple.startMs < RIPPLE_REARM_MS && cv::norm(ripple.center - center) < RIPPLE_REARM_DISTANCE;
+        });
+        if (recent || m_ripples.size() >= MAX_RIPPLES) {
+            continue;
+        }
+        m_ripples.push_back({center, now});
+        added = true;
+    }
+
+    if (added) {
+        setProjectionState(m_state); // draws the first ring and starts the animation timer
+    }
+}
+
+// Map the mask into every output at reduced resolution, grow it and soften its edge; the
+// renderers black it out as the last step of the warp, so it costs no extra pass
+void ImageProjectionWindow::setOcclusion(const cv::Mat& stillMask)
+{
+    if (stillMask.empty() || m_stillFrame.empty()) {
+        clearOcclusion();
+        return;
+    }
+
+    // Pixel centres: mask -> still frame, and projector -> reduced map
+    const double sx = static_cast<double>(m_stillFrame.cols) / stillMask.cols;
+    const double sy = static_cast<double>(m_stillFrame.rows) / stillMask.rows;
+    const cv::Matx33d maskToStill(sx, 0.0, 0.5 * sx - 0.5,
+                                  0.0, sy, 0.5 * sy - 0.5,
+                                  0.0, 0.0, 1.0);
+    const double s = 1.0 / OCCLUSION_SCALE;
+    const cv::Matx33d projectorToMap(s, 0.0, 0.5 * s - 0.5,
+                                     0.0, s, 0.5 * s - 0.5,
+                                     0.0, 0.0, 1.0);
+    static const cv::Mat margin = cv::getStructuringElement(
+        cv::MORPH_ELLIPSE, cv::Size(2 * OCCLUSION_MARGIN + 1, 2 * OCCLUSION_MARGIN + 1));
+
+    for (Output& output : m_outputs) {
+        if (!output.calibration.calibrated) {
+            output.renderer.clearOcclusion();
+            continue;
+        }
+
+        const cv::Size& size = output.renderer.outputSize();
+        const cv::Size mapSize(size.width / OCCLUSION_SCALE, size.height / OCCLUSION_SCALE);
+        cv::Mat occluded;
+        cv::warpPerspective(stillMask, occluded, projectorToMap * output.calibration.perspectiveMatrix * maskToStill,
+                            mapSize, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0));
+        cv::dilate(occluded, occluded, margin);
+        cv::GaussianBlur(occluded, occluded, cv::Size(5, 5), 0.0);
+
+        cv::Mat keep;
+        cv::bitwise_not(occluded, keep);
+        output.renderer.setOcclusion(keep);
+    }
+
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state); // the rainbow timer picks it up on its own
+    }
+}
+
+void ImageProjectionWindow::setOcclusionMasker(OcclusionMasker* masker)
+{
+    m_occlusionMasker = masker;
+}
+
+void ImageProjectionWindow::clearOcclusion()
+{
+    bool had = false;
+    for (Output& output : m_outputs) {
+        had = had || output.renderer.hasOcclusion();
+        output.renderer.clearOcclusion();
+    }
+    if (had && (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE)) {
+        setProjectionState(m_state);
+    }
+}
+
+// Freeze what the current region shows; returns false if there's nothing projected to keep
+bool ImageProjectionWindow::addRegion()
+{
+    Region region;
+    region.effect = m_state;
+
+    switch (m_state) {
+    case projectionState::IMAGE:
+        if (m_finalFrame.empty()) {
+            return false;
         }
+        region.source = m_finalFrame; // replaced, never written in place, so sharing is safe
+        region.sourceRegion = m_finalFrameRegion;
+        region.order = m_finalFrameOrder;
+        break;
+    case projectionState::EDGE_DETECTION:
+    case projectionState::RAINBOW_EDGE:
+        updateEdgeDetectionFrame();
+        if (m_edgeDetectionFrame.empty()) {
+            return false;
+        }
+        region.source = m_edgeDetectionFrame.clone(); // the cache is rewritten in place
+        region.sourceRegion = m_roi;
+        region.order = ChannelOrder::BGR;
+        break;
+    default:
+        qDebug() << "No region to freeze in state" << static_cast<int>(m_state);
+        return false;
     }
 
+    for (const Output& output : m_outputs) {
+        region.outputs.push_back(output.calibration);
+    }
+    m_regions.push_back(region);
+
+    qDebug() << "Region frozen," << m_regions.size() << "regions now";
+    return true;
+}
+
+void ImageProjectionWindow::clearRegions()
+{
+    m_regions.clear();
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        setProjectionState(m_state);
+    }
+    updateAnimationTimer();
+}
+
+int ImageProjectionWindow::getRegionCount() const
+{
+    return static_cast<int>(m_regions.size());
+}
+
+int ImageProjectionWindow::getOutputCount() const
+{
+    return static_cast<int>(m_outputs.size());
+}
+
+int ImageProjectionWindow::getActiveOutput() const
+{
+    return m_activeOutput;
+}
+
+// Calibration goes to the active output from here on; the others keep theirs
+void ImageProjectionWindow::setActiveOutput(int index)
+{
+    if (index < 0 || index >= getOutputCount()) {
+        qDebug() << "No projector output" << index;
+        return;
+    }
+
+    m_activeOutput = index;
+    qDebug() << "Active output" << index + 1 << "of" << getOutputCount();
+    setProjectionState(m_state);
+}
+
+ImageProjectionWindow::Output& ImageProjectionWindow::activeOutput()
+{
+    return m_outputs[m_activeOutput];
+}
+
+const ImageProjectionWindow::Output& ImageProjectionWindow::activeOutput() const
+{
+    return m_outputs[m_activeOutput];
+}
+
+void ImageProjectionWindow::setProjectionState(projectionState state)
+{
     // Update the current state
     m_state = state;
 
@@ -198,10 +540,51 @@ void ImageProjectionWindow::setProjectionState(projectionState state)
     case projectionState::IMAGE:
         activateImage();
         break;
+    case projectionState::FLAT:
+        activateFlat();
+        break;
     default:
         qDebug() << "Unknown projection state:" << static_cast<int>(state);
         break;
     }
+
+    updateAnimationTimer();
+}
+
+// The timer runs while anything on screen is animated: the rainbow state itself,
+// or frozen rainbow regions under an edge or image region. With audio, edges of
+// any colour pulse, and the timer ticks every display frame instead; so it does
+// while ripples spread. Whether anything moves matters to occlusion masking.
+void ImageProjectionWindow::updateAnimationTimer()
+{
+    const bool everyFrame = isAudioReactive() || !m_ripples.empty();
+    bool animated = (m_state == projectionState::RAINBOW_EDGE && !m_stillFrame.empty()) || everyFrame;
+    if (m_state == projectionState::EDGE_DETECTION || m_state == projectionState::IMAGE) {
+        for (const Region& region : m_regions) {
+            animated = animated || region.effect == projectionState::RAINBOW_EDGE;
+        }
+    }
+
+    const int interval = everyFrame ? FRAME_INTERVAL_MS : RAINBOW_INTERVAL_MS;
+    if (animated && !m_rainbowTimer->isActive()) {
+        m_rainbowClock.restart(); // rainbow starts from the same hue every time
+        m_rainbowTimer->start(interval);
+    } else if (animated && m_rainbowTimer->interval() != interval) {
+        m_rainbowTimer->setInterval(interval);
+    } else if (!animated && m_rainbowTimer->isActive()) {
+        m_rainbowTimer->stop();
+        m_audioBrightness = 1.0f;
+        qDebug() << "Rainbow timer stopped, nothing animated on screen.";
+    }
+
+    const bool panZooming = m_panZoom && m_state == projectionState::IMAGE && !m_finalFrame.empty();
+    if (panZooming && !m_panZoomTimer->isActive()) {
+        m_panZoomTimer->start(PAN_ZOOM_INTERVAL_MS);
+    } else if (!panZooming && m_panZoomTimer->isActive()) {
+        m_panZoomTimer->stop();
+    }
+
+    m_animating = animated || panZooming;
 }
 
 // Getters
@@ -223,6 +606,65 @@ QImage ImageProjectionWindow::getCurrentImage() const
     return QImage(); // Return an empty QImage if there's no pixmap
 }
 
+cv::Rect ImageProjectionWindow::getRegionOfInterest() const
+{
+    return m_roi;
+}
+
+// Still frame cropped to the calibration quad; may share memory with m_stillFrame
+cv::Mat ImageProjectionWindow::getStillRegion() const
+{
+    return m_stillRegion;
+}
+
+int ImageProjectionWindow::getStillRevision() const
+{
+    return m_stillRevision;
+}
+
+// A fresh Mat on every recompute, never written in place, so callers may keep it
+cv::Mat ImageProjectionWindow::getEdgeMap()
+{
+    updateEdgeDetectionFrame();
+    return m_edgeMap;
+}
+
+int ImageProjectionWindow::getEdgeRevision() const
+{
+    return m_edgeRevision;
+}
+
+ImageProjectionWindow::projectionState ImageProjectionWindow::getProjectionState() const
+{
+    return m_state;
+}
+
+// Still-frame (camera) pixels -> projector pixels
+cv::Mat ImageProjectionWindow::getPerspectiveMatrix()
+{
+    return cv::Mat(activeOutput().calibration.perspectiveMatrix); // copies
+}
+
+cv::Size ImageProjectionWindow::getOutputSize() const
+{
+    return activeOutput().renderer.outputSize();
+}
+
+std::array<cv::Point2f, 4> ImageProjectionWindow::getTransformCorners() const
+{
+    return activeOutput().calibration.corners;
+}
+
+bool ImageProjectionWindow::hasCompensation() const
+{
+    return activeOutput().renderer.hasCompensation();
+}
+
+bool ImageProjectionWindow::isPanZooming() const
+{
+    return m_panZoom;
+}
+
 
 // State Transitions
 
@@ -234,6 +676,11 @@ void ImageProjectionWindow::activateLogo(){
     if (!logoImage.isNull())
     {
         updateImage(logoImage);
+        for (const Output& output : m_outputs) {
+            if (output.window) {
+                output.window->present(logoImage);
+            }
+        }
     }
     else
     {
@@ -243,12 +690,17 @@ void ImageProjectionWindow::activateLogo(){
     m_isCalibrated = false;
 }
 
-// Activate SCANNING state (whiteout the current frame)
+// Activate SCANNING state (whiteout the active output, the others go dark so they don't confuse the scan)
 void ImageProjectionWindow::activateScanning()
 {
     m_isCalibrated = false;
-    m_imageLabel->clear();
-    setStyleSheet("background-color: white;");
+    if (activeOutput().calibration.calibrated) {
+        activeOutput().calibration.calibrated = false; // being rescanned
+        // The other outputs no longer share an overlap with it: drop their blend ramps until it is back
+        updateRegionOfInterest();
+        updateOutputMasks();
+    }
+    showSolid(Qt::white, Qt::black);
 }
 
 // Activate EDGE_DETECTION state
@@ -262,30 +714,26 @@ void ImageProjectionWindow::activateEdgeDetection()
     m_isCalibrated = true;
 
     // Handle Edge Detection Caching
-    if (m_updateEdgeDetectionFrame)
-    {
-        // Convert to grayscale
-        cv::Mat grayMat;
-        cv::cvtColor(m_stillFrame, grayMat, cv::COLOR_BGR2GRAY);
+    updateEdgeDetectionFrame();
 
-        // Apply Canny edge detection
-        cv::Mat edges;
-        cv::Canny(grayMat, edges, m_loSensitivity, m_hiSensitivity);
+    // Warp the edges into every output and show them
+    presentWarped(pulsedEdges(m_edgeDetectionFrame), m_roi);
+}
 
-        // Convert edges to BGR for consistent display format
-        cv::cvtColor(edges, m_edgeDetectionFrame, cv::COLOR_GRAY2BGR);
-        m_updateEdgeDetectionFrame = false;
+// Recompute the cached edge frame if the still, the ROI or the thresholds changed
+void ImageProjectionWindow::updateEdgeDetectionFrame()
+{
+    if (!m_updateEdgeDetectionFrame || m_stillRegion.empty()) {
+        return;
     }
-    // else // XXXX
-    // {
-    //     qDebug() << "This helped Edge!";
-    // }
 
-    // Apply the edge warping
-    cv::Mat warpedMat = applyPerspectiveTransform(m_edgeDetectionFrame);
+    // Only the region the warp keeps, traced at generation resolution so the preview is what gets generated from
+    m_edgeMap = EdgeMap::compute(m_stillRegion, m_loSensitivity, m_hiSensitivity);
 
-    // Update the QLabel with the edge-detected image
-    updateImage(warpedMat);
+    // Convert edges to BGR for consistent display format
+    cv::cvtColor(m_edgeMap, m_edgeDetectionFrame, cv::COLOR_GRAY2BGR);
+    m_updateEdgeDetectionFrame = false;
+    ++m_edgeRevision;
 }
 
 // Activate RAINBOW_EDGE state
@@ -296,11 +744,7 @@ void ImageProjectionWindow::activateRainbowEdge()
         return;
     }
 
-    // Start the timer to update rainbow edges periodically
-    if (!m_rainbowTimer->isActive()) {
-        m_frameCount = 0;          // Reset frame count
-        m_rainbowTimer->start(100); // Update every 100 ms (adjust as needed)
-    }
+    // The animation timer (see updateAnimationTimer) renders the frames
 }
 
 // Activate IMAGE state (apply perspective transform)
@@ -311,77 +755,37 @@ void ImageProjectionWindow::activateImage()
         return;
     }
 
-    // Apply perspective transform using the helper function
-    cv::Mat warpedMat = applyPerspectiveTransform(m_finalFrame);
-
-    if (!warpedMat.empty()) {
-        updateImage(warpedMat); // setting m_imageLabel to contain this image
-    }
-    else {
-        qDebug() << "Failed to apply perspective transform in activateImage().";
+    // Apply perspective transform and show it on every output
+    if (m_panZoom) {
+        presentWarped(m_finalFrame, m_finalFrameRegion, m_finalFrameOrder, panZoomMatrix(m_finalFrame.size()));
+    } else {
+        presentWarped(m_finalFrame, m_finalFrameRegion, m_finalFrameOrder);
     }
 }
 
-
-// Helper function to update the QLabel with a new image
-void ImageProjectionWindow::updateImage(const cv::Mat &mat)
+// Activate FLAT state (unwarped and uncompensated, it is what compensation is measured against);
+// only the active output is measured, the others stay dark
+void ImageProjectionWindow::activateFlat()
 {
-    if (mat.empty())
-    {
-        qDebug() << "Received empty Mat in ImageProjectionWindow::updateImage";
-        return;
-    }
-
-    QImage image;
-    const uchar* matData = mat.data;
-
-    if (mat.channels() == 3)
-    {
-        // Convert BGR to RGB directly into QImage without extra cv::Mat
-        cv::Mat rgbMat;
-        cv::cvtColor(mat, rgbMat, cv::COLOR_BGR2RGB);
-        matData = rgbMat.data;
-        image = QImage(matData, rgbMat.cols, rgbMat.rows, static_cast<int>(rgbMat.step), QImage::Format_RGB888);
-    }
-    else if (mat.channels() == 4)
-    {
-        // Convert BGRA to RGBA directly
-        cv::Mat rgbaMat;
-        cv::cvtColor(mat, rgbaMat, cv::COLOR_BGRA2RGBA);
-        matData = rgbaMat.data;
-        image = QImage(matData, rgbaMat.cols, rgbaMat.rows, static_cast<int>(rgbaMat.step), QImage::Format_RGBA8888);
-    }
-    else if (mat.channels() == 1)
-    {
-        // Grayscale image
-        image = QImage(matData, mat.cols, mat.rows, static_cast<int>(mat.step), QImage::Format_Grayscale8);
-    }
-    else
-    {
-        qDebug() << "Unsupported number of channels in Mat for updateImage: " << mat.channels();
-        return;
-    }
-
-    if (!image.isNull())
-    {
-        // Since matData might go out of scope, we need to make a deep copy now
-        image = image.copy();
-
-        // Scale the image to fit the label while maintaining aspect ratio
-        QPixmap pixmap = QPixmap::fromImage(image).scaled(
-            m_imageLabel->size(),
-            Qt::KeepAspectRatio,
-            Qt::SmoothTransformation
-            );
+    showSolid(QColor(m_flatLevel, m_flatLevel, m_flatLevel), Qt::black);
+}
 
-        m_imageLabel->setPixmap(pixmap);
-    }
-    else
-    {
-        qDebug() << "Conversion from Mat to QImage resulted in a null image.";
+// Whole outputs in one colour, the active one and the rest
+void ImageProjectionWindow::showSolid(const QColor& active, const QColor& others)
+{
+    for (int i = 0; i < getOutputCount(); ++i) {
+        const QColor& color = i == m_activeOutput ? active : others;
+        if (m_outputs[i].window) {
+            m_outputs[i].window->showSolid(color);
+        } else {
+            m_imageLabel->clear();
+            setStyleSheet(QString("background-color: %1;").arg(color.name()));
+        }
     }
 }
 
+
+// Helper function to update the QLabel with a new image
 void ImageProjectionWindow::updateImage(const QImage &image)
 {
     if (image.isNull())
@@ -411,68 +815,432 @@ void ImageProjectionWindow::updateImage(const QImage &image)
 }
 
 
-// Helper function to apply perspective transform to a cv::Mat and return a QImage
-cv::Mat ImageProjectionWindow::applyPerspectiveTransform(const cv::Mat& mat)
+// Each output's alpha: the drawn mask times its share of any overlap with the other projectors
+void ImageProjectionWindow::updateOutputMasks()
 {
-    if (mat.empty()) {
-        qDebug() << "Empty mat provided to applyPerspectiveTransform.";
-        return cv::Mat();
+    const std::vector<cv::Mat> blends = blendAlphas();
+
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        OutputCalibration& calibration = m_outputs[i].calibration;
+        cv::Mat alpha = maskAlpha(calibration.maskPolygon);
+        if (alpha.empty()) {
+            alpha = blends[i];
+        } else if (!blends[i].empty()) {
+            cv::multiply(alpha, blends[i], alpha, 1.0 / 255);
+        }
+        calibration.mask = alpha.empty() ? ProjectionMask() : ProjectionMask(alpha);
     }
+}
 
-    if (m_transformCorners.size() != 4) {
-        qDebug() << "Transform corners are not properly set.";
+// Rasterise a projector-space mask polygon into an alpha buffer, feathered inwards; empty without a polygon
+cv::Mat ImageProjectionWindow::maskAlpha(const std::vector<cv::Point2f>& polygon) const
+{
+    if (polygon.size() < 3) {
         return cv::Mat();
     }
 
-    if (m_updatePerspectiveMatrix) {
-        // Define source points (corners of the original image)
-        const std::vector<cv::Point2f> srcCorners = {
-            {0.0f, 0.0f},
-            {static_cast<float>(WIDTH), 0.0f},
-            {static_cast<float>(WIDTH), static_cast<float>(HEIGHT)},
-            {0.0f, static_cast<float>(HEIGHT)}
-        };
+    // Sub-pixel vertices (4 fractional bits)
+    constexpr int SHIFT = 4;
+    std::vector<cv::Point> vertices;
+    vertices.reserve(polygon.size());
+    for (const cv::Point2f& point : polygon) {
+        vertices.emplace_back(cvRound(point.x * (1 << SHIFT)), cvRound(point.y * (1 << SHIFT)));
+    }
+
+    cv::Mat alpha = cv::Mat::zeros(HEIGHT, WIDTH, CV_8UC1);
+    cv::fillPoly(alpha, std::vector<std::vector<cv::Point>>{vertices}, cv::Scalar(255), cv::LINE_AA, SHIFT);
+
+    // Ramp from 0 at the polygon edge to full over m_maskFeather pixels, so no light spills past it
+    if (m_maskFeather > 0) {
+        cv::Mat distance;
+        cv::distanceTransform(alpha, distance, cv::DIST_L2, cv::DIST_MASK_PRECISE);
+        distance.convertTo(alpha, CV_8UC1, 255.0 / m_maskFeather);
+    }
+
+    return alpha;
+}
+
+// Cross-fade where projectors overlap. Every calibrated output is weighted by the distance to the
+// edge of its own quad in the still frame (full weight m_blendWidth pixels in), the weights are
+// normalised across outputs and warped into each projector, then gamma-encoded since the projectors
+// add light, not pixel values. Empty alphas when fewer than two outputs are calibrated.
+std::vector<cv::Mat> ImageProjectionWindow::blendAlphas() const
+{
+    std::vector<cv::Mat> alphas(m_outputs.size());
+
+    const int calibratedCount = static_cast<int>(std::count_if(m_outputs.begin(), m_outputs.end(),
+        [](const Output& output) { return output.calibration.calibrated; }));
+    if (calibratedCount < 2 || m_blendWidth <= 0) {
+        return alphas;
+    }
+
+    const cv::Size frameSize = m_stillFrame.empty() ? cv::Size(WIDTH, HEIGHT) : m_stillFrame.size();
+    std::vector<cv::Mat> weights(m_outputs.size());
+    cv::Mat total = cv::Mat::zeros(frameSize, CV_32FC1);
+
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        const OutputCalibration& calibration = m_outputs[i].calibration;
+        if (!calibration.calibrated) {
+            continue;
+        }
+
+        std::vector<cv::Point> quad;
+        for (const cv::Point2f& corner : calibration.corners) {
+            quad.emplace_back(cvRound(corner.x), cvRound(corner.y));
+        }
+        cv::Mat inside = cv::Mat::zeros(frameSize, CV_8UC1);
+        cv::fillConvexPoly(inside, quad, cv::Scalar(255));
+
+        cv::distanceTransform(inside, weights[i], cv::DIST_L2, cv::DIST_MASK_PRECISE);
+        weights[i] = cv::min(weights[i] * (1.0 / m_blendWidth), 1.0);
+        total += weights[i];
+    }
+    cv::max(total, 1e-6, total); // nothing covers it, every share is 0
+
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        if (weights[i].empty()) {
+            continue;
+        }
+
+        cv::Mat share, warped;
+        cv::divide(weights[i], total, share);
+        cv::warpPerspective(share, warped, m_outputs[i].calibration.perspectiveMatrix, cv::Size(WIDTH, HEIGHT),
+                            cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0));
+        cv::pow(warped, 1.0 / BLEND_GAMMA, warped);
+        warped.convertTo(alphas[i], CV_8UC1, 255.0);
+    }
+
+    return alphas;
+}
+
+// Corners of the active output's quad in the still frame, and everything that follows from them;
+// keepStillCrop leaves the ROI (and the still region cropped with it) as it is
+void ImageProjectionWindow::setActiveCorners(const std::array<cv::Point2f, 4>& transformCorners, bool keepStillCrop)
+{
+    const cv::Point2f projectorCorners[4] = {
+        {0.0f, 0.0f},
+        {static_cast<float>(WIDTH), 0.0f},
+        {static_cast<float>(WIDTH), static_cast<float>(HEIGHT)},
+        {0.0f, static_cast<float>(HEIGHT)}
+    };
+
+    OutputCalibration& calibration = activeOutput().calibration;
+    calibration.corners = transformCorners;
+    calibration.perspectiveMatrix = cv::getPerspectiveTransform(transformCorners.data(), projectorCorners);
+    calibration.calibrated = true;
+
+    if (!keepStillCrop) {
+        updateRegionOfInterest();
+    }
+    updateOutputMasks(); // the blend ramps follow the quads
+}
+
+// Recompute the quad's bounding box and the still-frame crop that goes with it
+void ImageProjectionWindow::updateRegionOfInterest()
+{
+    const cv::Size frameSize = m_stillFrame.empty() ? cv::Size(WIDTH, HEIGHT) : m_stillFrame.size();
+    const cv::Rect frameRect(cv::Point(0, 0), frameSize);
+
+    // Union of the calibrated quads; the outputs share one still region and one image
+    std::vector<cv::Point2f> corners;
+    for (const Output& output : m_outputs) {
+        if (output.calibration.calibrated) {
+            corners.insert(corners.end(), output.calibration.corners.begin(), output.calibration.corners.end());
+        }
+    }
+    cv::Rect roi = corners.empty() ? cv::Rect() : cv::boundingRect(corners);
+    roi = cv::Rect(roi.x - ROI_PADDING, roi.y - ROI_PADDING,
+                   roi.width + 2 * ROI_PADDING, roi.height + 2 * ROI_PADDING) & frameRect;
+
+    // Corners not chosen yet (or degenerate), fall back to the whole frame
+    if (roi.width <= 2 * ROI_PADDING || roi.height <= 2 * ROI_PADDING) {
+        roi = frameRect;
+    }
+
+    if (roi != m_roi) {
+        m_roi = roi;
+        m_updateEdgeDetectionFrame = true;
+        m_updateStillRegion = true;
+    }
 
-        // Destination points (transform corners)
-        const std::array<cv::Point2f, 4> dstCorners = m_transformCorners;
+    if (!m_updateStillRegion) {
+        return;
+    }
 
-        // Calculate the perspective transform matrix
-        m_perspectiveMatrix = cv::getPerspectiveTransform(dstCorners.data(), srcCorners.data());
-        m_updatePerspectiveMatrix = false;
+    if (m_stillFrame.empty()) {
+        m_stillRegion = cv::Mat();
+    } else if (m_cameraModel.isValid() && !m_stillFrameUndistorted) {
+        // One remap does both the undistortion and the crop
+        m_cameraModel.undistort(m_stillFrame, m_stillRegion, m_roi);
+    } else {
+        m_stillRegion = m_stillFrame(m_roi);
     }
-    // else // XXXX
-    // {
-    //     qDebug() << "This helped Transform!";
-    // }
+    m_updateStillRegion = false;
+    ++m_stillRevision;
+}
 
-    const cv::Size outputSize(WIDTH, HEIGHT);
+// Warp into every output, each extra projector on its worker thread, then show all the frames
+// together so the outputs never disagree across an overlap
+void ImageProjectionWindow::presentWarped(const cv::Mat& mat, const cv::Rect& region, ChannelOrder order,
+                                          const cv::Matx33d& animation)
+{
+    if (mat.empty()) {
+        qDebug() << "Empty mat provided to presentWarped.";
+        return;
+    }
 
-    // Apply the perspective transformation
-    cv::Mat warped;
-    cv::warpPerspective(mat, warped, m_perspectiveMatrix, outputSize);
+    // Frozen rainbow regions are recoloured once per frame and shared by the outputs
+    std::vector<cv::Mat> frozenSources;
+    frozenSources.reserve(m_regions.size());
+    for (const Region& frozen : m_regions) {
+        if (frozen.effect == projectionState::RAINBOW_EDGE) {
+            frozenSources.push_back(rainbowEdges(frozen.source, frozen.sourceRegion));
+        } else if (frozen.effect == projectionState::EDGE_DETECTION) {
+            frozenSources.push_back(pulsedEdges(frozen.source));
+        } else {
+            frozenSources.push_back(frozen.source);
+        }
+    }
+
+    std::vector<QImage> frames(m_outputs.size() - 1);
+    for (size_t i = 1; i < m_outputs.size(); ++i) {
+        m_outputs[i].worker->post([&, i]() {
+            frames[i - 1] = renderOutput(i, mat, region, order, animation, frozenSources);
+        });
+    }
+    const auto finishWorkers = [this]() {
+        for (size_t i = 1; i < m_outputs.size(); ++i) {
+            m_outputs[i].worker->finish();
+        }
+    };
+
+    QImage primary;
+    try {
+        primary = renderOutput(0, mat, region, order, animation, frozenSources);
+    } catch (...) {
+        finishWorkers(); // they render from this frame's locals
+        throw;
+    }
+    finishWorkers();
 
-    return warped;
+    updateImage(primary);
+    for (size_t i = 1; i < m_outputs.size(); ++i) {
+        m_outputs[i].window->present(frames[i - 1]);
+    }
+
+    showOcclusionMasker(primary, frames);
+    recordAudioLatency();
+}
+
+// What the camera should see of animated frames: every output in grey, taken back into the still
+// frame at OCCLUSION_SCALE. The masker compares the camera with that instead of its model of the
+// surface, which would take moving content for people.
+void ImageProjectionWindow::showOcclusionMasker(const QImage& primary, const std::vector<QImage>& others) const
+{
+    if (!m_occlusionMasker || !m_animating || !m_occlusionMasker->wantsExpectedFrames() || m_stillFrame.empty()) {
+        return;
+    }
+
+    const double s = 1.0 / OCCLUSION_SCALE;
+    const cv::Matx33d reduce(s, 0.0, 0.5 * s - 0.5,
+                             0.0, s, 0.5 * s - 0.5,
+                             0.0, 0.0, 1.0);
+    const cv::Size size(m_stillFrame.cols / OCCLUSION_SCALE, m_stillFrame.rows / OCCLUSION_SCALE);
+    cv::Mat expected = cv::Mat::zeros(size, CV_8UC1);
+    for (size_t i = 0; i < m_outputs.size(); ++i) {
+        if (!m_outputs[i].calibration.calibrated) {
+            continue;
+        }
+
+        const QImage& frame = i == 0 ? primary : others[i - 1];
+        const cv::Mat rgb(frame.height(), frame.width(), CV_8UC3, const_cast<uchar*>(frame.constBits()),
+                          frame.bytesPerLine());
+        cv::Mat small, gray, warped;
+        cv::resize(rgb, small, cv::Size(rgb.cols / OCCLUSION_SCALE, rgb.rows / OCCLUSION_SCALE), 0.0, 0.0,
+                   cv::INTER_AREA);
+        cv::cvtColor(small, gray, cv::COLOR_RGB2GRAY);
+        const cv::Matx33d projectorToStill = reduce * m_outputs[i].calibration.perspectiveMatrix.inv() * reduce.inv();
+        cv::warpPerspective(gray, warped, projectorToStill, size, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0));
+        cv::max(expected, warped, expected);
+    }
+    m_occlusionMasker->addExpectedFrame(expected);
+}
+
+// Frozen regions and the current one as one output sees them, rendered straight into the
+// RGB buffer that gets shown; black where the output has nothing to show
+QImage ImageProjectionWindow::renderOutput(size_t index, const cv::Mat& mat, const cv::Rect& region, ChannelOrder order,
+                                           const cv::Matx33d& animation, const std::vector<cv::Mat>& frozenSources) const
+{
+    const Output& output = m_outputs[index];
+
+    // Frozen regions first, the current region on top
+    std::vector<ProjectionLayer> layers;
+    layers.reserve(m_regions.size() + 1);
+    for (size_t r = 0; r < m_regions.size(); ++r) {
+        const Region& frozen = m_regions[r];
+        if (index >= frozen.outputs.size() || !frozen.outputs[index].calibrated) {
+            continue;
+        }
+
+        ProjectionLayer layer;
+        layer.source = frozenSources[r];
+        layer.order = frozen.order;
+        layer.homography = frozen.outputs[index].perspectiveMatrix * placementMatrix(layer.source, frozen.sourceRegion);
+        layer.mask = &frozen.outputs[index].mask;
+        layers.push_back(layer);
+    }
+
+    if (output.calibration.calibrated) {
+        ProjectionLayer current;
+        current.source = mat;
+        current.order = order;
+        current.homography = output.calibration.perspectiveMatrix * placementMatrix(mat, region) * animation;
+        current.mask = &output.calibration.mask;
+        layers.push_back(current);
+    }
+
+    const cv::Size& size = output.renderer.outputSize();
+    QImage frame(size.width, size.height, QImage::Format_RGB888);
+    if (layers.empty()) {
+        frame.fill(Qt::black);
+        return frame;
+    }
+
+    // Warp, swizzle, composite, blend and radiometric compensation in one pass over the output:
+    // every source pixel is read once and every output byte written once
+    cv::Mat view(size, CV_8UC3, frame.bits(), static_cast<size_t>(frame.bytesPerLine()));
+    output.renderer.render(layers, view, ChannelOrder::RGB);
+    drawRipples(output, view);
+    return frame;
+}
+
+// Ripples are added on top of the rendered frame, only around each ring, and faded by the
+// output's mask and occlusion so they stay on the surface and cross-fade like everything else
+void ImageProjectionWindow::drawRipples(const Output& output, cv::Mat& frame) const
+{
+    if (m_ripples.empty() || !output.calibration.calibrated) {
+        return;
+    }
+
+    const cv::Rect bounds(cv::Point(0, 0), frame.size());
+    const cv::Mat& alpha = output.calibration.mask.alpha();
+    const qint64 now = m_rippleClock.elapsed();
+
+    for (const Ripple& ripple : m_ripples) {
+        const float age = static_cast<float>(now - ripple.startMs) / RIPPLE_MS;
+        if (age >= 1.0f) {
+            continue;
+        }
+
+        const cv::Vec3d p = output.calibration.perspectiveMatrix * cv::Vec3d(ripple.center.x, ripple.center.y, 1.0);
+        if (p[2] <= 0.0) {
+            continue;
+        }
+        const cv::Point center(cvRound(p[0] / p[2]), cvRound(p[1] / p[2]));
+        const int radius = cvRound(RIPPLE_RADIUS * age) + 1;
+        const int reach = radius + RIPPLE_THICKNESS;
+        const cv::Rect box = cv::Rect(center.x - reach, center.y - reach, 2 * reach + 1, 2 * reach + 1) & bounds;
+        if (box.empty()) {
+            continue;
+        }
+
+        cv::Mat ring = cv::Mat::zeros(box.size(), CV_8UC1);
+        cv::circle(ring, center - box.tl(), radius, cv::Scalar(255.0 * (1.0f - age)), RIPPLE_THICKNESS, cv::LINE_AA);
+        if (!alpha.empty()) {
+            cv::multiply(ring, alpha(box), ring, 1.0 / 255.0);
+        }
+
+        cv::Mat target = frame(box);
+        cv::Mat ringRgb;
+        cv::cvtColor(ring, ringRgb, cv::COLOR_GRAY2RGB);
+        output.renderer.occlude(ringRgb, box.tl()); // no rings on the people the frame is blacked out for
+        cv::add(target, ringRgb, target);
+    }
+}
+
+// The input covers region at its own resolution (an ROI crop, or a generated image of any size),
+// so fold that placement into the homography instead of pasting it back into a full frame
+cv::Matx33d ImageProjectionWindow::placementMatrix(const cv::Mat& mat, const cv::Rect& region)
+{
+    const double scaleX = static_cast<double>(region.width) / mat.cols;
+    const double scaleY = static_cast<double>(region.height) / mat.rows;
+    return cv::Matx33d(scaleX, 0.0, region.x + 0.5 * scaleX - 0.5,
+                       0.0, scaleY, region.y + 0.5 * scaleY - 0.5,
+                       0.0, 0.0, 1.0);
+}
+
+// Source pixels -> source pixels for this moment of the pan and zoom. It is composed into the
+// homography, so every frame is still one resample of the original image: no zoomed copies.
+// The zoom never drops below what keeps the turned view inside the image.
+cv::Matx33d ImageProjectionWindow::panZoomMatrix(const cv::Size& size) const
+{
+    const double phase = 2.0 * CV_PI * (m_panZoomClock.elapsed() / 1000.0) / m_panZoomSeconds;
+    const double width = size.width, height = size.height;
+
+    const double angle = PAN_ZOOM_MAX_DEGREES * CV_PI / 180.0 * std::sin(phase);
+    const double cosA = std::abs(std::cos(angle)), sinA = std::abs(std::sin(angle));
+    const double minZoom = std::max({PAN_ZOOM_MIN_ZOOM,
+                                     (width * cosA + height * sinA) / width,
+                                     (width * sinA + height * cosA) / height});
+    const double zoom = minZoom + (PAN_ZOOM_MAX_ZOOM - PAN_ZOOM_MIN_ZOOM) * 0.5 * (1.0 - std::cos(phase));
+
+    // Pan as far as the turned, zoomed view allows, along a slow figure of eight
+    const double extentX = (width * cosA + height * sinA) / (2.0 * zoom);
+    const double extentY = (width * sinA + height * cosA) / (2.0 * zoom);
+    const double halfX = 0.5 * (width - 1.0), halfY = 0.5 * (height - 1.0);
+    const double centreX = halfX + std::max(width / 2.0 - extentX, 0.0) * std::sin(phase);
+    const double centreY = halfY + std::max(height / 2.0 - extentY, 0.0) * std::sin(2.0 * phase);
+
+    // Scale and turn about the view centre, then put it back in the middle of the frame
+    const double c = zoom * std::cos(angle), s = zoom * std::sin(angle);
+    return cv::Matx33d(c, -s, halfX - c * centreX + s * centreY,
+                       s, c, halfY - s * centreX - c * centreY,
+                       0.0, 0.0, 1.0);
 }
 
 void ImageProjectionWindow::updateRainbowEdges()
 {
+    sampleAudio();
+
+    const qint64 now = m_rippleClock.elapsed();
+    m_ripples.erase(std::remove_if(m_ripples.begin(), m_ripples.end(),
+                                   [now](const Ripple& ripple) { return now - ripple.startMs >= RIPPLE_MS; }),
+                    m_ripples.end());
+
+    if (m_state != projectionState::RAINBOW_EDGE) {
+        // Frozen rainbow regions under an edge or image region, pulsing edges or ripples
+        setProjectionState(m_state);
+        return;
+    }
+
     if (m_stillFrame.empty()) {
         qDebug() << "No still frame set for rainbow edge detection.";
         return;
     }
 
-    cv::Mat edges = m_edgeDetectionFrame;
+    updateEdgeDetectionFrame(); // corners may have been refined since the last tick
+
+    // Colour the edges and show them on every output
+    presentWarped(rainbowEdges(m_edgeDetectionFrame, m_roi), m_roi);
+}
+
+// Colour an edge frame with the moving rainbow; region is where the frame sits in the still,
+// so the gradient stays anchored to the full frame whatever resolution the edges are at
+cv::Mat ImageProjectionWindow::rainbowEdges(const cv::Mat& edges, const cv::Rect& region) const
+{
     // Apply the rainbow effect to the edges
     cv::Mat rainbow_edges = cv::Mat::zeros(edges.size(), CV_8UC3);
 
     // Create a rainbow gradient (HSV color space)
     cv::Mat hue(edges.size(), CV_8UC1);
+    const double stillPerColumn = static_cast<double>(region.width) / edges.cols;
     for (int i = 0; i < edges.cols; i++) {
-        hue.col(i) = static_cast<uchar>((i + m_frameCount * 5) % 180);
+        const int x = region.x + static_cast<int>(i * stillPerColumn);
+        hue.col(i) = static_cast<uchar>((x + m_rainbowClock.elapsed() / 20) % 180);
     }
 
     cv::Mat saturation = cv::Mat::ones(edges.size(), CV_8UC1) * 255;
-    cv::Mat value = cv::Mat::ones(edges.size(), CV_8UC1) * 255;
+    cv::Mat value(edges.size(), CV_8UC1, cv::Scalar(cvRound(255 * m_audioBrightness)));
 
     std::vector<cv::Mat> hsv_channels = { hue, saturation, value };
     cv::Mat hsv_rainbow;
@@ -484,16 +1252,72 @@ void ImageProjectionWindow::updateRainbowEdges()
 
     // Apply the rainbow to the edges using vectorized operations
     rainbow.copyTo(rainbow_edges, edges);
+    return rainbow_edges;
+}
+
+// White edges dimmed to the current audio brightness; shared, not copied, when there's no audio
+cv::Mat ImageProjectionWindow::pulsedEdges(const cv::Mat& edges) const
+{
+    if (m_audioBrightness >= 1.0f) {
+        return edges;
+    }
+    cv::Mat pulsed;
+    edges.convertTo(pulsed, -1, m_audioBrightness);
+    return pulsed;
+}
+
+// Edges follow the audio whenever an analyzer is running and any are on screen
+bool ImageProjectionWindow::isAudioReactive() const
+{
+    if (!m_audio || !m_audio->isRunning()) {
+        return false;
+    }
+    if ((m_state == projectionState::EDGE_DETECTION || m_state == projectionState::RAINBOW_EDGE)
+        && !m_stillFrame.empty()) {
+        return true;
+    }
+    if (m_state == projectionState::IMAGE) {
+        for (const Region& region : m_regions) {
+            if (region.effect == projectionState::EDGE_DETECTION || region.effect == projectionState::RAINBOW_EDGE) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-    // Apply perspective transform using the helper function
-    cv::Mat transformedMat = applyPerspectiveTransform(rainbow_edges);
+// Take the newest analysis for the frame about to be rendered
+void ImageProjectionWindow::sampleAudio()
+{
+    AudioLevels levels;
+    if (!isAudioReactive() || !m_audio->snapshot(levels)) {
+        m_audioBrightness = 1.0f;
+        m_audioSampleTimeNs = 0;
+        return;
+    }
+    m_audioBrightness = AUDIO_FLOOR + (1.0f - AUDIO_FLOOR) * levels.pulse;
+    m_audioSampleTimeNs = levels.sampleTimeNs;
+}
 
-    if (!transformedMat.empty()) {
-        updateImage(transformedMat); // Use the cv::Mat version
+// Audio-to-photon latency up to the frame being handed to the window system
+// (the projector's own lag comes on top); logged every AUDIO_LATENCY_LOG_FRAMES frames
+void ImageProjectionWindow::recordAudioLatency()
+{
+    if (m_audioSampleTimeNs == 0 || m_audioSampleTimeNs == m_lastLatencySampleNs) {
+        return; // no audio, or this analysis was already counted
     }
-    else {
-        qDebug() << "Failed to apply perspective transform in updateRainbowEdges().";
+    m_lastLatencySampleNs = m_audioSampleTimeNs;
+
+    const qint64 latencyNs = AudioAnalyzer::nowNs() - m_audioSampleTimeNs;
+    m_audioLatencySumNs += latencyNs;
+    m_audioLatencyMaxNs = std::max(m_audioLatencyMaxNs, latencyNs);
+    if (++m_audioLatencyFrames < AUDIO_LATENCY_LOG_FRAMES) {
+        return;
     }
 
-    m_frameCount++; // Increment frame count for animation
+    qDebug() << "Audio to frame latency: mean" << m_audioLatencySumNs / m_audioLatencyFrames / 1000000.0
+             << "ms, max" << m_audioLatencyMaxNs / 1000000.0 << "ms over" << m_audioLatencyFrames << "frames";
+    m_audioLatencySumNs = 0;
+    m_audioLatencyMaxNs = 0;
+    m_audioLatencyFrames = 0;
 }
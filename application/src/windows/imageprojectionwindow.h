@@ -6,7 +6,16 @@
 #include <QLabel>
 #include <QImage>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QPolygonF>
+#include <memory>
 #include <opencv2/opencv.hpp>
+#include "utils/cameramodel.h"
+#include "utils/projectionrenderer.h"
+#include "utils/audioanalyzer.h"
+#include "utils/occlusionmasker.h"
+#include "utils/renderworker.h"
+#include "windows/projectoroutput.h"
 
 class ImageProjectionWindow : public QWidget
 {
@@ -18,45 +27,164 @@ public:
         SCANNING,
         EDGE_DETECTION,
         RAINBOW_EDGE,
-        IMAGE
+        IMAGE,
+        FLAT
     } projectionState;
 
     explicit ImageProjectionWindow(QWidget* parent = nullptr);
 
     // Setters
-    void setStillFrame(const cv::Mat &image);
-    void setFinalFrame(const cv::Mat &mat);
+    void setStillFrame(const cv::Mat &image, bool undistorted = false); // undistorted: taken from the live feed
+    void setFinalFrame(const cv::Mat &mat, ChannelOrder order = ChannelOrder::BGR); // shared, not copied
     void setSensitivity(int lo, int hi);
     void setTransformCorners(const std::array<cv::Point2f, 4>& transformCorners);
+    void setCameraModel(const CameraModel& cameraModel);
+    void refineTransformCorners(const std::array<cv::Point2f, 4>& transformCorners);
     void setProjectionState(projectionState state);
+    void setFlatLevel(int level);
+    void setCompensation(const cv::Mat& gain, const cv::Mat& offset, double gamma);
+    void clearCompensation();
+    void setMaskPolygon(const std::vector<cv::Point2f>& stillPolygon);
+    void setMaskFeather(int pixels);
+    void clearMask();
+    void setPanZoom(bool enabled); // slow pan, zoom and turn of the projected image
+    void setAudioAnalyzer(const AudioAnalyzer* analyzer); // edge effects pulse with the music; not owned
+    void addRipples(const QPolygonF& stillPoints); // rings spreading from where someone touched the surface
+    void setOcclusion(const cv::Mat& stillMask); // 255 where someone is in the way, any resolution over the still frame
+    void setOcclusionMasker(OcclusionMasker* masker); // is shown animated frames, so it can tell them from people; not owned
+    void clearOcclusion();
+
+    // Regions: the current one can be frozen so another surface gets calibrated next to it
+    bool addRegion();
+    void clearRegions();
+    int getRegionCount() const;
+
+    // Outputs: this window is output 0, every further projector screen adds one.
+    // Corners, compensation and the perspective matrix refer to the active output.
+    int getOutputCount() const;
+    int getActiveOutput() const;
+    void setActiveOutput(int index);
 
     // Getters
     bool getIsCalibrated(void) const;
     QImage getCurrentImage() const;
+    cv::Rect getRegionOfInterest() const;
+    cv::Mat getStillRegion() const;
+    int getStillRevision() const; // changes whenever getStillRegion() does
+    cv::Mat getEdgeMap(); // edges of the still region at generation resolution, as previewed; shared
+    int getEdgeRevision() const; // changes whenever getEdgeMap() does
+    projectionState getProjectionState() const;
+    cv::Mat getPerspectiveMatrix();
+    cv::Size getOutputSize() const;
+    std::array<cv::Point2f, 4> getTransformCorners() const;
+    bool hasCompensation() const;
+    bool isPanZooming() const;
 
     // Functions
     void showOnProjector();
 
 private:
     static constexpr int WIDTH = 1280, HEIGHT = 720;
+    static constexpr int ROI_PADDING = 2; // keeps bilinear neighbours of the quad edge inside the crop
+    static constexpr double BLEND_GAMMA = 2.2; // projector response the blend ramps are encoded for
+    static constexpr int PAN_ZOOM_INTERVAL_MS = 33;
+    static constexpr double PAN_ZOOM_MIN_ZOOM = 1.05, PAN_ZOOM_MAX_ZOOM = 1.2;
+    static constexpr double PAN_ZOOM_MAX_DEGREES = 1.5;
+    static constexpr int OCCLUSION_SCALE = 4;   // occlusion maps are 1/4 of the projector resolution
+    static constexpr int OCCLUSION_MARGIN = 4;  // px (reduced) of extra blackout around a person
+    static constexpr int RAINBOW_INTERVAL_MS = 100;
+    static constexpr int FRAME_INTERVAL_MS = 16;        // one frame at 60 Hz while edges follow the audio or ripples spread
+    static constexpr float AUDIO_FLOOR = 0.25f;         // edge brightness in silence
+    static constexpr int AUDIO_LATENCY_LOG_FRAMES = 300;
 
     // image for proj
     cv::Mat m_stillFrame;
+    bool m_stillFrameUndistorted = false;
+    cv::Mat m_stillRegion; // m_stillFrame cropped to m_roi (and undistorted when the lens is calibrated)
     cv::Mat m_finalFrame;
+    ChannelOrder m_finalFrameOrder = ChannelOrder::BGR;
+    cv::Rect m_finalFrameRegion; // still-frame region the final frame was generated from
 
     QLabel *m_imageLabel; // holding the image on screen
 
     // Cached Values
-    bool m_updatePerspectiveMatrix = true;
     bool m_updateEdgeDetectionFrame = true;
-    cv::Mat m_perspectiveMatrix;
-    cv::Mat m_edgeDetectionFrame;
+    bool m_updateStillRegion = true;
+    int m_stillRevision = 0;
+    cv::Mat m_edgeMap;            // CV_8UC1 at generation resolution
+    cv::Mat m_edgeDetectionFrame; // m_edgeMap as BGR, for presenting
+    int m_edgeRevision = 0;
 
     int m_loSensitivity, m_hiSensitivity;
-    std::array<cv::Point2f, 4> m_transformCorners;
+    cv::Rect m_roi; // bounding box of the calibrated quads in still-frame coordinates
+    CameraModel m_cameraModel;
+    int m_flatLevel = 255;
+    int m_maskFeather;
+    int m_blendWidth; // still-frame pixels over which overlapping projectors cross-fade
+
+    // How one projector sees the still frame
+    struct OutputCalibration {
+        bool calibrated = false;
+        std::array<cv::Point2f, 4> corners;
+        cv::Matx33d perspectiveMatrix = cv::Matx33d::eye(); // still frame -> projector
+        std::vector<cv::Point2f> maskPolygon;               // drawn mask, in projector space
+        ProjectionMask mask;                                // drawn mask times blend ramp
+    };
+
+    // One projector; each has its own renderer so colour correction follows the screen
+    struct Output {
+        explicit Output(ProjectorOutput* window);
+        ProjectorOutput* window; // nullptr for this window
+        ProjectionRenderer renderer;
+        std::unique_ptr<RenderWorker> worker; // renders a further output alongside this window's
+        OutputCalibration calibration;
+    };
+    std::vector<Output> m_outputs;
+    int m_activeOutput = 0;
+
+    // Frozen regions, composited under the current one
+    struct Region {
+        std::vector<OutputCalibration> outputs; // calibration of every output at the time
+        cv::Mat source;                // final image, or edge frame for the edge effects
+        ChannelOrder order;
+        cv::Rect sourceRegion;         // still-frame region the source covers
+        projectionState effect;
+    };
+    std::vector<Region> m_regions;
 
     QTimer *m_rainbowTimer;
-    int m_frameCount;
+    QElapsedTimer m_rainbowClock; // drives the rainbow hue, so its speed doesn't depend on the tick rate
+
+    // Audio reactivity: sampled once per frame, latency measured from the audio to the presented frame
+    const AudioAnalyzer* m_audio = nullptr;
+    float m_audioBrightness = 1.0f;
+    qint64 m_audioSampleTimeNs = 0;
+    qint64 m_lastLatencySampleNs = 0;
+    qint64 m_audioLatencySumNs = 0, m_audioLatencyMaxNs = 0;
+    int m_audioLatencyFrames = 0;
+
+    // Ripples from people touching the surface, drawn over every output
+    static constexpr int RIPPLE_MS = 900;
+    static constexpr float RIPPLE_RADIUS = 160.0f;      // projector px when it fades out
+    static constexpr int RIPPLE_THICKNESS = 6;
+    static constexpr int RIPPLE_REARM_MS = 300;         // a held hand ripples a few times a second, not every frame
+    static constexpr float RIPPLE_REARM_DISTANCE = 40.0f; // still-frame px
+    static constexpr size_t MAX_RIPPLES = 32;
+    struct Ripple {
+        cv::Point2f center; // still frame
+        qint64 startMs;
+    };
+    std::vector<Ripple> m_ripples;
+    QElapsedTimer m_rippleClock;
+
+    // Pan and zoom, one loop every m_panZoomSeconds
+    bool m_panZoom = false;
+    double m_panZoomSeconds;
+    QTimer *m_panZoomTimer;
+    QElapsedTimer m_panZoomClock;
+
+    bool m_animating = false; // anything projected moves on its own: rainbow, pulsing edges, ripples, pan and zoom
+    OcclusionMasker* m_occlusionMasker = nullptr;
 
     bool m_isCalibrated = false;
     projectionState m_state;
@@ -67,11 +195,33 @@ private:
     void activateEdgeDetection();
     void activateRainbowEdge();
     void activateImage();
+    void activateFlat();
 
     // Helper functions
-    void updateImage(const cv::Mat &mat);
     void updateImage(const QImage &image);
-    cv::Mat applyPerspectiveTransform(const cv::Mat& mat);
+    void presentWarped(const cv::Mat& mat, const cv::Rect& region, ChannelOrder order = ChannelOrder::BGR,
+                       const cv::Matx33d& animation = cv::Matx33d::eye());
+    QImage renderOutput(size_t index, const cv::Mat& mat, const cv::Rect& region, ChannelOrder order,
+                        const cv::Matx33d& animation, const std::vector<cv::Mat>& frozenSources) const;
+    cv::Matx33d panZoomMatrix(const cv::Size& size) const;
+    void showSolid(const QColor& active, const QColor& others);
+    static cv::Matx33d placementMatrix(const cv::Mat& mat, const cv::Rect& region);
+    cv::Mat rainbowEdges(const cv::Mat& edges, const cv::Rect& region) const;
+    cv::Mat pulsedEdges(const cv::Mat& edges) const;
+    bool isAudioReactive() const;
+    void sampleAudio();
+    void recordAudioLatency();
+    void showOcclusionMasker(const QImage& primary, const std::vector<QImage>& others) const;
+    void drawRipples(const Output& output, cv::Mat& frame) const;
+    void updateAnimationTimer();
+    void setActiveCorners(const std::array<cv::Point2f, 4>& transformCorners, bool keepStillCrop = false);
+    Output& activeOutput();
+    const Output& activeOutput() const;
+    void updateOutputMasks();
+    cv::Mat maskAlpha(const std::vector<cv::Point2f>& polygon) const;
+    std::vector<cv::Mat> blendAlphas() const;
+    void updateRegionOfInterest();
+    void updateEdgeDetectionFrame();
 
 
     // ui functions
@@ -79,8 +229,9 @@ private:
     void debugPositionInfo();
 
     // for the projector screen
-    QScreen* findProjectorScreen();
+    QList<QScreen*> findProjectorScreens();
     void moveToScreen(QScreen* screen);
+    void loadColorLut(Output& output, const QString& screenName);
     void setupProjectorMode();
     const QSize FIXED_SIZE{1280, 720};
     bool m_isOnProjector = false;
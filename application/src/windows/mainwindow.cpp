@@ -5,6 +5,7 @@
 #include <QGraphicsDropShadowEffect>
 #include <QScreen>
 #include <QApplication>
+#include <QProcessEnvironment>
 
 
 MainWindow::MainWindow(QWidget *parent)
@@ -73,6 +74,29 @@ void MainWindow::setupPages()
     // will show projected image
     projectPage = new ProjectPage(imageProjectionWindow, this);
 
+    // live feed runs the drift tracker while the pages aren't using the camera
+    liveFeed = new LiveFeed(this);
+    driftTracker = new DriftTracker(this);
+    liveFeed->addAnalyzer(driftTracker);
+    surfaceCompensator = new SurfaceCompensator(this);
+    liveFeed->addAnalyzer(surfaceCompensator);
+    interactionTracker = new InteractionTracker(this);
+    liveFeed->addAnalyzer(interactionTracker);
+    occlusionMasker = new OcclusionMasker(this);
+    liveFeed->addAnalyzer(occlusionMasker);
+    imageProjectionWindow->setOcclusionMasker(occlusionMasker);
+    sketchWatcher = new SketchWatcher(this);
+    liveFeed->addAnalyzer(sketchWatcher);
+    liveFeed->setCameraModel(calibrationPage->getCameraModel());
+
+    // edge effects follow the music when an audio source is configured
+    const QString audioSource = QProcessEnvironment::systemEnvironment().value("GPMS_AUDIO_SOURCE");
+    if (!audioSource.isEmpty()) {
+        audioAnalyzer = new AudioAnalyzer(this);
+        audioAnalyzer->start(audioSource);
+        imageProjectionWindow->setAudioAnalyzer(audioAnalyzer);
+    }
+
     stackedWidget->addWidget(createPage);
 
     stackedWidget->addWidget(calibrationPage);
@@ -110,6 +134,41 @@ void MainWindow::setupConnections()
 
     // from calibration page
     connect(calibrationPage, &CalibrationPage::navigateToSensitivityPage, this, &MainWindow::navigateToSensitivityPage);
+    connect(calibrationPage, &CalibrationPage::calibrationReset, this, [this]() {
+        // hand the camera back to the calibration page
+        driftTracker->clearCorners();
+        surfaceCompensator->cancel();
+        stopInteraction();
+        stopOcclusion();
+        stopSketch();
+        liveFeed->stop();
+        imageProjectionWindow->clearCompensation(); // measured through the old corners
+    });
+    connect(calibrationPage, &CalibrationPage::cameraModelChanged, this, [this]() {
+        liveFeed->setCameraModel(calibrationPage->getCameraModel());
+    });
+
+    // drift tracker keeps the warp locked when the rig gets bumped
+    connect(driftTracker, &DriftTracker::cornersDrifted, this, [this](const QPolygonF& corners) {
+        std::array<cv::Point2f, 4> transformCorners;
+        for (int i = 0; i < 4 && i < corners.size(); ++i) {
+            transformCorners[i] = cv::Point2f(corners[i].x(), corners[i].y());
+        }
+        imageProjectionWindow->refineTransformCorners(transformCorners);
+    });
+
+    // surface compensation projects flat levels while the live feed measures them
+    connect(surfaceCompensator, &SurfaceCompensator::levelRequested, imageProjectionWindow, &ImageProjectionWindow::setFlatLevel);
+    connect(surfaceCompensator, &SurfaceCompensator::finished, this, [this](bool success) {
+        if (success) {
+            imageProjectionWindow->setCompensation(surfaceCompensator->gainMap(),
+                                                   surfaceCompensator->offsetMap(),
+                                                   surfaceCompensator->gamma());
+        }
+        imageProjectionWindow->setProjectionState(compensationReturnState);
+        driftTracker->setCorners(imageProjectionWindow->getTransformCorners());
+        projectPage->setCompensationState(imageProjectionWindow->hasCompensation());
+    });
 
     // from sensitivity page
     connect(sensitivityPage, &SensitivityPage::navigateToTextVisionPage, this, &MainWindow::navigateToTextVisionPage);
@@ -117,6 +176,21 @@ void MainWindow::setupConnections()
 
     // from text vision page
     connect(textVisionPage, &TextVisionPage::navigateToPickImagesPage, this, &MainWindow::navigateToPickImagesPage);
+    connect(textVisionPage, &TextVisionPage::requestSketch, this, &MainWindow::toggleSketch);
+
+    // sketch mode: a finished drawing becomes the new still and is submitted straight away
+    connect(sketchWatcher, &SketchWatcher::settled, this, [this]() {
+        const cv::Mat still = sketchWatcher->still();
+        textVisionPage->setSketchState(false);
+        driftTracker->setCorners(imageProjectionWindow->getTransformCorners());
+        if (still.empty() || currentPage != Page::TEXT_VISION) {
+            return;
+        }
+
+        imageProjectionWindow->setStillFrame(still, true); // live feed frames are undistorted already
+        imageProjectionWindow->setProjectionState(ImageProjectionWindow::projectionState::RAINBOW_EDGE);
+        navigateToPickImagesPage(sketchPrompt, sketchRealistic);
+    });
         // take picture here when clicked
 
     // from pick images page
@@ -128,12 +202,167 @@ void MainWindow::setupConnections()
     connect(projectPage, &ProjectPage::navigateToCreatePage, this, &MainWindow::navigateToCreatePage);
     connect(projectPage, &ProjectPage::navigateToPickImagesPage, this, &MainWindow::navigateToPickImagesPage);
     connect(projectPage, &ProjectPage::requestImageRefresh, pickImagesPage, &PickImagesPage::resetState);
+    connect(projectPage, &ProjectPage::requestCompensation, this, &MainWindow::toggleSurfaceCompensation);
+    connect(projectPage, &ProjectPage::requestAnotherSurface, this, &MainWindow::addAnotherSurface);
+    connect(projectPage, &ProjectPage::requestPanZoom, this, &MainWindow::togglePanZoom);
+    connect(projectPage, &ProjectPage::requestInteraction, this, &MainWindow::toggleInteraction);
+    connect(interactionTracker, &InteractionTracker::contactsDetected, imageProjectionWindow, &ImageProjectionWindow::addRipples);
+    connect(projectPage, &ProjectPage::requestOcclusion, this, &MainWindow::toggleOcclusion);
+
+    // occlusion masking measures the unlit surface first, then keeps the window's mask current
+    connect(occlusionMasker, &OcclusionMasker::darkRequested, this, [this]() {
+        imageProjectionWindow->setFlatLevel(0);
+    });
+    connect(occlusionMasker, &OcclusionMasker::ready, this, [this]() {
+        imageProjectionWindow->setProjectionState(occlusionReturnState);
+        driftTracker->setCorners(imageProjectionWindow->getTransformCorners());
+        projectPage->setOcclusionState(true);
+    });
+    connect(occlusionMasker, &OcclusionMasker::maskUpdated, this, [this]() {
+        if (occlusionMasker->isRunning()) {
+            imageProjectionWindow->setOcclusion(occlusionMasker->mask());
+        }
+    });
+}
+
+void MainWindow::toggleSurfaceCompensation()
+{
+    if (surfaceCompensator->isRunning() || occlusionMasker->isMeasuring()) {
+        return;
+    }
+
+    if (imageProjectionWindow->hasCompensation()) {
+        imageProjectionWindow->clearCompensation();
+        projectPage->setCompensationState(false);
+        return;
+    }
+
+    if (!liveFeed->isRunning()) {
+        qDebug() << "Surface compensation needs the live feed (calibrate first)";
+        return;
+    }
+
+    // flat frames would look like a bump to the drift tracker, and like a crowd to the masker
+    driftTracker->clearCorners();
+    stopOcclusion();
+    compensationReturnState = imageProjectionWindow->getProjectionState();
+    projectPage->setCompensationState(false, true);
+    surfaceCompensator->begin(imageProjectionWindow->getPerspectiveMatrix(), imageProjectionWindow->getOutputSize());
+}
+
+void MainWindow::togglePanZoom()
+{
+    imageProjectionWindow->setPanZoom(!imageProjectionWindow->isPanZooming());
+    projectPage->setPanZoomState(imageProjectionWindow->isPanZooming());
+}
+
+void MainWindow::toggleInteraction()
+{
+    if (interactionTracker->isEnabled()) {
+        stopInteraction();
+        return;
+    }
+
+    if (!liveFeed->isRunning()) {
+        qDebug() << "Interaction needs the live feed (calibrate first)";
+        return;
+    }
+
+    interactionTracker->setEnabled(true, imageProjectionWindow->getRegionOfInterest());
+    projectPage->setInteractionState(true);
+}
+
+void MainWindow::stopInteraction()
+{
+    interactionTracker->setEnabled(false);
+    projectPage->setInteractionState(false);
+}
+
+void MainWindow::toggleOcclusion()
+{
+    if (surfaceCompensator->isRunning() || occlusionMasker->isMeasuring()) {
+        return;
+    }
+
+    if (occlusionMasker->isRunning()) {
+        stopOcclusion();
+        return;
+    }
+
+    if (!liveFeed->isRunning()) {
+        qDebug() << "Occlusion masking needs the live feed (calibrate first)";
+        return;
+    }
+
+    // the black frames would look like a bump to the drift tracker
+    driftTracker->clearCorners();
+    occlusionReturnState = imageProjectionWindow->getProjectionState();
+    projectPage->setOcclusionState(false, true);
+    occlusionMasker->begin();
+}
+
+// Light the board evenly and wait for the drawing on it to settle
+void MainWindow::toggleSketch(QString prompt, bool isRealistic)
+{
+    if (sketchWatcher->isRunning()) {
+        stopSketch();
+        return;
+    }
+
+    if (!liveFeed->isRunning()) {
+        qDebug() << "Sketch mode needs the live feed (calibrate first)";
+        return;
+    }
+
+    sketchPrompt = prompt;
+    sketchRealistic = isRealistic;
+    driftTracker->clearCorners(); // the white frame would look like a bump
+    imageProjectionWindow->setFlatLevel(255);
+    sketchWatcher->begin(imageProjectionWindow->getRegionOfInterest());
+    textVisionPage->setSketchState(true);
+}
+
+void MainWindow::stopSketch()
+{
+    if (!sketchWatcher->isRunning()) {
+        return;
+    }
+    sketchWatcher->cancel();
+    textVisionPage->setSketchState(false);
+    driftTracker->setCorners(imageProjectionWindow->getTransformCorners());
+    if (currentPage == Page::TEXT_VISION) {
+        imageProjectionWindow->setProjectionState(ImageProjectionWindow::projectionState::RAINBOW_EDGE);
+    }
+}
+
+void MainWindow::stopOcclusion()
+{
+    if (occlusionMasker->isMeasuring()) {
+        imageProjectionWindow->setProjectionState(occlusionReturnState);
+        driftTracker->setCorners(imageProjectionWindow->getTransformCorners());
+    }
+    occlusionMasker->stop();
+    imageProjectionWindow->clearOcclusion();
+    projectPage->setOcclusionState(false);
 }
 
 
 void MainWindow::navigateToCreatePage()
 {
+    // the create page needs the camera back
+    driftTracker->clearCorners();
+    surfaceCompensator->cancel();
+    stopInteraction();
+    stopOcclusion();
+    stopSketch();
+    liveFeed->stop();
+    imageProjectionWindow->clearCompensation();
+    projectPage->setCompensationState(false);
+    imageProjectionWindow->setPanZoom(false);
+    projectPage->setPanZoomState(false);
+
     // reset everything
+    imageProjectionWindow->clearRegions(); // surfaces kept from earlier rounds
     calibrationPage->resetPoints(); // points for calibration
     sensitivityPage->resetSensitivitySliders(); // reset sensitivity bars
     textVisionPage->clearInput();// clear textbox
@@ -165,6 +394,7 @@ void MainWindow::navigateToCalibrationPage()
     }
     else
     {
+        liveFeed->stop();
         imageProjectionWindow->setProjectionState(ImageProjectionWindow::projectionState::SCANNING);
         calibrationPage->startCamera();
     }
@@ -174,12 +404,20 @@ void MainWindow::navigateToCalibrationPage()
 
 void MainWindow::navigateToSensitivityPage()
 {
+    // calibration is done and its camera released; start watching for drift
+    if (currentPage == Page::CALIBRATION) {
+        createPage->stopCamera();
+        driftTracker->setCorners(calibrationPage->getSortedCorners());
+        liveFeed->start();
+    }
+
     stackedWidget->setCurrentWidget(sensitivityPage);
     currentPage = Page::SENSITIVITY;
 
     sensitivityPage->updateSensitivity();
     QImage image = calibrationPage->getCleanQImage();
     pickImagesPage->setAPIImage(image);
+    pickImagesPage->prepareUpload(); // encoded while the sensitivity and prompt are chosen
 }
 
 // default vals set in .h
@@ -189,6 +427,7 @@ void MainWindow::navigateToTextVisionPage(int low, int high)
         // set threshold here
         pickImagesPage->setLowThreshold(low);
         pickImagesPage->setHighThreshold(high);
+        pickImagesPage->prepareUpload(); // the edge map is final now, encode it while the prompt is typed
     }
 
     imageProjectionWindow->setProjectionState(ImageProjectionWindow::projectionState::RAINBOW_EDGE);
@@ -218,7 +457,37 @@ void MainWindow::navigateToProjectPage(const cv::Mat& selectedImage)
     currentPage = Page::PROJECT;
 }
 
+// Keep what is projected now as its own region and run the flow again for the next surface
+void MainWindow::addAnotherSurface()
+{
+    if (surfaceCompensator->isRunning()) {
+        return;
+    }
+
+    // the frozen region keeps the image still
+    imageProjectionWindow->setPanZoom(false);
+    projectPage->setPanZoomState(false);
+    stopInteraction(); // the next surface changes what is watched
+    stopOcclusion();
+    if (!imageProjectionWindow->addRegion()) {
+        return;
+    }
+
+    calibrationPage->resetPoints(); // fresh corners and camera; frozen regions stay
+    sensitivityPage->resetSensitivitySliders();
+    textVisionPage->clearInput();
+    pickImagesPage->resetState();
+    projectPage->setCompensationState(false);
+
+    stackedWidget->setCurrentWidget(calibrationPage);
+    currentPage = Page::CALIBRATION;
+}
+
 MainWindow::~MainWindow()
 {
     // delete ui;
+    imageProjectionWindow->setOcclusionMasker(nullptr);
+    if (audioAnalyzer) {
+        imageProjectionWindow->setAudioAnalyzer(nullptr); // the window isn't our child and outlives it
+    }
 }
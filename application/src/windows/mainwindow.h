@@ -13,6 +13,13 @@
 #include "pages/project/projectpage.h"
 
 #include "windows/imageprojectionwindow.h"
+#include "utils/livefeed.h"
+#include "utils/drifttracker.h"
+#include "utils/surfacecompensator.h"
+#include "utils/audioanalyzer.h"
+#include "utils/interactiontracker.h"
+#include "utils/occlusionmasker.h"
+#include "utils/sketchwatcher.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -52,6 +59,19 @@ private:
     PickImagesPage *pickImagesPage;
     ProjectPage *projectPage;
 
+    // background camera work once calibration is done
+    LiveFeed *liveFeed;
+    DriftTracker *driftTracker;
+    SurfaceCompensator *surfaceCompensator;
+    InteractionTracker *interactionTracker;
+    OcclusionMasker *occlusionMasker;
+    SketchWatcher *sketchWatcher;
+    QString sketchPrompt;
+    bool sketchRealistic = false;
+    AudioAnalyzer *audioAnalyzer = nullptr;
+    ImageProjectionWindow::projectionState compensationReturnState = ImageProjectionWindow::projectionState::IMAGE;
+    ImageProjectionWindow::projectionState occlusionReturnState = ImageProjectionWindow::projectionState::IMAGE;
+
     Page currentPage = Page::CREATE;
 
     // functions
@@ -62,6 +82,14 @@ private:
 
     // for projection window
     void showImageProjectionWindow();
+    void toggleSurfaceCompensation();
+    void togglePanZoom();
+    void toggleInteraction();
+    void stopInteraction();
+    void toggleOcclusion();
+    void stopOcclusion();
+    void toggleSketch(QString prompt, bool isRealistic);
+    void stopSketch();
 
 
 private slots:
@@ -71,6 +99,7 @@ private slots:
     void navigateToTextVisionPage(int low, int high);
     void navigateToPickImagesPage(QString prompt, bool isRealistic); // in order to pass in vars
     void navigateToProjectPage(const cv::Mat& image = cv::Mat());
+    void addAnotherSurface();
 
 
 };
@@ -0,0 +1,51 @@
+#include "projectoroutput.h"
+#include <QVBoxLayout>
+#include <QDebug>
+#include <QPixmap>
+
+ProjectorOutput::ProjectorOutput(const QSize& size, QWidget* parent)
+    : QWidget(parent, Qt::Window | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint)
+{
+    setAttribute(Qt::WA_ShowWithoutActivating, true);
+    setFixedSize(size);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    m_imageLabel = new QLabel(this);
+    m_imageLabel->setAlignment(Qt::AlignCenter);
+    m_imageLabel->setFixedSize(size);
+    layout->addWidget(m_imageLabel);
+
+    showSolid(Qt::black);
+}
+
+// Centred on the screen, like the primary projection window
+void ProjectorOutput::showOnScreen(QScreen* screen)
+{
+    const QRect screenGeometry = screen->geometry();
+    move(screenGeometry.x() + (screenGeometry.width() - width()) / 2,
+         screenGeometry.y() + (screenGeometry.height() - height()) / 2);
+    show();
+    qDebug() << "Projector output on" << screen->name() << "at" << geometry();
+}
+
+void ProjectorOutput::present(const QImage& image)
+{
+    if (image.isNull()) {
+        qDebug() << "Received null QImage in ProjectorOutput::present";
+        return;
+    }
+
+    QPixmap pixmap = QPixmap::fromImage(image);
+    if (pixmap.size() != m_imageLabel->size()) {
+        pixmap = pixmap.scaled(m_imageLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    m_imageLabel->setPixmap(pixmap);
+}
+
+void ProjectorOutput::showSolid(const QColor& color)
+{
+    m_imageLabel->clear();
+    setStyleSheet(QString("background-color: %1;").arg(color.name()));
+}
@@ -0,0 +1,25 @@
+#ifndef PROJECTOROUTPUT_H
+#define PROJECTOROUTPUT_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QScreen>
+
+// A further projector. It only shows what the projection window renders for it;
+// calibration, effects and content all live in ImageProjectionWindow.
+class ProjectorOutput : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ProjectorOutput(const QSize& size, QWidget* parent = nullptr);
+
+    void showOnScreen(QScreen* screen);
+    void present(const QImage& image);
+    void showSolid(const QColor& color);
+
+private:
+    QLabel* m_imageLabel;
+};
+
+#endif // PROJECTOROUTPUT_H